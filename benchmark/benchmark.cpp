@@ -0,0 +1,452 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "benchmark.h"
+
+#include "flatbuffers_streaming_json_writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#else
+#include <chrono>
+#endif
+
+int64_t
+benchmark_now_us()
+{
+#ifdef ESP_PLATFORM
+  return esp_timer_get_time();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static std::string
+to_decimal(size_t i)
+{
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%u", (unsigned)i);
+  return buf;
+}
+
+static void
+append_reading(std::string& out, size_t i)
+{
+  char buf[160];
+  snprintf(buf, sizeof(buf),
+    "{\"id\":\"dev-%06u\",\"ts\":%llu,\"value\":%u.%02u,\"level\":%u,"
+    "\"ok\":%s,\"tags\":[\"zone-%u\",\"rack\"]}",
+    (unsigned)i,
+    1510000000000ULL + (unsigned long long)i * 1000,
+    (unsigned)(i % 100), (unsigned)((i * 7) % 100),
+    (unsigned)(i % 5),
+    (i % 3)? "true" : "false",
+    (unsigned)(i % 16));
+  out += buf;
+}
+
+static void
+append_readings(std::string& out, size_t count, size_t& next)
+{
+  out += "[";
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (i > 0)
+    {
+      out += ",";
+    }
+    append_reading(out, next++);
+  }
+  out += "]";
+}
+
+// {"readings": [...]}, a single large item
+static BenchmarkScenario
+make_large_array(size_t readings)
+{
+  BenchmarkScenario scenario;
+  scenario.name = "large_array";
+  scenario.path = {"readings"};
+  scenario.expected_items = 1;
+  scenario.expected_errors = 0;
+
+  size_t next = 0;
+  scenario.payload = "{\"readings\":";
+  append_readings(scenario.payload, readings, next);
+  scenario.payload += "}";
+  return scenario;
+}
+
+// {"pages": [{"readings": [...]}, ...]}, many small items
+static BenchmarkScenario
+make_many_items(size_t pages, size_t readings)
+{
+  BenchmarkScenario scenario;
+  scenario.name = "many_items";
+  scenario.path = {"pages", "readings"};
+  scenario.expected_items = pages;
+  scenario.expected_errors = 0;
+
+  size_t next = 0;
+  scenario.payload = "{\"pages\":[";
+  for (size_t p = 0; p < pages; ++p)
+  {
+    scenario.payload += (p > 0)? ",{\"readings\":" : "{\"readings\":";
+    append_readings(scenario.payload, readings, next);
+    scenario.payload += ",\"cursor\":\"skipped\"}";
+  }
+  scenario.payload += "]}";
+  return scenario;
+}
+
+// {"results": [{"l0": {"l1": ... {"readings": [...]}}}, ...]}
+static BenchmarkScenario
+make_deep_nesting(size_t pages, size_t depth, size_t readings)
+{
+  BenchmarkScenario scenario;
+  scenario.name = "deep_nesting";
+  scenario.path = {"results"};
+  scenario.expected_items = pages;
+  scenario.expected_errors = 0;
+
+  std::string open;
+  std::string close;
+  for (size_t d = 0; d < depth; ++d)
+  {
+    std::string key = "l" + to_decimal(d);
+    scenario.path.push_back(key);
+    open += "{\"" + key + "\":";
+    close += "}";
+  }
+  scenario.path.push_back("readings");
+
+  size_t next = 0;
+  scenario.payload = "{\"results\":[";
+  for (size_t p = 0; p < pages; ++p)
+  {
+    if (p > 0)
+    {
+      scenario.payload += ",";
+    }
+    scenario.payload += open + "{\"readings\":";
+    append_readings(scenario.payload, readings, next);
+    scenario.payload += "}" + close;
+  }
+  scenario.payload += "]}";
+  return scenario;
+}
+
+// {"pages": [{"entries": {"<id>": {...}, ...}}, ...]}, the id/val rewrite
+static BenchmarkScenario
+make_keyed_vector(size_t pages, size_t entries)
+{
+  BenchmarkScenario scenario;
+  scenario.name = "keyed_vector";
+  scenario.path = {"pages", "entries"};
+  scenario.expected_items = pages;
+  scenario.expected_errors = 0;
+
+  size_t next = 0;
+  scenario.payload = "{\"pages\":[";
+  for (size_t p = 0; p < pages; ++p)
+  {
+    scenario.payload += (p > 0)? ",{\"entries\":{" : "{\"entries\":{";
+    for (size_t e = 0; e < entries; ++e)
+    {
+      if (e > 0)
+      {
+        scenario.payload += ",";
+      }
+      // In sorted order, as the direct builder sorts keyed vectors and the
+      // text mode keeps document order, so both deliver the same items
+      char key[24];
+      snprintf(key, sizeof(key), "\"key-%06u\":", (unsigned)next);
+      scenario.payload += key;
+      append_reading(scenario.payload, next++);
+    }
+    scenario.payload += "}}";
+  }
+  scenario.payload += "]}";
+  return scenario;
+}
+
+// {"shards": {"<shard>": {"readings": [...]}, ...}}
+static BenchmarkScenario
+make_wildcard(size_t shards, size_t readings)
+{
+  BenchmarkScenario scenario;
+  scenario.name = "wildcard";
+  scenario.path = {"shards", "*", "readings"};
+  scenario.expected_items = shards;
+  scenario.expected_errors = 0;
+
+  size_t next = 0;
+  scenario.payload = "{\"shards\":{";
+  for (size_t s = 0; s < shards; ++s)
+  {
+    if (s > 0)
+    {
+      scenario.payload += ",";
+    }
+    scenario.payload += "\"shard-" + to_decimal(s) + "\":{\"readings\":";
+    append_readings(scenario.payload, readings, next);
+    scenario.payload += "}";
+  }
+  scenario.payload += "}}";
+  return scenario;
+}
+
+// {"pages": [{"readings": [...]}, {"error": {...}}, ...]}
+static BenchmarkScenario
+make_error_path(size_t pages, size_t readings, size_t error_every)
+{
+  BenchmarkScenario scenario;
+  scenario.name = "error_path";
+  scenario.path = {"pages", "readings"};
+  scenario.error_path = {"pages", "error"};
+  scenario.expected_items = 0;
+  scenario.expected_errors = 0;
+
+  size_t next = 0;
+  scenario.payload = "{\"pages\":[";
+  for (size_t p = 0; p < pages; ++p)
+  {
+    if (p > 0)
+    {
+      scenario.payload += ",";
+    }
+
+    if ((p % error_every) == (error_every - 1))
+    {
+      scenario.payload +=
+        "{\"error\":{\"code\":" + to_decimal(400 + (p % 100)) +
+        ",\"message\":\"rate limited, retry later\"}}";
+      scenario.expected_errors++;
+    }
+    else {
+      scenario.payload += "{\"readings\":";
+      append_readings(scenario.payload, readings, next);
+      scenario.payload += "}";
+      scenario.expected_items++;
+    }
+  }
+  scenario.payload += "]}";
+  return scenario;
+}
+
+std::vector<BenchmarkScenario>
+make_benchmark_scenarios(size_t scale)
+{
+  if (scale == 0)
+  {
+    scale = 1;
+  }
+
+  std::vector<BenchmarkScenario> scenarios;
+  scenarios.push_back(make_large_array(200 * scale));
+  scenarios.push_back(make_many_items(100 * scale, 2));
+  scenarios.push_back(make_deep_nesting(50 * scale, 12, 2));
+  scenarios.push_back(make_keyed_vector(50 * scale, 4));
+  scenarios.push_back(make_wildcard(50 * scale, 4));
+  scenarios.push_back(make_error_path(100 * scale, 2, 4));
+  return scenarios;
+}
+
+// A size-prefixed item from a sink, written out as one line of JSON
+static bool
+append_benchmark_item_json(
+  const FlatbuffersStreamingJsonParser& parser,
+  const reflection::Object* table,
+  const uint8_t* record,
+  size_t len,
+  std::string& out)
+{
+  // The record is only valid during the write, and is read in place
+  std::vector<uint64_t> aligned((len + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  memcpy(aligned.data(), record, len);
+
+  FlatbuffersStreamingJsonWriter writer(parser.get_compiled_schema());
+  auto buf = reinterpret_cast<const uint8_t*>(aligned.data()) + sizeof(flatbuffers::uoffset_t);
+  if (!writer.start(buf, table))
+  {
+    return false;
+  }
+
+  char chunk[256];
+  bool ok = writer.write(chunk, sizeof(chunk), [&out](const char* data, size_t size)
+  {
+    out.append(data, size);
+    return true;
+  });
+
+  out += "\n";
+  return ok;
+}
+
+// Every item and error of one parse of the scenario, as JSON
+static bool
+capture_benchmark_output(
+  FlatbuffersStreamingJsonParser& parser,
+  FlatbuffersStreamingJsonBuildMode mode,
+  const BenchmarkScenario& scenario,
+  size_t chunk_size,
+  std::string& out)
+{
+  auto batch_table = parser.get_flatbuffers_table(bench::Batch::GetFullyQualifiedName());
+  auto error_table = parser.get_flatbuffers_table(bench::Error::GetFullyQualifiedName());
+  bool written = true;
+
+  BenchmarkVisitor visitor(parser, mode);
+  if (!scenario.error_path.empty())
+  {
+    visitor.subscribe_sink<bench::ErrorT>(
+      scenario.error_path,
+      [&](const uint8_t* record, size_t len)
+      {
+        out += "error ";
+        written = append_benchmark_item_json(parser, error_table, record, len, out) && written;
+        return true;
+      });
+  }
+  visitor.subscribe_sink<bench::BatchT>(
+    scenario.path,
+    [&](const uint8_t* record, size_t len)
+    {
+      out += "item ";
+      written = append_benchmark_item_json(parser, batch_table, record, len, out) && written;
+      return true;
+    });
+
+  visitor.begin_stream();
+
+  bool ok = true;
+  const auto& payload = scenario.payload;
+  for (size_t i = 0; ok && (i < payload.size()); i += chunk_size)
+  {
+    ok = visitor.feed(payload.data() + i, std::min(chunk_size, payload.size() - i));
+  }
+
+  return visitor.finish() && ok && written;
+}
+
+bool
+check_benchmark_scenario_output(
+  FlatbuffersStreamingJsonParser& parser,
+  const BenchmarkScenario& scenario,
+  size_t chunk_size)
+{
+  const size_t whole = scenario.payload.size();
+
+  std::string text;
+  std::string direct;
+  std::string text_chunked;
+  std::string direct_chunked;
+  bool ok = (
+    capture_benchmark_output(parser, FlatbuffersStreamingJsonBuildMode::ReserializeJson, scenario, whole, text) &&
+    capture_benchmark_output(parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder, scenario, whole, direct) &&
+    capture_benchmark_output(parser, FlatbuffersStreamingJsonBuildMode::ReserializeJson, scenario, chunk_size, text_chunked) &&
+    capture_benchmark_output(parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder, scenario, chunk_size, direct_chunked)
+  );
+
+  return (
+    ok &&
+    !text.empty() &&
+    (direct == text) &&
+    (text_chunked == text) &&
+    (direct_chunked == text)
+  );
+}
+
+void
+print_benchmark_header()
+{
+  printf("%-14s %-10s %4s %10s %7s %9s %11s %10s %11s\n",
+    "scenario", "mode", "ok", "bytes", "items", "MB/s", "items/s", "peak_heap", "allocs/item");
+}
+
+void
+print_benchmark_result(const BenchmarkResult& result)
+{
+  double seconds = (result.elapsed_us > 0)? (result.elapsed_us / 1e6) : 1e-6;
+  double allocs_per_item = (result.items > 0)?
+    (static_cast<double>(result.allocations) / result.items) : 0.0;
+
+  printf("%-14s %-10s %4s %10u %7u %9.3f %11.1f %10u %11.2f\n",
+    result.scenario,
+    result.mode,
+    result.ok? "yes" : "NO",
+    (unsigned)result.bytes,
+    (unsigned)result.items,
+    (result.bytes / seconds) / (1024.0 * 1024.0),
+    result.items / seconds,
+    (unsigned)result.peak_heap,
+    allocs_per_item);
+}
+
+template<typename ConstructT>
+static void
+print_benchmark_startup(const char* mode, ConstructT construct)
+{
+  auto before = benchmark_alloc_get_stats();
+  auto start_us = benchmark_now_us();
+
+  std::unique_ptr<FlatbuffersStreamingJsonParser> parser(construct());
+
+  auto end_us = benchmark_now_us();
+  auto after = benchmark_alloc_get_stats();
+
+  printf("startup %-14s ok=%s %8lld us %8u bytes resident\n",
+    mode,
+    parser->is_ready()? "yes" : "no",
+    (long long)(end_us - start_us),
+    (unsigned)(after.current_bytes - before.current_bytes));
+}
+
+void
+print_benchmark_startup(
+  stx::string_view text_schema,
+  stx::string_view binary_schema)
+{
+  print_benchmark_startup("text+binary", [&]()
+  {
+    return new FlatbuffersStreamingJsonParser(text_schema, binary_schema);
+  });
+
+  print_benchmark_startup("binary", [&]()
+  {
+    return new FlatbuffersStreamingJsonParser(binary_schema);
+  });
+}
+
+void
+print_benchmark_stats(
+  const char* mode,
+  const FlatbuffersStreamingJsonStats& visitor_stats,
+  const FlatbuffersStreamingJsonStats& parser_stats)
+{
+  printf("%-10s lex=%llu serialize=%llu parse=%llu verify=%llu unpack=%llu callback=%llu "
+    "verifier_failures=%u verifications_skipped=%u peak_item_json=%u peak_builder=%u\n",
+    mode,
+    (unsigned long long)visitor_stats.lex_cycles,
+    (unsigned long long)visitor_stats.serialize_cycles,
+    (unsigned long long)parser_stats.parse_cycles,
+    (unsigned long long)parser_stats.verify_cycles,
+    (unsigned long long)parser_stats.unpack_cycles,
+    (unsigned long long)visitor_stats.callback_cycles,
+    (unsigned)parser_stats.verifier_failures,
+    (unsigned)parser_stats.verifications_skipped,
+    (unsigned)visitor_stats.peak_item_json_size,
+    (unsigned)std::max(visitor_stats.peak_builder_size, parser_stats.peak_builder_size));
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+// Streaming parser benchmark, shared by the host (host/) and ESP-IDF (esp32/)
+// harnesses. Both need the generated code from benchmark.fbs:
+//   make -C benchmark/host generate FLATC=/path/to/flatc
+#include "benchmark_generated.h"
+
+#include "flatbuffers_streaming_json_visitor.h"
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Counters kept by the replaced global operator new/delete (benchmark_alloc.cpp)
+struct BenchmarkAllocStats
+{
+  size_t allocations;
+  size_t current_bytes;
+  size_t peak_bytes;
+};
+
+BenchmarkAllocStats benchmark_alloc_get_stats();
+
+// Restart peak tracking from the current heap usage
+void benchmark_alloc_reset_peak();
+
+// Monotonic microseconds
+int64_t benchmark_now_us();
+
+// Read-only stream over a payload, so the benchmark input needs no copy
+class BenchmarkMemoryStreambuf
+: public std::streambuf
+{
+public:
+  BenchmarkMemoryStreambuf(const std::string& payload)
+  {
+    char* begin = const_cast<char*>(payload.data());
+    setg(begin, begin, begin + payload.size());
+  }
+};
+
+struct BenchmarkScenario
+{
+  const char* name;
+  std::string payload;
+
+  std::vector<std::string> path;
+
+  // Empty for no error subscription
+  std::vector<std::string> error_path;
+
+  size_t expected_items;
+  size_t expected_errors;
+};
+
+struct BenchmarkResult
+{
+  const char* scenario;
+  const char* mode;
+  bool ok;
+
+  size_t bytes;
+  size_t items;
+  int64_t elapsed_us;
+
+  size_t peak_heap;
+  size_t allocations;
+};
+
+// Payloads scale linearly, scale=1 fits comfortably in ESP32 internal RAM
+std::vector<BenchmarkScenario> make_benchmark_scenarios(size_t scale);
+
+// Each item of the scenario, written back out as JSON, must match between
+// the text and direct build modes, and between parsing the payload whole
+// and feeding it chunk_size bytes at a time
+bool check_benchmark_scenario_output(
+  FlatbuffersStreamingJsonParser& parser,
+  const BenchmarkScenario& scenario,
+  size_t chunk_size);
+
+void print_benchmark_header();
+void print_benchmark_result(const BenchmarkResult& result);
+
+// Time and resident heap of constructing a parser from both schemas,
+// and from the binary schema alone
+void print_benchmark_startup(
+  stx::string_view text_schema,
+  stx::string_view binary_schema);
+
+// Per-phase breakdown, only non-zero with FLATBUFFERS_STREAMING_JSON_STATS
+void print_benchmark_stats(
+  const char* mode,
+  const FlatbuffersStreamingJsonStats& visitor_stats,
+  const FlatbuffersStreamingJsonStats& parser_stats);
+
+typedef FlatbuffersStreamingJsonVisitor<bench::BatchT, bench::ErrorT> BenchmarkVisitor;
+
+// Parse the scenario payload iterations times with the visitor,
+// after subscribe(visitor, items, errors) registers counting subscriptions
+template<typename SubscribeT>
+inline BenchmarkResult
+run_benchmark_scenario(
+  BenchmarkVisitor& visitor,
+  const char* mode,
+  const BenchmarkScenario& scenario,
+  size_t iterations,
+  SubscribeT subscribe)
+{
+  size_t items = 0;
+  size_t errors = 0;
+
+  visitor.clear_subscriptions();
+  subscribe(visitor, items, errors);
+
+  // One untimed pass, so steady-state capacities are already allocated
+  {
+    BenchmarkMemoryStreambuf buf(scenario.payload);
+    std::istream in(&buf);
+    visitor.parse_stream(in);
+  }
+
+  items = 0;
+  errors = 0;
+
+  bool ok = true;
+  auto before = benchmark_alloc_get_stats();
+  benchmark_alloc_reset_peak();
+  auto start_us = benchmark_now_us();
+
+  for (size_t i = 0; i < iterations; ++i)
+  {
+    BenchmarkMemoryStreambuf buf(scenario.payload);
+    std::istream in(&buf);
+    ok = visitor.parse_stream(in) && ok;
+  }
+
+  auto end_us = benchmark_now_us();
+  auto after = benchmark_alloc_get_stats();
+
+  BenchmarkResult result;
+  result.scenario = scenario.name;
+  result.mode = mode;
+  result.ok = (
+    ok &&
+    (items == scenario.expected_items * iterations) &&
+    (errors == scenario.expected_errors * iterations)
+  );
+  result.bytes = scenario.payload.size() * iterations;
+  result.items = items + errors;
+  result.elapsed_us = (end_us - start_us);
+  result.peak_heap = (after.peak_bytes > before.current_bytes)?
+    (after.peak_bytes - before.current_bytes) : 0;
+  result.allocations = (after.allocations - before.allocations);
+
+  return result;
+}
+
+// Delivers zero-copy tables, so only parsing and building are measured
+inline BenchmarkResult
+run_benchmark_scenario(
+  BenchmarkVisitor& visitor,
+  const char* mode,
+  const BenchmarkScenario& scenario,
+  size_t iterations)
+{
+  return run_benchmark_scenario(
+    visitor,
+    mode,
+    scenario,
+    iterations,
+    [&scenario](BenchmarkVisitor& v, size_t& items, size_t& errors)
+    {
+      if (!scenario.error_path.empty())
+      {
+        v.subscribe<bench::ErrorT>(
+          scenario.error_path,
+          std::function<bool(const bench::Error*)>(
+            [&errors](const bench::Error*) { errors++; return true; }));
+      }
+      v.subscribe<bench::BatchT>(
+        scenario.path,
+        std::function<bool(const bench::Batch*)>(
+          [&items](const bench::Batch*) { items++; return true; }));
+    });
+}
+
+// Delivers items in batches of up to max_items, or max_bytes
+inline BenchmarkResult
+run_batched_benchmark_scenario(
+  BenchmarkVisitor& visitor,
+  const char* mode,
+  const BenchmarkScenario& scenario,
+  size_t iterations,
+  size_t max_items,
+  size_t max_bytes)
+{
+  return run_benchmark_scenario(
+    visitor,
+    mode,
+    scenario,
+    iterations,
+    [&](BenchmarkVisitor& v, size_t& items, size_t& errors)
+    {
+      if (!scenario.error_path.empty())
+      {
+        v.subscribe_batched<bench::ErrorT>(
+          scenario.error_path,
+          max_items,
+          max_bytes,
+          [&errors](const FlatbuffersStreamingJsonBatch<bench::Error>& batch)
+          {
+            errors += batch.size();
+            return true;
+          });
+      }
+      v.subscribe_batched<bench::BatchT>(
+        scenario.path,
+        max_items,
+        max_bytes,
+        [&items](const FlatbuffersStreamingJsonBatch<bench::Batch>& batch)
+        {
+          items += batch.size();
+          return true;
+        });
+    });
+}
+
+// Builds batches of up to max_items, or max_bytes, into one buffer each,
+// sharing strings and vtables. Needs the direct builder
+inline BenchmarkResult
+run_shared_batch_benchmark_scenario(
+  BenchmarkVisitor& visitor,
+  const char* mode,
+  const BenchmarkScenario& scenario,
+  size_t iterations,
+  size_t max_items,
+  size_t max_bytes)
+{
+  return run_benchmark_scenario(
+    visitor,
+    mode,
+    scenario,
+    iterations,
+    [&](BenchmarkVisitor& v, size_t& items, size_t& errors)
+    {
+      if (!scenario.error_path.empty())
+      {
+        v.subscribe_shared_batch<bench::ErrorT>(
+          scenario.error_path,
+          max_items,
+          max_bytes,
+          [&errors](const FlatbuffersStreamingJsonSharedBatch<bench::Error>& batch)
+          {
+            errors += batch.size();
+            return true;
+          });
+      }
+      v.subscribe_shared_batch<bench::BatchT>(
+        scenario.path,
+        max_items,
+        max_bytes,
+        [&items](const FlatbuffersStreamingJsonSharedBatch<bench::Batch>& batch)
+        {
+          items += batch.size();
+          return true;
+        });
+    });
+}
+
+// Writes size-prefixed items to a sink which only counts them,
+// so only parsing, building and verifying are measured
+inline BenchmarkResult
+run_sink_benchmark_scenario(
+  BenchmarkVisitor& visitor,
+  const char* mode,
+  const BenchmarkScenario& scenario,
+  size_t iterations)
+{
+  return run_benchmark_scenario(
+    visitor,
+    mode,
+    scenario,
+    iterations,
+    [&scenario](BenchmarkVisitor& v, size_t& items, size_t& errors)
+    {
+      if (!scenario.error_path.empty())
+      {
+        v.subscribe_sink<bench::ErrorT>(
+          scenario.error_path,
+          [&errors](const uint8_t*, size_t) { errors++; return true; });
+      }
+      v.subscribe_sink<bench::BatchT>(
+        scenario.path,
+        [&items](const uint8_t*, size_t) { items++; return true; });
+    });
+}
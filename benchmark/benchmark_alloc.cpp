@@ -0,0 +1,116 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "benchmark.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new/delete, to count C++ heap allocations.
+// Each block is prefixed with its size, so live (and peak) bytes are known.
+// Atomic, as pipelined rows allocate on the pipeline's thread too
+
+static std::atomic<size_t> alloc_count(0);
+static std::atomic<size_t> alloc_current_bytes(0);
+static std::atomic<size_t> alloc_peak_bytes(0);
+
+// Keeps the returned block aligned for any type
+static constexpr size_t alloc_header_size = 16;
+
+static void*
+counted_alloc(size_t size)
+{
+  auto p = static_cast<uint8_t*>(malloc(size + alloc_header_size));
+  if (p == nullptr)
+  {
+    abort();
+  }
+
+  *reinterpret_cast<size_t*>(p) = size;
+
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  size_t current = alloc_current_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  size_t peak = alloc_peak_bytes.load(std::memory_order_relaxed);
+  while ((current > peak) &&
+         !alloc_peak_bytes.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+  {
+  }
+
+  return (p + alloc_header_size);
+}
+
+static void
+counted_free(void* ptr)
+{
+  if (ptr == nullptr)
+  {
+    return;
+  }
+
+  auto p = static_cast<uint8_t*>(ptr) - alloc_header_size;
+  alloc_current_bytes.fetch_sub(*reinterpret_cast<size_t*>(p), std::memory_order_relaxed);
+  free(p);
+}
+
+void* operator new(size_t size)
+{
+  return counted_alloc(size);
+}
+
+void* operator new[](size_t size)
+{
+  return counted_alloc(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+  return counted_alloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+  return counted_alloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+  counted_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+  counted_free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+  counted_free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+  counted_free(ptr);
+}
+
+BenchmarkAllocStats
+benchmark_alloc_get_stats()
+{
+  BenchmarkAllocStats stats;
+  stats.allocations = alloc_count.load();
+  stats.current_bytes = alloc_current_bytes.load();
+  stats.peak_bytes = alloc_peak_bytes.load();
+  return stats;
+}
+
+void
+benchmark_alloc_reset_peak()
+{
+  alloc_peak_bytes.store(alloc_current_bytes.load());
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "benchmark.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+
+#include <cstdio>
+
+static const char* TAG = "benchmark";
+
+// Embedded by COMPONENT_EMBED_TXTFILES, which appends a NUL terminator
+extern const char benchmark_fbs_start[] asm("_binary_benchmark_fbs_start");
+extern const char benchmark_fbs_end[] asm("_binary_benchmark_fbs_end");
+extern const char benchmark_bfbs_start[] asm("_binary_benchmark_bfbs_start");
+extern const char benchmark_bfbs_end[] asm("_binary_benchmark_bfbs_end");
+
+static const size_t benchmark_scale = 1;
+static const size_t benchmark_iterations = 5;
+static const size_t benchmark_arena_size = 16 * 1024;
+static const size_t benchmark_ring_size = 16 * 1024;
+
+static void
+benchmark_task(void* arg)
+{
+  FlatbuffersStreamingJsonParser parser(
+    stx::string_view(benchmark_fbs_start, benchmark_fbs_end - benchmark_fbs_start),
+    stx::string_view(benchmark_bfbs_start, benchmark_bfbs_end - benchmark_bfbs_start));
+  if (!parser.is_ready())
+  {
+    ESP_LOGE(TAG, "Could not load benchmark schemas");
+    vTaskDelete(nullptr);
+    return;
+  }
+
+  print_benchmark_startup(
+    stx::string_view(benchmark_fbs_start, benchmark_fbs_end - benchmark_fbs_start),
+    stx::string_view(benchmark_bfbs_start, benchmark_bfbs_end - benchmark_bfbs_start));
+
+  {
+    FlatbuffersStreamingJsonArena arena(benchmark_arena_size);
+
+    BenchmarkVisitor text(parser);
+    BenchmarkVisitor direct(parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder);
+    BenchmarkVisitor direct_arena(parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder, &arena);
+
+    // Trusts the builders' output, skipping verification
+    FlatbuffersStreamingJsonParser trusted_parser(parser.get_compiled_schema());
+    trusted_parser.set_verify_policy(FlatbuffersStreamingJsonVerifyPolicy::Never);
+    BenchmarkVisitor text_trusted(trusted_parser);
+    BenchmarkVisitor direct_trusted(trusted_parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder);
+
+    // Lexing stays on this core, items are dispatched on core 1
+    FlatbuffersStreamingJsonPipeline pipeline(parser.get_compiled_schema(), benchmark_ring_size, 1);
+    pipeline.start();
+    FlatbuffersStreamingJsonParser pipelined_parser(parser.get_compiled_schema());
+    BenchmarkVisitor text_pipelined(pipelined_parser);
+    BenchmarkVisitor direct_pipelined(pipelined_parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder);
+    text_pipelined.set_pipeline(&pipeline);
+    direct_pipelined.set_pipeline(&pipeline);
+
+    auto scenarios = make_benchmark_scenarios(benchmark_scale);
+
+    for (const auto& scenario : scenarios)
+    {
+      bool same = check_benchmark_scenario_output(parser, scenario, 7);
+      printf("output %-14s %s\n", scenario.name, same? "matches" : "DIFFERS");
+    }
+
+    print_benchmark_header();
+    for (const auto& scenario : scenarios)
+    {
+      print_benchmark_result(run_benchmark_scenario(text, "text", scenario, benchmark_iterations));
+      print_benchmark_result(run_benchmark_scenario(direct, "direct", scenario, benchmark_iterations));
+      print_benchmark_result(run_benchmark_scenario(text_trusted, "text_nv", scenario, benchmark_iterations));
+      print_benchmark_result(run_benchmark_scenario(direct_trusted, "direct_nv", scenario, benchmark_iterations));
+      print_benchmark_result(run_benchmark_scenario(direct_arena, "arena", scenario, benchmark_iterations));
+      print_benchmark_result(run_batched_benchmark_scenario(
+        direct, "batched", scenario, benchmark_iterations, 16, 8 * 1024));
+      print_benchmark_result(run_shared_batch_benchmark_scenario(
+        direct, "shared", scenario, benchmark_iterations, 16, 8 * 1024));
+      print_benchmark_result(run_sink_benchmark_scenario(direct, "sink", scenario, benchmark_iterations));
+      print_benchmark_result(run_benchmark_scenario(text_pipelined, "text_pl", scenario, benchmark_iterations));
+      print_benchmark_result(run_benchmark_scenario(direct_pipelined, "direct_pl", scenario, benchmark_iterations));
+    }
+
+    ESP_LOGI(TAG, "arena overflowed %u times, free heap %u",
+      (unsigned)arena.get_overflow_count(), (unsigned)esp_get_free_heap_size());
+  }
+
+  vTaskDelete(nullptr);
+}
+
+extern "C" void app_main()
+{
+  xTaskCreatePinnedToCore(&benchmark_task, "benchmark", 16 * 1024, nullptr, 5, nullptr, 0);
+}
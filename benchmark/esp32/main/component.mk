@@ -0,0 +1,16 @@
+#
+# Component Makefile
+#
+
+COMPONENT_ADD_INCLUDEDIRS := \
+	. \
+	../.. \
+	../../generated
+
+COMPONENT_SRCDIRS := \
+	. \
+	../..
+
+COMPONENT_EMBED_TXTFILES := \
+	../../benchmark.fbs \
+	../../generated/benchmark.bfbs
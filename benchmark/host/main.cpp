@@ -0,0 +1,154 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "benchmark.h"
+
+// Generated by tools/flatbuffers_streaming_json_gen, see the Makefile
+#include "benchmark_streaming_json.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+// Schemas are NUL terminated, as FlatbuffersStreamingJsonParser expects
+static std::string
+load_schema(const char* filename)
+{
+  std::ifstream in(filename, std::ios::binary);
+  std::string contents(
+    (std::istreambuf_iterator<char>(in)),
+    std::istreambuf_iterator<char>());
+  if (!contents.empty())
+  {
+    contents.push_back('\0');
+  }
+  return contents;
+}
+
+// Decodes straight into native objects, without the builder or a schema
+static BenchmarkResult
+run_decoded_benchmark_scenario(
+  BenchmarkVisitor& visitor,
+  const BenchmarkScenario& scenario,
+  size_t iterations)
+{
+  return run_benchmark_scenario(
+    visitor,
+    "decoded",
+    scenario,
+    iterations,
+    [&scenario](BenchmarkVisitor& v, size_t& items, size_t& errors)
+    {
+      if (!scenario.error_path.empty())
+      {
+        v.subscribe_decoded<bench::ErrorT>(
+          scenario.error_path,
+          [&errors](const bench::ErrorT&) { errors++; return true; });
+      }
+      v.subscribe_decoded<bench::BatchT>(
+        scenario.path,
+        [&items](const bench::BatchT&) { items++; return true; });
+    });
+}
+
+// usage: benchmark [scale] [iterations] [benchmark.fbs] [benchmark.bfbs]
+int main(int argc, char** argv)
+{
+  size_t scale = (argc > 1)? strtoul(argv[1], nullptr, 10) : 10;
+  size_t iterations = (argc > 2)? strtoul(argv[2], nullptr, 10) : 20;
+  auto text_schema = load_schema((argc > 3)? argv[3] : "../benchmark.fbs");
+  auto binary_schema = load_schema((argc > 4)? argv[4] : "../generated/benchmark.bfbs");
+
+  FlatbuffersStreamingJsonParser parser(
+    stx::string_view(text_schema.data(), text_schema.size()),
+    stx::string_view(binary_schema.data(), binary_schema.size()));
+  if (!parser.is_ready())
+  {
+    fprintf(stderr, "Could not load benchmark schemas\n");
+    return EXIT_FAILURE;
+  }
+
+  print_benchmark_startup(
+    stx::string_view(text_schema.data(), text_schema.size()),
+    stx::string_view(binary_schema.data(), binary_schema.size()));
+
+  FlatbuffersStreamingJsonArena arena(64 * 1024);
+
+  BenchmarkVisitor text(parser);
+  BenchmarkVisitor direct(parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder);
+  BenchmarkVisitor direct_arena(parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder, &arena);
+  BenchmarkVisitor decoded(parser);
+
+  // Trusts the builders' output, skipping verification
+  FlatbuffersStreamingJsonParser trusted_parser(parser.get_compiled_schema());
+  trusted_parser.set_verify_policy(FlatbuffersStreamingJsonVerifyPolicy::Never);
+  BenchmarkVisitor text_trusted(trusted_parser);
+  BenchmarkVisitor direct_trusted(trusted_parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder);
+
+  // Items are dispatched on a second thread, sharing the schema
+  FlatbuffersStreamingJsonPipeline pipeline(parser.get_compiled_schema(), 64 * 1024);
+  pipeline.start();
+  FlatbuffersStreamingJsonParser pipelined_parser(parser.get_compiled_schema());
+  BenchmarkVisitor text_pipelined(pipelined_parser);
+  BenchmarkVisitor direct_pipelined(pipelined_parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder);
+  text_pipelined.set_pipeline(&pipeline);
+  direct_pipelined.set_pipeline(&pipeline);
+
+  auto scenarios = make_benchmark_scenarios(scale);
+
+  // Every mode must deliver the same items before any are timed
+  bool ok = true;
+  for (const auto& scenario : scenarios)
+  {
+    bool same = check_benchmark_scenario_output(parser, scenario, 7);
+    printf("output %-14s %s\n", scenario.name, same? "matches" : "DIFFERS");
+    ok = ok && same;
+  }
+
+  print_benchmark_header();
+  for (const auto& scenario : scenarios)
+  {
+    BenchmarkResult results[] = {
+      run_benchmark_scenario(text, "text", scenario, iterations),
+      run_benchmark_scenario(direct, "direct", scenario, iterations),
+      run_benchmark_scenario(text_trusted, "text_nv", scenario, iterations),
+      run_benchmark_scenario(direct_trusted, "direct_nv", scenario, iterations),
+      run_benchmark_scenario(direct_arena, "arena", scenario, iterations),
+      run_decoded_benchmark_scenario(decoded, scenario, iterations),
+      run_batched_benchmark_scenario(direct, "batched", scenario, iterations, 64, 64 * 1024),
+      run_shared_batch_benchmark_scenario(direct, "shared", scenario, iterations, 64, 64 * 1024),
+      run_sink_benchmark_scenario(direct, "sink", scenario, iterations),
+      run_benchmark_scenario(text_pipelined, "text_pl", scenario, iterations),
+      run_benchmark_scenario(direct_pipelined, "direct_pl", scenario, iterations),
+    };
+
+    for (const auto& result : results)
+    {
+      print_benchmark_result(result);
+      ok = ok && result.ok;
+    }
+  }
+
+  if (FlatbuffersStreamingJsonStats::enabled)
+  {
+    // The parser is shared, so its phases are totals over all modes
+    print_benchmark_stats("text", text.get_stats(), parser.get_stats());
+    print_benchmark_stats("direct", direct.get_stats(), parser.get_stats());
+    print_benchmark_stats("arena", direct_arena.get_stats(), parser.get_stats());
+    print_benchmark_stats("decoded", decoded.get_stats(), parser.get_stats());
+  }
+
+  if (arena.get_overflow_count() > 0)
+  {
+    printf("arena overflowed %u times\n", (unsigned)arena.get_overflow_count());
+  }
+
+  return ok? EXIT_SUCCESS : EXIT_FAILURE;
+}
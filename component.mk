@@ -17,3 +17,6 @@ CXXFLAGS += \
 	-DPICOJSON_USE_INT64=1
 
 flatbuffers/src/idl_parser.o: CXXFLAGS += -Wno-maybe-uninitialized -Wno-type-limits
+
+# Hot-path counters and cycle timing, see flatbuffers_streaming_json_stats.h
+#CXXFLAGS += -DFLATBUFFERS_STREAMING_JSON_STATS=1
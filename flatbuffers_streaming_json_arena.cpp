@@ -0,0 +1,160 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_arena.h"
+
+#include <cstring>
+
+constexpr char FlatbuffersStreamingJsonArena::TAG[];
+
+// Largest scalar alignment a flatbuffer needs
+static constexpr size_t arena_alignment = 8;
+
+FlatbuffersStreamingJsonArena::FlatbuffersStreamingJsonArena(
+  uint8_t* _buf,
+  size_t _capacity
+)
+: buf(_buf)
+, capacity(_capacity)
+{
+  // Only use the aligned part of the region
+  auto misalignment = reinterpret_cast<uintptr_t>(buf) % arena_alignment;
+  if ((buf != nullptr) && (misalignment != 0))
+  {
+    auto skip = arena_alignment - misalignment;
+    buf += skip;
+    capacity = (capacity > skip)? (capacity - skip) : 0;
+  }
+}
+
+FlatbuffersStreamingJsonArena::FlatbuffersStreamingJsonArena(
+  size_t _capacity
+)
+: buf(new uint8_t[align_size(_capacity)])
+, capacity(align_size(_capacity))
+, own_buf(true)
+{
+}
+
+FlatbuffersStreamingJsonArena::~FlatbuffersStreamingJsonArena()
+{
+  if (own_buf)
+  {
+    delete[] buf;
+  }
+}
+
+uint8_t*
+FlatbuffersStreamingJsonArena::allocate(size_t size)
+{
+  size = align_size(size);
+  if (size > (capacity - used))
+  {
+    // Still correct, but no longer predictable
+    overflow_count++;
+    return new uint8_t[size];
+  }
+
+  last_p = buf + used;
+  used += size;
+  if (used > high_water)
+  {
+    high_water = used;
+  }
+
+  return last_p;
+}
+
+void
+FlatbuffersStreamingJsonArena::deallocate(uint8_t* p, size_t)
+{
+  if (!owns(p))
+  {
+    delete[] p;
+    return;
+  }
+
+  // Otherwise the space is reclaimed by reset()
+  if (p == last_p)
+  {
+    used = (p - buf);
+    last_p = nullptr;
+  }
+}
+
+uint8_t*
+FlatbuffersStreamingJsonArena::reallocate_downward(
+  uint8_t* old_p,
+  size_t old_size,
+  size_t new_size)
+{
+  // Grow the most recent allocation in place, when it fits
+  if ((old_p != nullptr) && (old_p == last_p))
+  {
+    size_t offset = (old_p - buf);
+    size_t aligned_size = align_size(new_size);
+    if (aligned_size <= (capacity - offset))
+    {
+      // The builder's data lives at the end of its buffer
+      memmove(old_p + (new_size - old_size), old_p, old_size);
+
+      used = offset + aligned_size;
+      if (used > high_water)
+      {
+        high_water = used;
+      }
+      return old_p;
+    }
+  }
+
+  return flatbuffers::Allocator::reallocate_downward(old_p, old_size, new_size);
+}
+
+void
+FlatbuffersStreamingJsonArena::reset()
+{
+  used = 0;
+  last_p = nullptr;
+}
+
+size_t
+FlatbuffersStreamingJsonArena::get_capacity() const
+{
+  return capacity;
+}
+
+size_t
+FlatbuffersStreamingJsonArena::get_used() const
+{
+  return used;
+}
+
+size_t
+FlatbuffersStreamingJsonArena::get_high_water() const
+{
+  return high_water;
+}
+
+size_t
+FlatbuffersStreamingJsonArena::get_overflow_count() const
+{
+  return overflow_count;
+}
+
+bool
+FlatbuffersStreamingJsonArena::owns(const uint8_t* p) const
+{
+  return ((p >= buf) && (p < (buf + capacity)));
+}
+
+size_t
+FlatbuffersStreamingJsonArena::align_size(size_t size)
+{
+  return ((size + (arena_alignment - 1)) & ~(arena_alignment - 1));
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers/flatbuffers.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Bump allocator over one fixed region, for flatbuffer builder storage.
+// Everything is released at once by reset(), typically after each item,
+// so a long-running stream does not fragment the heap.
+// Allocations which do not fit fall back to the heap, and are counted.
+class FlatbuffersStreamingJsonArena
+: public flatbuffers::Allocator
+{
+public:
+  // Use a caller-provided region (e.g. a static buffer)
+  FlatbuffersStreamingJsonArena(uint8_t* _buf, size_t _capacity);
+
+  // Allocate the region once, up front
+  explicit FlatbuffersStreamingJsonArena(size_t _capacity);
+
+  ~FlatbuffersStreamingJsonArena();
+
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonArena";
+
+  uint8_t* allocate(size_t size) override;
+  void deallocate(uint8_t* p, size_t size) override;
+  uint8_t* reallocate_downward(
+    uint8_t* old_p,
+    size_t old_size,
+    size_t new_size) override;
+
+  // Release everything allocated from the region.
+  // Nothing allocated before this may still be in use
+  void reset();
+
+  size_t get_capacity() const;
+  size_t get_used() const;
+  size_t get_high_water() const;
+
+  // Allocations which did not fit in the region
+  size_t get_overflow_count() const;
+
+private:
+  FlatbuffersStreamingJsonArena(const FlatbuffersStreamingJsonArena&);
+  FlatbuffersStreamingJsonArena& operator=(const FlatbuffersStreamingJsonArena&);
+
+  bool owns(const uint8_t* p) const;
+  static size_t align_size(size_t size);
+
+  uint8_t* buf = nullptr;
+  size_t capacity = 0;
+  bool own_buf = false;
+
+  size_t used = 0;
+  size_t high_water = 0;
+  size_t overflow_count = 0;
+
+  // The most recent allocation can be freed, or grown, in place
+  uint8_t* last_p = nullptr;
+};
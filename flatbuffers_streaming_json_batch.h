@@ -0,0 +1,229 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers/flatbuffers.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Verified flatbuffers stored back to back, each size-prefixed:
+// a little-endian uoffset_t length, then the buffer, starting 8-byte aligned.
+// The whole batch is one contiguous region, e.g. for a single flash write,
+// which FlatbuffersStreamingJsonStreamReader reads back
+class FlatbuffersStreamingJsonBatchBuffer
+{
+public:
+  static constexpr size_t alignment = 8;
+
+  void reserve(size_t bytes, size_t items)
+  {
+    storage.reserve((bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    offsets.reserve(items);
+  }
+
+  void clear()
+  {
+    len = 0;
+    offsets.clear();
+  }
+
+  // Bytes used, once this buffer is appended
+  size_t get_size_with(size_t buf_len) const
+  {
+    return (align_prefix(len) + sizeof(flatbuffers::uoffset_t) + buf_len);
+  }
+
+  void append(const uint8_t* buf, size_t buf_len)
+  {
+    size_t prefix = align_prefix(len);
+    size_t end = (prefix + sizeof(flatbuffers::uoffset_t) + buf_len);
+    storage.resize((end + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+
+    auto data = get_data();
+    memset(data + len, 0, prefix - len);
+    flatbuffers::WriteScalar<flatbuffers::uoffset_t>(
+      data + prefix, static_cast<flatbuffers::uoffset_t>(buf_len));
+    memcpy(data + prefix + sizeof(flatbuffers::uoffset_t), buf, buf_len);
+
+    offsets.push_back(static_cast<uint32_t>(prefix));
+    len = end;
+  }
+
+  size_t size() const
+  {
+    return offsets.size();
+  }
+
+  bool empty() const
+  {
+    return offsets.empty();
+  }
+
+  // The whole contiguous batch
+  const uint8_t* data() const
+  {
+    return reinterpret_cast<const uint8_t*>(storage.data());
+  }
+
+  size_t bytes() const
+  {
+    return len;
+  }
+
+  // A single item's flatbuffer, without its size prefix
+  const uint8_t* get_buffer(size_t i) const
+  {
+    return data() + offsets[i] + sizeof(flatbuffers::uoffset_t);
+  }
+
+  size_t get_buffer_size(size_t i) const
+  {
+    return flatbuffers::ReadScalar<flatbuffers::uoffset_t>(data() + offsets[i]);
+  }
+
+private:
+  // The prefix goes 4 bytes before an aligned buffer
+  static size_t align_prefix(size_t offset)
+  {
+    size_t buf_offset = (offset + sizeof(flatbuffers::uoffset_t) + alignment - 1) & ~(alignment - 1);
+    return (buf_offset - sizeof(flatbuffers::uoffset_t));
+  }
+
+  uint8_t* get_data()
+  {
+    return reinterpret_cast<uint8_t*>(storage.data());
+  }
+
+  // As uint64_t, so that buffers can be 8-byte aligned
+  std::vector<uint64_t> storage;
+  size_t len = 0;
+
+  // Of each size prefix
+  std::vector<uint32_t> offsets;
+};
+
+// The root tables of a batch, only valid during the batch callback
+template<typename TableT>
+class FlatbuffersStreamingJsonBatch
+{
+public:
+  FlatbuffersStreamingJsonBatch(const FlatbuffersStreamingJsonBatchBuffer& _buffer)
+  : buffer(_buffer)
+  {
+  }
+
+  size_t size() const
+  {
+    return buffer.size();
+  }
+
+  bool empty() const
+  {
+    return buffer.empty();
+  }
+
+  const TableT* operator[](size_t i) const
+  {
+    return flatbuffers::GetRoot<TableT>(buffer.get_buffer(i));
+  }
+
+  // The size-prefixed flatbuffers, back to back
+  const FlatbuffersStreamingJsonBatchBuffer& get_buffer() const
+  {
+    return buffer;
+  }
+
+private:
+  const FlatbuffersStreamingJsonBatchBuffer& buffer;
+};
+
+// The root of a shared batch: items built one after another into the same
+// flatbuffer, so they share their strings and vtables.
+// Laid out as a table whose only field is the vector of item tables
+template<typename TableT>
+struct FlatbuffersStreamingJsonSharedBatchTable FLATBUFFERS_FINAL_CLASS
+: private flatbuffers::Table
+{
+  enum
+  {
+    VT_ITEMS = 4,
+  };
+
+  static const char* GetFullyQualifiedName()
+  {
+    return "FlatbuffersStreamingJsonSharedBatch";
+  }
+
+  const flatbuffers::Vector<flatbuffers::Offset<TableT>>* items() const
+  {
+    return GetPointer<const flatbuffers::Vector<flatbuffers::Offset<TableT>>*>(VT_ITEMS);
+  }
+
+  bool Verify(flatbuffers::Verifier& verifier) const
+  {
+    return (
+      VerifyTableStart(verifier) &&
+      VerifyOffset(verifier, VT_ITEMS) &&
+      verifier.Verify(items()) &&
+      verifier.VerifyVectorOfTables(items()) &&
+      verifier.EndTable()
+    );
+  }
+};
+
+// The item tables of a shared batch, only valid during the batch callback.
+// The whole batch is one flatbuffer, e.g. to be forwarded or stored as is
+template<typename TableT>
+class FlatbuffersStreamingJsonSharedBatch
+{
+public:
+  typedef FlatbuffersStreamingJsonSharedBatchTable<TableT> RootT;
+
+  FlatbuffersStreamingJsonSharedBatch(const uint8_t* _buf, size_t _len)
+  : buf(_buf)
+  , len(_len)
+  , items(flatbuffers::GetRoot<RootT>(_buf)->items())
+  {
+  }
+
+  size_t size() const
+  {
+    return (items != nullptr)? items->size() : 0;
+  }
+
+  bool empty() const
+  {
+    return (size() == 0);
+  }
+
+  const TableT* operator[](size_t i) const
+  {
+    return items->Get(static_cast<flatbuffers::uoffset_t>(i));
+  }
+
+  const uint8_t* get_buffer_pointer() const
+  {
+    return buf;
+  }
+
+  size_t get_size() const
+  {
+    return len;
+  }
+
+private:
+  const uint8_t* buf;
+  size_t len;
+
+  const flatbuffers::Vector<flatbuffers::Offset<TableT>>* items;
+};
@@ -0,0 +1,1445 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_builder.h"
+
+#include "esp_log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+
+constexpr char FlatbuffersStreamingJsonBuilder::TAG[];
+
+template<typename T>
+static bool
+encode_in_range(int64_t i, uint8_t* bytes)
+{
+  if ((i < static_cast<int64_t>(std::numeric_limits<T>::min())) ||
+      (i > static_cast<int64_t>(std::numeric_limits<T>::max())))
+  {
+    return false;
+  }
+
+  flatbuffers::WriteScalar<T>(bytes, static_cast<T>(i));
+  return true;
+}
+
+static bool
+equals(stx::string_view a, const flatbuffers::String* b)
+{
+  return (
+    (b != nullptr) &&
+    (a.size() == b->size()) &&
+    (memcmp(a.data(), b->c_str(), a.size()) == 0)
+  );
+}
+
+FlatbuffersStreamingJsonBuilder::FlatbuffersStreamingJsonBuilder(
+  const FlatbuffersStreamingJsonParser& _flatbuffers_parser,
+  flatbuffers::Allocator* allocator,
+  size_t initial_size
+)
+: schema(_flatbuffers_parser.get_flatbuffers_schema())
+, schema_index(_flatbuffers_parser.get_schema_index())
+, fbb(initial_size, allocator)
+{
+}
+
+void
+FlatbuffersStreamingJsonBuilder::clear()
+{
+  // Keep all allocated memory around for the next root table
+  fbb.Clear();
+  frames.clear();
+  field_values.clear();
+  scratch.clear();
+
+  skip_depth = 0;
+  flexbuffer.clear();
+  finished = false;
+
+  batch_roots.clear();
+  memset(interned, 0, sizeof(interned));
+}
+
+void
+FlatbuffersStreamingJsonBuilder::release()
+{
+  clear();
+  fbb.Reset();
+}
+
+void
+FlatbuffersStreamingJsonBuilder::reserve(
+  size_t depth,
+  size_t fields,
+  size_t scratch_size
+)
+{
+  frames.reserve(depth);
+  field_values.reserve(fields);
+  scratch.reserve(scratch_size);
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::start_root(
+  const reflection::Object* table
+)
+{
+  clear();
+
+  if (schema == nullptr)
+  {
+    ESP_LOGE(TAG, "No binary flatbuffer schema available");
+    return false;
+  }
+
+  if ((table == nullptr) || table->is_struct())
+  {
+    ESP_LOGE(TAG, "Root type must be a table");
+    return false;
+  }
+
+  return push_frame(TableFrame, table, nullptr);
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::finish_root(bool size_prefixed)
+{
+  if ((frames.size() != 1) || (skip_depth > 0) || flexbuffer.is_capturing())
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON, could not finish root table");
+    return false;
+  }
+
+  flatbuffers::uoffset_t root = 0;
+  bool ok = close_table(root);
+  if (ok)
+  {
+    frames.pop_back();
+
+    auto file_ident = schema->file_ident();
+    bool has_file_ident = (
+      (file_ident != nullptr) &&
+      (file_ident->size() == flatbuffers::FlatBufferBuilder::kFileIdentifierLength)
+    );
+
+    if (size_prefixed)
+    {
+      fbb.FinishSizePrefixed(
+        flatbuffers::Offset<flatbuffers::Table>(root),
+        has_file_ident? file_ident->c_str() : nullptr);
+    }
+    else {
+      fbb.Finish(
+        flatbuffers::Offset<flatbuffers::Table>(root),
+        has_file_ident? file_ident->c_str() : nullptr);
+    }
+
+    finished = true;
+  }
+
+  return ok;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::start_batch_root(
+  const reflection::Object* table
+)
+{
+  if (finished)
+  {
+    // The last batch was delivered, start the next one
+    clear();
+  }
+  else {
+    // Keep the batch's items and interned strings, but drop the state of an
+    // item which failed part way (whatever it had added is unreferenced)
+    frames.clear();
+    field_values.clear();
+    scratch.clear();
+    skip_depth = 0;
+  }
+
+  if (schema == nullptr)
+  {
+    ESP_LOGE(TAG, "No binary flatbuffer schema available");
+    return false;
+  }
+
+  if ((table == nullptr) || table->is_struct())
+  {
+    ESP_LOGE(TAG, "Root type must be a table");
+    return false;
+  }
+
+  return push_frame(TableFrame, table, nullptr);
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::end_batch_root()
+{
+  if ((frames.size() != 1) || (skip_depth > 0) || flexbuffer.is_capturing())
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON, could not finish root table");
+    return false;
+  }
+
+  flatbuffers::uoffset_t root = 0;
+  bool ok = close_table(root);
+  if (ok)
+  {
+    frames.pop_back();
+    batch_roots.push_back(flatbuffers::Offset<flatbuffers::Table>(root));
+  }
+
+  return ok;
+}
+
+size_t
+FlatbuffersStreamingJsonBuilder::get_batch_size() const
+{
+  return batch_roots.size();
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::finish_batch()
+{
+  if (batch_roots.empty())
+  {
+    ESP_LOGE(TAG, "No items in the shared batch");
+    return false;
+  }
+
+  auto items = fbb.CreateVector(batch_roots);
+
+  auto start = fbb.StartTable();
+  fbb.AddOffset(
+    FlatbuffersStreamingJsonSharedBatchTable<flatbuffers::Table>::VT_ITEMS, items);
+  auto root = fbb.EndTable(start);
+
+  // Not the schema's root type, so without its file identifier
+  fbb.Finish(flatbuffers::Offset<flatbuffers::Table>(root));
+
+  batch_roots.clear();
+  frames.clear();
+  finished = true;
+  return true;
+}
+
+const uint8_t*
+FlatbuffersStreamingJsonBuilder::get_buffer_pointer() const
+{
+  return finished? fbb.GetBufferPointer() : nullptr;
+}
+
+size_t
+FlatbuffersStreamingJsonBuilder::get_size() const
+{
+  return finished? fbb.GetSize() : 0;
+}
+
+size_t
+FlatbuffersStreamingJsonBuilder::get_built_size() const
+{
+  // Including vector elements not yet copied into the buffer
+  return (fbb.GetSize() + scratch.size());
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::set_key(stx::string_view key)
+{
+  if (skip_depth > 0)
+  {
+    return true;
+  }
+
+  if (is_capturing_flexbuffer())
+  {
+    return flexbuffer.set_key(key);
+  }
+
+  if (frames.empty())
+  {
+    ESP_LOGE(TAG, "Key '%.*s' found outside of a table", (int)key.size(), key.data());
+    return false;
+  }
+
+  auto& frame = frames.back();
+  switch (frame.type)
+  {
+    case TableFrame:
+    case StructFrame:
+    {
+      auto field = schema_index.get_field(frame.table, key);
+      frame.field = (field != nullptr)? field->field : nullptr;
+
+      // Support additional (ignored) fields present in JSON but not in the schema
+      frame.skip_value = (
+        (frame.field == nullptr) ||
+        (frame.field->deprecated())
+      );
+      frame.flexbuffer_value = (!frame.skip_value && field->is_flexbuffer);
+
+      if (frame.skip_value && (frame.type == StructFrame))
+      {
+        ESP_LOGE(TAG, "Unknown struct field '%.*s'", (int)key.size(), key.data());
+        return false;
+      }
+      return true;
+    }
+
+    case KeyedVectorFrame:
+    {
+      // Each key opens a new element table, with the key stored as its id
+      auto table = frame.object;
+      auto id_field = frame.table->id_field->field;
+      if (id_field->type()->base_type() != reflection::String)
+      {
+        ESP_LOGE(TAG, "Keyed vector table '%s' needs a string id", table->name()->c_str());
+        return false;
+      }
+
+      auto id = create_string(key);
+
+      bool ok = push_frame(TableFrame, table, get_keyed_vector_val_field(table));
+      if (ok)
+      {
+        frames.back().auto_close = true;
+
+        FieldValue id_value = { id_field, id.o };
+        field_values.push_back(id_value);
+      }
+      return ok;
+    }
+
+    default:
+      ESP_LOGE(TAG, "Key '%.*s' found inside an array", (int)key.size(), key.data());
+      return false;
+  }
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::set_null()
+{
+  if (skip_depth > 0)
+  {
+    return true;
+  }
+
+  // A null (flexbuffer) field is left out, as flatc does
+  if (is_capturing_flexbuffer() && flexbuffer.is_capturing())
+  {
+    return flexbuffer_value_added(flexbuffer.set_null());
+  }
+
+  if (is_discarding_value())
+  {
+    return value_stored();
+  }
+
+  reflection::BaseType base_type;
+  int32_t index;
+  bool ok = get_value_type(base_type, index);
+  if (ok)
+  {
+    if (frames.back().type == TableFrame)
+    {
+      // Ignore this field, it will take its default value
+      return value_stored();
+    }
+
+    ESP_LOGE(TAG, "Unexpected null value");
+  }
+
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::set_bool(bool b)
+{
+  if ((skip_depth == 0) && is_capturing_flexbuffer())
+  {
+    return flexbuffer_value_added(flexbuffer.set_bool(b));
+  }
+
+  return set_int64(b? 1 : 0);
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::set_int64(int64_t i)
+{
+  if (skip_depth > 0)
+  {
+    return true;
+  }
+
+  if (is_capturing_flexbuffer())
+  {
+    return flexbuffer_value_added(flexbuffer.set_int64(i));
+  }
+
+  if (is_discarding_value())
+  {
+    return value_stored();
+  }
+
+  reflection::BaseType base_type;
+  int32_t index;
+  uint8_t bytes[sizeof(uint64_t)] = {};
+
+  return (
+    get_value_type(base_type, index) &&
+    encode_integer(base_type, i, bytes) &&
+    store_scalar(bytes, flatbuffers::GetTypeSize(base_type))
+  );
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::set_number(double d)
+{
+  if (skip_depth > 0)
+  {
+    return true;
+  }
+
+  if (is_capturing_flexbuffer())
+  {
+    return flexbuffer_value_added(flexbuffer.set_number(d));
+  }
+
+  if (is_discarding_value())
+  {
+    return value_stored();
+  }
+
+  reflection::BaseType base_type;
+  int32_t index;
+  uint8_t bytes[sizeof(uint64_t)] = {};
+
+  return (
+    get_value_type(base_type, index) &&
+    encode_real(base_type, d, bytes) &&
+    store_scalar(bytes, flatbuffers::GetTypeSize(base_type))
+  );
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::set_raw_number(
+  const FlatbuffersStreamingJsonNumber& number
+)
+{
+  if (skip_depth > 0)
+  {
+    return true;
+  }
+
+  if (is_capturing_flexbuffer())
+  {
+    return flexbuffer_value_added(flexbuffer.set_raw_number(number));
+  }
+
+  if (is_discarding_value())
+  {
+    return value_stored();
+  }
+
+  reflection::BaseType base_type;
+  int32_t index;
+  uint8_t bytes[sizeof(uint64_t)] = {};
+
+  return (
+    get_value_type(base_type, index) &&
+    encode_number(base_type, number, bytes) &&
+    store_scalar(bytes, flatbuffers::GetTypeSize(base_type))
+  );
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::set_string(stx::string_view s)
+{
+  if (skip_depth > 0)
+  {
+    return true;
+  }
+
+  if (is_capturing_flexbuffer())
+  {
+    return flexbuffer_value_added(flexbuffer.set_string(s));
+  }
+
+  if (is_discarding_value())
+  {
+    return value_stored();
+  }
+
+  reflection::BaseType base_type;
+  int32_t index;
+  bool ok = get_value_type(base_type, index);
+  if (ok)
+  {
+    if (base_type == reflection::String)
+    {
+      auto str = create_string(s);
+      return store_offset(str.o);
+    }
+    else if (flatbuffers::IsScalar(base_type))
+    {
+      // Enum names, or quoted scalar values
+      uint8_t bytes[sizeof(uint64_t)] = {};
+      return (
+        encode_string(base_type, index, s, bytes) &&
+        store_scalar(bytes, flatbuffers::GetTypeSize(base_type))
+      );
+    }
+
+    ESP_LOGE(TAG, "Unexpected string value '%.*s'", (int)s.size(), s.data());
+  }
+
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::start_object()
+{
+  if (skip_depth > 0)
+  {
+    skip_depth++;
+    return true;
+  }
+
+  if (is_capturing_flexbuffer())
+  {
+    return flexbuffer_value_added(flexbuffer.start_object());
+  }
+
+  if (is_discarding_value())
+  {
+    skip_depth = 1;
+    return true;
+  }
+
+  reflection::BaseType base_type;
+  int32_t index;
+  bool ok = get_value_type(base_type, index);
+  if (ok)
+  {
+    if (base_type == reflection::Obj)
+    {
+      auto table = schema->objects()->Get(index);
+      return push_frame(table->is_struct()? StructFrame : TableFrame, table, nullptr);
+    }
+    else if (base_type == reflection::Union)
+    {
+      auto table = get_union_table(frames.back());
+      if (table != nullptr)
+      {
+        return push_frame(TableFrame, table, nullptr);
+      }
+
+      ESP_LOGE(TAG, "Union type field must precede its value");
+      return false;
+    }
+    else if (base_type == reflection::Vector)
+    {
+      auto type = frames.back().field->type();
+      if (type->element() == reflection::Obj)
+      {
+        auto table = schema->objects()->Get(type->index());
+        if (get_keyed_vector_val_field(table) != nullptr)
+        {
+          // We found a reflection structure that can be re-written
+          return push_frame(KeyedVectorFrame, table, frames.back().field);
+        }
+      }
+    }
+
+    ESP_LOGE(TAG, "Unexpected object value");
+  }
+
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::end_object()
+{
+  if (skip_depth > 0)
+  {
+    skip_depth--;
+    return (skip_depth > 0)? true : value_stored();
+  }
+
+  if (is_capturing_flexbuffer())
+  {
+    return flexbuffer_value_added(flexbuffer.end_object());
+  }
+
+  // The root table is only closed by finish_root()
+  if (frames.size() <= 1)
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON object");
+    return false;
+  }
+
+  auto type = frames.back().type;
+  if (type == StructFrame)
+  {
+    return close_struct();
+  }
+  else if ((type == TableFrame) || (type == KeyedVectorFrame))
+  {
+    flatbuffers::uoffset_t offset = 0;
+    bool ok = (type == TableFrame)? close_table(offset) : close_vector(offset);
+    if (ok)
+    {
+      frames.pop_back();
+      return store_offset(offset);
+    }
+    return false;
+  }
+
+  ESP_LOGE(TAG, "Unbalanced JSON object");
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::start_array()
+{
+  if (skip_depth > 0)
+  {
+    skip_depth++;
+    return true;
+  }
+
+  if (is_capturing_flexbuffer())
+  {
+    return flexbuffer_value_added(flexbuffer.start_array());
+  }
+
+  if (is_discarding_value())
+  {
+    skip_depth = 1;
+    return true;
+  }
+
+  reflection::BaseType base_type;
+  int32_t index;
+  bool ok = get_value_type(base_type, index);
+  if (ok)
+  {
+    if ((base_type == reflection::Vector) &&
+        (frames.back().type != VectorFrame))
+    {
+      auto field = frames.back().field;
+      auto type = field->type();
+
+      const reflection::Object* element_table = nullptr;
+      if (type->element() == reflection::Obj)
+      {
+        element_table = schema->objects()->Get(type->index());
+      }
+
+      return push_frame(VectorFrame, element_table, field);
+    }
+
+    ESP_LOGE(TAG, "Unexpected array value");
+  }
+
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::end_array()
+{
+  if (skip_depth > 0)
+  {
+    skip_depth--;
+    return (skip_depth > 0)? true : value_stored();
+  }
+
+  if (is_capturing_flexbuffer())
+  {
+    return flexbuffer_value_added(flexbuffer.end_array());
+  }
+
+  if (frames.empty() || (frames.back().type != VectorFrame))
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON array");
+    return false;
+  }
+
+  flatbuffers::uoffset_t offset = 0;
+  bool ok = close_vector(offset);
+  if (ok)
+  {
+    frames.pop_back();
+    return store_offset(offset);
+  }
+
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::is_discarding_value() const
+{
+  return (!frames.empty() && frames.back().skip_value);
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::is_capturing_flexbuffer() const
+{
+  return (!frames.empty() && frames.back().flexbuffer_value);
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::flexbuffer_value_added(bool ok)
+{
+  if (!ok || !flexbuffer.is_complete())
+  {
+    return ok;
+  }
+
+  // Stored as the field's [ubyte]
+  const auto& buf = flexbuffer.get_buffer();
+  auto vec = fbb.CreateVector(buf.data(), buf.size());
+  return store_offset(vec.o);
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::get_value_type(
+  reflection::BaseType& base_type,
+  int32_t& index
+) const
+{
+  if (!frames.empty())
+  {
+    auto& frame = frames.back();
+    if (frame.field != nullptr)
+    {
+      auto type = frame.field->type();
+      index = type->index();
+
+      if (frame.type == VectorFrame)
+      {
+        base_type = type->element();
+        return true;
+      }
+      else if (frame.type != KeyedVectorFrame)
+      {
+        base_type = type->base_type();
+        return true;
+      }
+    }
+  }
+
+  ESP_LOGE(TAG, "JSON value found without a matching key");
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::store_scalar(
+  const uint8_t* bytes,
+  size_t size
+)
+{
+  auto& frame = frames.back();
+  switch (frame.type)
+  {
+    case TableFrame:
+    {
+      uint64_t data = 0;
+      memcpy(&data, bytes, size);
+      return store_field_value(data);
+    }
+
+    case StructFrame:
+      memcpy(&scratch[frame.scratch_begin + frame.field->offset()], bytes, size);
+      frame.count++;
+      return value_stored();
+
+    case VectorFrame:
+      scratch.insert(scratch.end(), bytes, bytes + size);
+      frame.count++;
+      return value_stored();
+
+    default:
+      ESP_LOGE(TAG, "Unexpected scalar value");
+      return false;
+  }
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::store_offset(flatbuffers::uoffset_t offset)
+{
+  if (frames.empty())
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON");
+    return false;
+  }
+
+  auto& frame = frames.back();
+  switch (frame.type)
+  {
+    case TableFrame:
+      return store_field_value(offset);
+
+    case VectorFrame:
+    case KeyedVectorFrame:
+    {
+      auto bytes = reinterpret_cast<const uint8_t*>(&offset);
+      scratch.insert(scratch.end(), bytes, bytes + sizeof(offset));
+      frame.count++;
+      return value_stored();
+    }
+
+    default:
+      ESP_LOGE(TAG, "Structs can only contain scalars and structs");
+      return false;
+  }
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::store_field_value(uint64_t data)
+{
+  auto& frame = frames.back();
+
+  for (auto i = frame.values_begin; i < field_values.size(); ++i)
+  {
+    if (field_values[i].field == frame.field)
+    {
+      ESP_LOGE(TAG, "Field '%s' set more than once", frame.field->name()->c_str());
+      return false;
+    }
+  }
+
+  FieldValue value = { frame.field, data };
+  field_values.push_back(value);
+  return value_stored();
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::value_stored()
+{
+  auto& frame = frames.back();
+  if ((frame.type == TableFrame) || (frame.type == StructFrame))
+  {
+    frame.field = nullptr;
+    frame.skip_value = false;
+    frame.flexbuffer_value = false;
+
+    if (frame.auto_close)
+    {
+      // The keyed vector element only has its id and val fields
+      flatbuffers::uoffset_t offset = 0;
+      bool ok = close_table(offset);
+      if (ok)
+      {
+        frames.pop_back();
+        return store_offset(offset);
+      }
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::encode_integer(
+  reflection::BaseType base_type,
+  int64_t i,
+  uint8_t* bytes
+) const
+{
+  bool ok = false;
+
+  switch (base_type)
+  {
+    case reflection::Bool:
+      flatbuffers::WriteScalar<uint8_t>(bytes, (i != 0)? 1 : 0);
+      ok = true;
+      break;
+
+    case reflection::UType:
+    case reflection::UByte:
+      ok = encode_in_range<uint8_t>(i, bytes);
+      break;
+
+    case reflection::Byte:
+      ok = encode_in_range<int8_t>(i, bytes);
+      break;
+
+    case reflection::Short:
+      ok = encode_in_range<int16_t>(i, bytes);
+      break;
+
+    case reflection::UShort:
+      ok = encode_in_range<uint16_t>(i, bytes);
+      break;
+
+    case reflection::Int:
+      ok = encode_in_range<int32_t>(i, bytes);
+      break;
+
+    case reflection::UInt:
+      ok = encode_in_range<uint32_t>(i, bytes);
+      break;
+
+    case reflection::Long:
+      flatbuffers::WriteScalar<int64_t>(bytes, i);
+      ok = true;
+      break;
+
+    case reflection::ULong:
+      if (i >= 0)
+      {
+        flatbuffers::WriteScalar<uint64_t>(bytes, static_cast<uint64_t>(i));
+        ok = true;
+      }
+      break;
+
+    case reflection::Float:
+      flatbuffers::WriteScalar<float>(bytes, static_cast<float>(i));
+      ok = true;
+      break;
+
+    case reflection::Double:
+      flatbuffers::WriteScalar<double>(bytes, static_cast<double>(i));
+      ok = true;
+      break;
+
+    default:
+      ESP_LOGE(TAG, "Unexpected number value");
+      return false;
+  }
+
+  if (!ok)
+  {
+    ESP_LOGE(TAG, "Number %lld out of range for field", (long long)i);
+  }
+
+  return ok;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::encode_real(
+  reflection::BaseType base_type,
+  double d,
+  uint8_t* bytes
+) const
+{
+  if (base_type == reflection::Float)
+  {
+    flatbuffers::WriteScalar<float>(bytes, static_cast<float>(d));
+    return true;
+  }
+  else if (base_type == reflection::Double)
+  {
+    flatbuffers::WriteScalar<double>(bytes, d);
+    return true;
+  }
+  else if (flatbuffers::IsInteger(base_type) && (std::floor(d) == d))
+  {
+    // Integral values too large to be represented as int64_t
+    if ((base_type == reflection::ULong) &&
+        (d >= 9223372036854775808.0) &&
+        (d < 18446744073709551616.0))
+    {
+      flatbuffers::WriteScalar<uint64_t>(bytes, static_cast<uint64_t>(d));
+      return true;
+    }
+    else if ((d >= -9223372036854775808.0) &&
+             (d < 9223372036854775808.0))
+    {
+      return encode_integer(base_type, static_cast<int64_t>(d), bytes);
+    }
+  }
+
+  ESP_LOGE(TAG, "Number %g not representable in field", d);
+  return false;
+}
+
+// Converted once, straight from the token to the field's type
+bool
+FlatbuffersStreamingJsonBuilder::encode_number(
+  reflection::BaseType base_type,
+  const FlatbuffersStreamingJsonNumber& number,
+  uint8_t* bytes
+) const
+{
+  bool ok = false;
+
+  if (base_type == reflection::Float)
+  {
+    float f = 0;
+    ok = flatbuffers_streaming_json_number_to_real(number, f);
+    flatbuffers::WriteScalar<float>(bytes, f);
+  }
+  else if (base_type == reflection::Double)
+  {
+    double d = 0;
+    ok = flatbuffers_streaming_json_number_to_real(number, d);
+    flatbuffers::WriteScalar<double>(bytes, d);
+  }
+  else if (base_type == reflection::ULong)
+  {
+    uint64_t u = 0;
+    ok = flatbuffers_streaming_json_number_to_integer(number, u);
+    flatbuffers::WriteScalar<uint64_t>(bytes, u);
+  }
+  else if (flatbuffers::IsInteger(base_type) || (base_type == reflection::Bool))
+  {
+    // Range checked for the field by encode_integer()
+    int64_t i = 0;
+    if (flatbuffers_streaming_json_number_to_integer(number, i))
+    {
+      return encode_integer(base_type, i, bytes);
+    }
+  }
+  else {
+    ESP_LOGE(TAG, "Unexpected number value");
+    return false;
+  }
+
+  if (!ok)
+  {
+    ESP_LOGE(TAG, "Number %.*s not representable in field",
+      (int)number.text.size(), number.text.data());
+  }
+
+  return ok;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::encode_string(
+  reflection::BaseType base_type,
+  int32_t index,
+  stx::string_view s,
+  uint8_t* bytes
+) const
+{
+  int64_t i = 0;
+  if ((index >= 0) && lookup_enum_value(index, s, i))
+  {
+    return encode_integer(base_type, i, bytes);
+  }
+
+  if (base_type == reflection::Bool)
+  {
+    if ((s == "true") || (s == "false"))
+    {
+      return encode_integer(base_type, (s == "true")? 1 : 0, bytes);
+    }
+  }
+
+  // Also allow numbers inside quotes
+  FlatbuffersStreamingJsonNumber number;
+  if (flatbuffers_streaming_json_scan_number(s, number))
+  {
+    return encode_number(base_type, number, bytes);
+  }
+
+  ESP_LOGE(TAG, "Could not convert string '%.*s' to a scalar value", (int)s.size(), s.data());
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::lookup_enum_value(
+  int32_t index,
+  stx::string_view name,
+  int64_t& value
+) const
+{
+  auto enums = schema->enums();
+  if ((enums != nullptr) && (static_cast<flatbuffers::uoffset_t>(index) < enums->size()))
+  {
+    auto values = enums->Get(index)->values();
+    for (flatbuffers::uoffset_t i = 0; i < values->size(); ++i)
+    {
+      auto enum_val = values->Get(i);
+      if (equals(name, enum_val->name()))
+      {
+        value = enum_val->value();
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+const reflection::Object*
+FlatbuffersStreamingJsonBuilder::get_union_table(const Frame& frame) const
+{
+  // Unions are preceded by a type field, using the same enum as the union
+  auto index = frame.field->type()->index();
+  for (auto i = frame.values_begin; i < field_values.size(); ++i)
+  {
+    auto type = field_values[i].field->type();
+    if ((type->base_type() == reflection::UType) &&
+        (type->index() == index))
+    {
+      int64_t union_type = flatbuffers::ReadScalar<uint8_t>(&field_values[i].data);
+      auto enum_val = schema->enums()->Get(index)->values()->LookupByKey(union_type);
+      if ((enum_val != nullptr) &&
+          (enum_val->union_type() != nullptr) &&
+          (enum_val->union_type()->base_type() == reflection::Obj))
+      {
+        return schema->objects()->Get(enum_val->union_type()->index());
+      }
+      break;
+    }
+  }
+
+  return nullptr;
+}
+
+const reflection::Field*
+FlatbuffersStreamingJsonBuilder::get_keyed_vector_val_field(
+  const reflection::Object* table
+) const
+{
+  auto table_info = schema_index.get_table(table);
+  if ((table_info != nullptr) &&
+      (table_info->val_field != nullptr) &&
+      (table_info->val_field->field->type()->base_type() == reflection::Obj))
+  {
+    return table_info->val_field->field;
+  }
+
+  return nullptr;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::push_frame(
+  FrameType type,
+  const reflection::Object* object,
+  const reflection::Field* field
+)
+{
+  Frame frame;
+  frame.type = type;
+  frame.object = object;
+  frame.table = schema_index.get_table(object);
+  frame.field = field;
+  frame.skip_value = false;
+  frame.flexbuffer_value = false;
+  frame.auto_close = false;
+  frame.values_begin = field_values.size();
+  frame.scratch_begin = scratch.size();
+  frame.count = 0;
+
+  if (type == StructFrame)
+  {
+    // Structs are assembled in place, with all padding zeroed
+    scratch.resize(scratch.size() + object->bytesize(), 0);
+  }
+
+  frames.push_back(frame);
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::close_table(flatbuffers::uoffset_t& offset)
+{
+  auto& frame = frames.back();
+  auto fields = frame.object->fields();
+
+  // Check if all required fields are parsed
+  for (flatbuffers::uoffset_t f = 0; f < fields->size(); ++f)
+  {
+    auto required_field = fields->Get(f);
+    if (required_field->required())
+    {
+      bool found = false;
+      for (auto i = frame.values_begin; i < field_values.size(); ++i)
+      {
+        if (field_values[i].field == required_field)
+        {
+          found = true;
+          break;
+        }
+      }
+
+      if (!found)
+      {
+        ESP_LOGE(TAG,
+          "Required field '%s' is missing in '%s'",
+          required_field->name()->c_str(),
+          frame.object->name()->c_str()
+        );
+        return false;
+      }
+    }
+  }
+
+  auto start = fbb.StartTable();
+
+  // Inline structs have the largest alignment, add them first
+  for (auto i = frame.values_begin; i < field_values.size(); ++i)
+  {
+    auto field = field_values[i].field;
+    auto type = field->type();
+    if (type->base_type() == reflection::Obj)
+    {
+      auto table = schema->objects()->Get(type->index());
+      if (table->is_struct())
+      {
+        fbb.Align(table->minalign());
+        fbb.PushBytes(&scratch[field_values[i].data], table->bytesize());
+        fbb.AddStructOffset(field->offset(), fbb.GetSize());
+      }
+    }
+  }
+
+  // Then serialize scalars and offsets, largest first, to minimize padding
+  for (size_t size = sizeof(uint64_t); size > 0; size /= 2)
+  {
+    for (auto i = frame.values_begin; i < field_values.size(); ++i)
+    {
+      auto field = field_values[i].field;
+      auto& data = field_values[i].data;
+      auto voffset = field->offset();
+      auto base_type = field->type()->base_type();
+
+      if (flatbuffers::IsScalar(base_type))
+      {
+        if (flatbuffers::GetTypeSize(base_type) != size)
+        {
+          continue;
+        }
+
+        switch (base_type)
+        {
+#define FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(BASE_TYPE, CTYPE, DEFAULT) \
+          case reflection::BASE_TYPE: \
+            fbb.AddElement<CTYPE>(voffset, \
+              flatbuffers::ReadScalar<CTYPE>(&data), \
+              static_cast<CTYPE>(field->DEFAULT())); \
+            break;
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(UType, uint8_t, default_integer)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(Bool, uint8_t, default_integer)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(Byte, int8_t, default_integer)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(UByte, uint8_t, default_integer)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(Short, int16_t, default_integer)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(UShort, uint16_t, default_integer)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(Int, int32_t, default_integer)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(UInt, uint32_t, default_integer)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(Long, int64_t, default_integer)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(ULong, uint64_t, default_integer)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(Float, float, default_real)
+          FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT(Double, double, default_real)
+#undef FLATBUFFERS_STREAMING_JSON_ADD_ELEMENT
+          default:
+            break;
+        }
+      }
+      else if (size == sizeof(flatbuffers::uoffset_t))
+      {
+        bool is_struct = (
+          (base_type == reflection::Obj) &&
+          schema->objects()->Get(field->type()->index())->is_struct()
+        );
+
+        if (!is_struct)
+        {
+          fbb.AddOffset(voffset,
+            flatbuffers::Offset<void>(static_cast<flatbuffers::uoffset_t>(data)));
+        }
+      }
+    }
+  }
+
+  offset = fbb.EndTable(start);
+
+  field_values.resize(frame.values_begin);
+  scratch.resize(frame.scratch_begin);
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::close_struct()
+{
+  auto frame = frames.back();
+  if (frame.count != frame.object->fields()->size())
+  {
+    ESP_LOGE(TAG, "Wrong number of initializers for struct '%s'", frame.object->name()->c_str());
+    return false;
+  }
+
+  frames.pop_back();
+
+  auto& parent = frames.back();
+  switch (parent.type)
+  {
+    case TableFrame:
+      // The struct bytes stay in scratch, until the table is closed
+      return store_field_value(frame.scratch_begin);
+
+    case StructFrame:
+      memcpy(
+        &scratch[parent.scratch_begin + parent.field->offset()],
+        &scratch[frame.scratch_begin],
+        frame.object->bytesize());
+      scratch.resize(frame.scratch_begin);
+      parent.count++;
+      return value_stored();
+
+    case VectorFrame:
+      // The struct was assembled in place, as the next vector element
+      parent.count++;
+      return value_stored();
+
+    default:
+      ESP_LOGE(TAG, "Unexpected struct value");
+      return false;
+  }
+}
+
+bool
+FlatbuffersStreamingJsonBuilder::close_vector(flatbuffers::uoffset_t& offset)
+{
+  auto& frame = frames.back();
+
+  bool is_offset = true;
+  size_t element_size = sizeof(flatbuffers::uoffset_t);
+  size_t alignment = sizeof(flatbuffers::uoffset_t);
+
+  if (frame.type == VectorFrame)
+  {
+    auto element = frame.field->type()->element();
+    if (flatbuffers::IsScalar(element))
+    {
+      is_offset = false;
+      element_size = flatbuffers::GetTypeSize(element);
+      alignment = element_size;
+    }
+    else if ((element == reflection::Obj) && frame.object->is_struct())
+    {
+      is_offset = false;
+      element_size = frame.object->bytesize();
+      alignment = frame.object->minalign();
+    }
+  }
+
+  if ((frame.type == KeyedVectorFrame) && frame.table->is_sorted)
+  {
+    sort_keyed_vector(frame);
+  }
+
+  fbb.StartVector(frame.count * element_size / alignment, alignment);
+
+  // No padding is added here, but the buffer alignment is updated
+  fbb.Align(alignment);
+
+  if (is_offset)
+  {
+    // Start at the back, since we're building the data backwards
+    for (auto i = frame.count; i > 0; --i)
+    {
+      flatbuffers::uoffset_t element;
+      memcpy(&element,
+        &scratch[frame.scratch_begin + (i - 1) * sizeof(element)],
+        sizeof(element));
+      fbb.PushElement(flatbuffers::Offset<void>(element));
+    }
+  }
+  else if (frame.count > 0)
+  {
+    fbb.PushBytes(&scratch[frame.scratch_begin], frame.count * element_size);
+  }
+
+  offset = fbb.EndVector(frame.count);
+
+  scratch.resize(frame.scratch_begin);
+  return true;
+}
+
+void
+FlatbuffersStreamingJsonBuilder::sort_keyed_vector(const Frame& frame)
+{
+  if (frame.count < 2)
+  {
+    return;
+  }
+
+  // The elements are already built, so their ids are read back in place
+  auto id_offset = frame.table->id_field->field->offset();
+  sorted_elements.resize(frame.count);
+  for (size_t i = 0; i < frame.count; ++i)
+  {
+    auto& element = sorted_elements[i];
+    memcpy(&element.offset,
+      &scratch[frame.scratch_begin + i * sizeof(element.offset)],
+      sizeof(element.offset));
+
+    auto table = reinterpret_cast<const flatbuffers::Table*>(
+      fbb.GetCurrentBufferPointer() + fbb.GetSize() - element.offset);
+    auto id = table->GetPointer<const flatbuffers::String*>(id_offset);
+    element.id = (id != nullptr)? id->c_str() : "";
+  }
+
+  // As LookupByKey compares them. Later elements have larger offsets,
+  // so repeated keys stay in document order
+  auto less = [](const SortedElement& a, const SortedElement& b)
+  {
+    auto cmp = strcmp(a.id, b.id);
+    return ((cmp < 0) || ((cmp == 0) && (a.offset < b.offset)));
+  };
+
+  // Maps are often sent in key order already
+  if (std::is_sorted(sorted_elements.begin(), sorted_elements.end(), less))
+  {
+    return;
+  }
+
+  std::sort(sorted_elements.begin(), sorted_elements.end(), less);
+
+  for (size_t i = 0; i < frame.count; ++i)
+  {
+    memcpy(&scratch[frame.scratch_begin + i * sizeof(flatbuffers::uoffset_t)],
+      &sorted_elements[i].offset,
+      sizeof(flatbuffers::uoffset_t));
+  }
+}
+
+flatbuffers::Offset<flatbuffers::String>
+FlatbuffersStreamingJsonBuilder::create_string(stx::string_view s)
+{
+  if (s.size() > intern_max_length)
+  {
+    return fbb.CreateString(s.data(), s.size());
+  }
+
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (auto c : s)
+  {
+    hash = ((hash ^ static_cast<uint8_t>(c)) * 16777619u);
+  }
+
+  // Offsets count from the end of the buffer, so stay valid as it grows
+  auto& slot = interned[hash % intern_slots];
+  if (slot != 0)
+  {
+    auto str = reinterpret_cast<const flatbuffers::String*>(
+      fbb.GetCurrentBufferPointer() + fbb.GetSize() - slot);
+    if ((str->size() == s.size()) && (memcmp(str->c_str(), s.data(), s.size()) == 0))
+    {
+      return flatbuffers::Offset<flatbuffers::String>(slot);
+    }
+  }
+
+  auto str = fbb.CreateString(s.data(), s.size());
+  slot = str.o;
+  return str;
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers_streaming_json_batch.h"
+#include "flatbuffers_streaming_json_flexbuffer.h"
+#include "flatbuffers_streaming_json_number.h"
+#include "flatbuffers_streaming_json_parser.h"
+#include "flatbuffers_streaming_json_schema_index.h"
+
+#include "flatbuffers/flatbuffers.h"
+#include "flatbuffers/reflection.h"
+
+#include "stx/string_view.hpp"
+
+#include <string>
+#include <vector>
+
+// Builds a flatbuffer directly from streamed JSON events,
+// using the binary (reflection) schema to resolve each key to a field.
+// This avoids re-serializing JSON text and parsing it a second time.
+class FlatbuffersStreamingJsonBuilder
+{
+public:
+  // The allocator (e.g. a FlatbuffersStreamingJsonArena) backs the builder's
+  // buffer, otherwise the heap is used
+  FlatbuffersStreamingJsonBuilder(
+    const FlatbuffersStreamingJsonParser& _flatbuffers_parser,
+    flatbuffers::Allocator* allocator=nullptr,
+    size_t initial_size=1024
+  );
+
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonBuilder";
+
+  void clear();
+
+  // Return the builder's buffer to its allocator, e.g. before an arena reset
+  void release();
+
+  // Size the nesting and field state up front, so it does not grow mid-stream
+  void reserve(size_t depth, size_t fields, size_t scratch_size);
+
+  // The root table is opened implicitly, following keys are its fields
+  bool start_root(const reflection::Object* table);
+
+  // A size-prefixed buffer carries its own length, for streams of buffers
+  bool finish_root(bool size_prefixed = false);
+
+  // Items of a shared batch are built one after another into one buffer,
+  // so later items reuse the strings and vtables of earlier ones.
+  // Each item is started, then ended instead of finished
+  bool start_batch_root(const reflection::Object* table);
+  bool end_batch_root();
+
+  // Items ended so far
+  size_t get_batch_size() const;
+
+  // Finish the batch's items as one FlatbuffersStreamingJsonSharedBatch
+  bool finish_batch();
+
+  bool set_key(stx::string_view key);
+
+  bool set_null();
+  bool set_bool(bool b);
+  bool set_int64(int64_t i);
+  bool set_number(double d);
+  bool set_raw_number(const FlatbuffersStreamingJsonNumber& number);
+  bool set_string(stx::string_view s);
+
+  bool start_object();
+  bool end_object();
+  bool start_array();
+  bool end_array();
+
+  // Only valid after finish_root()
+  const uint8_t* get_buffer_pointer() const;
+  size_t get_size() const;
+
+  // Bytes built so far, before finish_root()
+  size_t get_built_size() const;
+
+private:
+  enum FrameType
+  {
+    TableFrame,
+    StructFrame,
+    VectorFrame,
+    // JSON object of {"key": {...}} re-written as [{"id": "key", "val": {...}}]
+    KeyedVectorFrame,
+  };
+
+  struct Frame
+  {
+    FrameType type;
+
+    // Table or struct being built, or element table of a vector
+    const reflection::Object* object;
+    const FlatbuffersStreamingJsonSchemaIndex::Table* table;
+
+    // Field receiving the next value, or the field holding this vector
+    const reflection::Field* field;
+
+    // The next value has no matching field, and will be discarded
+    bool skip_value;
+
+    // The next value is a flexbuffer field's, captured whole
+    bool flexbuffer_value;
+
+    // Close this (keyed vector element) table as soon as a value is stored
+    bool auto_close;
+
+    // Start of this frame's state in field_values / scratch
+    size_t values_begin;
+    size_t scratch_begin;
+
+    // Vector element count
+    size_t count;
+  };
+
+  struct FieldValue
+  {
+    const reflection::Field* field;
+
+    // Little-endian scalar bytes, an offset into the builder,
+    // or the scratch position of inline struct bytes
+    uint64_t data;
+  };
+
+  // A keyed vector element, by its id
+  struct SortedElement
+  {
+    const char* id;
+    flatbuffers::uoffset_t offset;
+  };
+
+  bool is_discarding_value() const;
+
+  // Events of a flexbuffer field's value go to the capture, until it is whole
+  bool is_capturing_flexbuffer() const;
+  bool flexbuffer_value_added(bool ok);
+  bool get_value_type(
+    reflection::BaseType& base_type,
+    int32_t& index) const;
+
+  bool store_scalar(const uint8_t* bytes, size_t size);
+  bool store_offset(flatbuffers::uoffset_t offset);
+  bool store_field_value(uint64_t data);
+  bool value_stored();
+
+  bool encode_integer(
+    reflection::BaseType base_type,
+    int64_t i,
+    uint8_t* bytes) const;
+  bool encode_real(
+    reflection::BaseType base_type,
+    double d,
+    uint8_t* bytes) const;
+  bool encode_number(
+    reflection::BaseType base_type,
+    const FlatbuffersStreamingJsonNumber& number,
+    uint8_t* bytes) const;
+  bool encode_string(
+    reflection::BaseType base_type,
+    int32_t index,
+    stx::string_view s,
+    uint8_t* bytes) const;
+
+  bool lookup_enum_value(
+    int32_t index,
+    stx::string_view name,
+    int64_t& value) const;
+
+  const reflection::Object* get_union_table(const Frame& frame) const;
+  const reflection::Field* get_keyed_vector_val_field(
+    const reflection::Object* table) const;
+
+  bool push_frame(
+    FrameType type,
+    const reflection::Object* object,
+    const reflection::Field* field);
+
+  bool close_table(flatbuffers::uoffset_t& offset);
+  bool close_struct();
+  bool close_vector(flatbuffers::uoffset_t& offset);
+  void sort_keyed_vector(const Frame& frame);
+
+  flatbuffers::Offset<flatbuffers::String> create_string(stx::string_view s);
+
+  const reflection::Schema* schema = nullptr;
+  const FlatbuffersStreamingJsonSchemaIndex& schema_index;
+
+  flatbuffers::FlatBufferBuilder fbb;
+
+  std::vector<Frame> frames;
+  std::vector<FieldValue> field_values;
+  std::vector<uint8_t> scratch;
+
+  // Elements of a keyed vector being sorted
+  std::vector<SortedElement> sorted_elements;
+
+  // Nesting depth of a discarded object/array value
+  int skip_depth = 0;
+
+  FlatbuffersStreamingJsonFlexBufferCapture flexbuffer;
+
+  bool finished = false;
+
+  // Roots of the shared batch's items
+  std::vector<flatbuffers::Offset<flatbuffers::Table>> batch_roots;
+
+  // Short strings (enum-like values, keyed vector ids) are stored once per
+  // buffer: each slot holds the offset of the last string hashed to it
+  static constexpr size_t intern_max_length = 32;
+  static constexpr size_t intern_slots = 64;
+  flatbuffers::uoffset_t interned[intern_slots] = {};
+};
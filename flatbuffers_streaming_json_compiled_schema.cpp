@@ -0,0 +1,181 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_compiled_schema.h"
+
+#include "esp_log.h"
+
+#include <cstdint>
+
+constexpr char FlatbuffersStreamingJsonCompiledSchema::TAG[];
+
+FlatbuffersStreamingJsonCompiledSchema::FlatbuffersStreamingJsonCompiledSchema(
+  stx::string_view _text_schema,
+  stx::string_view binary_schema,
+  const std::vector<FlatbuffersStreamingJsonKeyedTable>& keyed_tables
+)
+{
+  did_check_text_schema = check_flatbuffers_text_schema(_text_schema);
+  if (did_check_text_schema)
+  {
+    text_schema = _text_schema;
+  }
+
+  did_parse_binary_schema = parse_flatbuffers_binary_schema(binary_schema, keyed_tables);
+}
+
+FlatbuffersStreamingJsonCompiledSchema::FlatbuffersStreamingJsonCompiledSchema(
+  stx::string_view binary_schema,
+  const std::vector<FlatbuffersStreamingJsonKeyedTable>& keyed_tables
+)
+: is_binary_only(true)
+{
+  did_parse_binary_schema = parse_flatbuffers_binary_schema(binary_schema, keyed_tables);
+}
+
+bool
+FlatbuffersStreamingJsonCompiledSchema::is_ready() const
+{
+  return (
+    (did_check_text_schema || is_binary_only) &&
+    did_parse_binary_schema
+  );
+}
+
+bool
+FlatbuffersStreamingJsonCompiledSchema::has_text_schema() const
+{
+  return did_check_text_schema;
+}
+
+bool
+FlatbuffersStreamingJsonCompiledSchema::has_binary_schema() const
+{
+  return did_parse_binary_schema;
+}
+
+stx::string_view
+FlatbuffersStreamingJsonCompiledSchema::get_text_schema() const
+{
+  return text_schema;
+}
+
+const reflection::Schema*
+FlatbuffersStreamingJsonCompiledSchema::get_flatbuffers_schema() const
+{
+  return schema;
+}
+
+const reflection::Object*
+FlatbuffersStreamingJsonCompiledSchema::get_flatbuffers_table(
+  flatbuffers::uoffset_t index
+) const
+{
+  return schema? schema->objects()->Get(index) : (reflection::Object*)nullptr;
+}
+
+const reflection::Object*
+FlatbuffersStreamingJsonCompiledSchema::get_flatbuffers_table(
+  const char* name
+) const
+{
+  // Objects are sorted by their fully qualified name
+  return schema? schema->objects()->LookupByKey(name) : nullptr;
+}
+
+const reflection::Object*
+FlatbuffersStreamingJsonCompiledSchema::get_flatbuffers_root_table() const
+{
+  return schema? schema->root_table() : nullptr;
+}
+
+const FlatbuffersStreamingJsonSchemaIndex&
+FlatbuffersStreamingJsonCompiledSchema::get_schema_index() const
+{
+  return schema_index;
+}
+
+bool
+FlatbuffersStreamingJsonCompiledSchema::check_flatbuffers_text_schema(
+  stx::string_view buf
+)
+{
+  // Check for a non-zero buffer length
+  if (!buf.empty())
+  {
+    // Check for a nullptr terminated buffer
+    char eof = buf[buf.size() - 1];
+    if (eof == 0x00)
+    {
+      return true;
+    }
+    else {
+      ESP_LOGE(TAG, "nullptr byte missing from text flatbuffer schema buffer");
+    }
+  }
+  else {
+    ESP_LOGE(TAG, "0 length text flatbuffer schema buffer found");
+  }
+
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonCompiledSchema::parse_flatbuffers_binary_schema(
+  stx::string_view buf,
+  const std::vector<FlatbuffersStreamingJsonKeyedTable>& keyed_tables
+)
+{
+  // Load flatbuffers binary schema from buffer, it is used in place
+  // Check for a non-zero buffer length
+  if (!buf.empty())
+  {
+    // The verifier bounds every read, so no terminating byte is needed
+    // (a .bfbs embedded with COMPONENT_EMBED_FILES has none)
+    flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t *>(buf.data()), buf.size());
+    if ((reinterpret_cast<uintptr_t>(buf.data()) % sizeof(flatbuffers::uoffset_t)) != 0)
+    {
+      // Offsets are read in place, which must not fault
+      ESP_LOGE(TAG, "Unaligned binary flatbuffer schema buffer");
+    }
+    else if (reflection::VerifySchemaBuffer(verifier))
+    {
+      // Parse a buffer containing the binary schema
+      schema = reflection::GetSchema(buf.data());
+      if (schema != nullptr)
+      {
+        // Success
+        ESP_LOGI(TAG, "Successfully parsed binary flatbuffer schema buffer");
+
+        // Print the namespaced-name of the (default) root object
+        if (schema->root_table() != nullptr)
+        {
+          ESP_LOGI(TAG, "Default root table: %s", schema->root_table()->name()->c_str());
+        }
+
+        // Resolve field lookups once, instead of for every JSON key
+        if (schema_index.build(schema, keyed_tables))
+        {
+          return true;
+        }
+
+        ESP_LOGE(TAG, "Keyed table or its fields not found in binary flatbuffer schema");
+      }
+    }
+    else {
+      ESP_LOGE(TAG, "Invalid binary flatbuffer schema buffer");
+    }
+  }
+  else {
+    ESP_LOGE(TAG, "0 length binary flatbuffer schema buffer found");
+  }
+
+  return false;
+}
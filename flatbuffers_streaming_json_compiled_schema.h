@@ -0,0 +1,80 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers_streaming_json_schema_index.h"
+
+#include "flatbuffers/reflection.h"
+
+#include "stx/string_view.hpp"
+
+#include <vector>
+
+// The schemas, loaded once and never modified afterwards,
+// so one instance can be shared by parsers on any task or core.
+// Both buffers are used in place, and must outlive this and its parsers
+class FlatbuffersStreamingJsonCompiledSchema
+{
+private:
+  FlatbuffersStreamingJsonCompiledSchema(const FlatbuffersStreamingJsonCompiledSchema &);
+  FlatbuffersStreamingJsonCompiledSchema &operator=(const FlatbuffersStreamingJsonCompiledSchema &);
+
+public:
+  // The text schema is only kept here, each parser using re-serialized JSON
+  // items parses it into its own flatbuffers::Parser, on first use.
+  // Keyed tables name the key and value fields of JSON maps, when they are
+  // not "id" and "val"
+  FlatbuffersStreamingJsonCompiledSchema(
+    stx::string_view text_schema,
+    stx::string_view binary_schema,
+    const std::vector<FlatbuffersStreamingJsonKeyedTable>& keyed_tables={}
+  );
+
+  explicit FlatbuffersStreamingJsonCompiledSchema(
+    stx::string_view binary_schema,
+    const std::vector<FlatbuffersStreamingJsonKeyedTable>& keyed_tables={}
+  );
+
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonCompiledSchema";
+
+  // Every schema given to the constructor is usable
+  bool is_ready() const;
+
+  bool has_text_schema() const;
+  bool has_binary_schema() const;
+
+  // Null terminated, or empty
+  stx::string_view get_text_schema() const;
+
+  const reflection::Schema* get_flatbuffers_schema() const;
+  const reflection::Object* get_flatbuffers_table(flatbuffers::uoffset_t index) const;
+  const reflection::Object* get_flatbuffers_table(const char* name) const;
+  const reflection::Object* get_flatbuffers_root_table() const;
+
+  // Field lookups for the binary schema, built once it is parsed
+  const FlatbuffersStreamingJsonSchemaIndex& get_schema_index() const;
+
+private:
+  bool check_flatbuffers_text_schema(stx::string_view buf);
+  bool parse_flatbuffers_binary_schema(
+    stx::string_view buf,
+    const std::vector<FlatbuffersStreamingJsonKeyedTable>& keyed_tables);
+
+  stx::string_view text_schema;
+  bool did_check_text_schema = false;
+  bool did_parse_binary_schema = false;
+
+  // Constructed from a binary schema alone
+  bool is_binary_only = false;
+
+  const reflection::Schema* schema = nullptr;
+  FlatbuffersStreamingJsonSchemaIndex schema_index;
+};
@@ -0,0 +1,511 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_decoder.h"
+
+#include "esp_log.h"
+
+constexpr char FlatbuffersStreamingJsonDecoder::TAG[];
+
+void
+FlatbuffersStreamingJsonDecoder::clear()
+{
+  frames.clear();
+  fields_set.clear();
+  skip_depth = 0;
+  flexbuffer = nullptr;
+}
+
+void
+FlatbuffersStreamingJsonDecoder::reserve(size_t depth)
+{
+  frames.reserve(depth);
+  fields_set.reserve(depth * 8);
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::start_root(
+  void* obj,
+  const FlatbuffersStreamingJsonDecoderTable* table
+)
+{
+  clear();
+
+  if ((obj == nullptr) || (table == nullptr))
+  {
+    ESP_LOGE(TAG, "No root object to decode into");
+    return false;
+  }
+
+  push_frame(TableFrame, obj, table, -1);
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::start_flexbuffer_root(
+  FlatbuffersStreamingJsonFlexBufferCapture* capture
+)
+{
+  clear();
+
+  if (capture == nullptr)
+  {
+    ESP_LOGE(TAG, "No flexbuffer to capture into");
+    return false;
+  }
+
+  // The item's root object is opened implicitly, as for a table.
+  // Any value left open by a failed item is dropped
+  flexbuffer = capture;
+  flexbuffer->clear();
+  return flexbuffer->start_object();
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::finish_root()
+{
+  if (flexbuffer != nullptr)
+  {
+    if (!flexbuffer->end_object() || !flexbuffer->is_complete())
+    {
+      ESP_LOGE(TAG, "Unbalanced JSON at end of item");
+      return false;
+    }
+    return true;
+  }
+
+  if ((frames.size() != 1) || (skip_depth > 0))
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON at end of item");
+    return false;
+  }
+
+  frames.clear();
+  fields_set.clear();
+  return true;
+}
+
+void
+FlatbuffersStreamingJsonDecoder::push_frame(
+  FrameType type,
+  void* obj,
+  const FlatbuffersStreamingJsonDecoderTable* table,
+  int field
+)
+{
+  frames.push_back({type, obj, table, field, false, fields_set.size()});
+}
+
+void
+FlatbuffersStreamingJsonDecoder::pop_frame()
+{
+  fields_set.resize(frames.back().fields_begin);
+  frames.pop_back();
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::is_discarding_value() const
+{
+  return (
+    (frames.back().type == TableFrame) &&
+    (frames.back().field < 0)
+  );
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::set_key(stx::string_view key)
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->set_key(key);
+  }
+
+  if (skip_depth > 0)
+  {
+    return true;
+  }
+
+  if (frames.empty())
+  {
+    ESP_LOGE(TAG, "Key '%.*s' found outside of a table", (int)key.size(), key.data());
+    return false;
+  }
+
+  auto& frame = frames.back();
+  switch (frame.type)
+  {
+    case TableFrame:
+      // Support additional (ignored) fields present in JSON but not in the schema
+      frame.field = frame.table->find_field(key);
+      if ((frame.field < 0) && (frame.table->struct_fields_count > 0))
+      {
+        ESP_LOGE(TAG, "Unknown struct field '%.*s'", (int)key.size(), key.data());
+        return false;
+      }
+      return true;
+
+    case KeyedVectorFrame:
+    {
+      // Each key appends a new element, with the key stored as its id
+      const FlatbuffersStreamingJsonDecoderTable* element_table = nullptr;
+      auto element = frame.table->start_object(frame.obj, frame.field, &element_table);
+      if ((element == nullptr) || (element_table == nullptr))
+      {
+        return false;
+      }
+
+      FlatbuffersStreamingJsonDecoderValue id;
+      id.type = FlatbuffersStreamingJsonDecoderValue::String;
+      id.s = key;
+      if (!element_table->set_value(element, element_table->id_field, id))
+      {
+        ESP_LOGE(TAG, "Keyed vector table '%s' needs a string id", element_table->name);
+        return false;
+      }
+
+      push_frame(TableFrame, element, element_table, element_table->val_field);
+      frames.back().auto_close = true;
+      return true;
+    }
+
+    default:
+      ESP_LOGE(TAG, "Key '%.*s' found inside an array", (int)key.size(), key.data());
+      return false;
+  }
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::set_value(
+  const FlatbuffersStreamingJsonDecoderValue& value
+)
+{
+  if (skip_depth > 0)
+  {
+    return true;
+  }
+
+  if (frames.empty())
+  {
+    return false;
+  }
+
+  if (is_discarding_value())
+  {
+    return value_stored();
+  }
+
+  auto& frame = frames.back();
+  if (frame.type == KeyedVectorFrame)
+  {
+    ESP_LOGE(TAG, "Value found in place of a key");
+    return false;
+  }
+
+  // Nulls leave a table field's default value in place
+  if (value.type == FlatbuffersStreamingJsonDecoderValue::Null)
+  {
+    if ((frame.type != TableFrame) || (frame.table->struct_fields_count > 0))
+    {
+      ESP_LOGE(TAG, "Unexpected null value");
+      return false;
+    }
+    return value_stored();
+  }
+
+  if ((frame.type == TableFrame) && !set_field())
+  {
+    return false;
+  }
+
+  if (!frame.table->set_value(frame.obj, frame.field, value))
+  {
+    ESP_LOGE(TAG, "Invalid value for field %d of '%s'", frame.field, frame.table->name);
+    return false;
+  }
+
+  return value_stored();
+}
+
+// The current field of the innermost table or struct is given a value
+bool
+FlatbuffersStreamingJsonDecoder::set_field()
+{
+  const auto& frame = frames.back();
+  for (auto i = frame.fields_begin; i < fields_set.size(); ++i)
+  {
+    if (fields_set[i] == frame.field)
+    {
+      ESP_LOGE(TAG, "Field %d of '%s' set more than once", frame.field, frame.table->name);
+      return false;
+    }
+  }
+
+  fields_set.push_back(frame.field);
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::value_stored()
+{
+  auto& frame = frames.back();
+  if (frame.type == TableFrame)
+  {
+    frame.field = -1;
+    if (frame.auto_close)
+    {
+      pop_frame();
+    }
+  }
+
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::set_null()
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->set_null();
+  }
+
+  FlatbuffersStreamingJsonDecoderValue value;
+  value.type = FlatbuffersStreamingJsonDecoderValue::Null;
+  return set_value(value);
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::set_bool(bool b)
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->set_bool(b);
+  }
+
+  FlatbuffersStreamingJsonDecoderValue value;
+  value.type = FlatbuffersStreamingJsonDecoderValue::Bool;
+  value.b = b;
+  return set_value(value);
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::set_int64(int64_t i)
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->set_int64(i);
+  }
+
+  FlatbuffersStreamingJsonDecoderValue value;
+  value.type = FlatbuffersStreamingJsonDecoderValue::Int;
+  value.i = i;
+  return set_value(value);
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::set_number(double d)
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->set_number(d);
+  }
+
+  FlatbuffersStreamingJsonDecoderValue value;
+  value.type = FlatbuffersStreamingJsonDecoderValue::Number;
+  value.d = d;
+  return set_value(value);
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::set_raw_number(
+  const FlatbuffersStreamingJsonNumber& number
+)
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->set_raw_number(number);
+  }
+
+  FlatbuffersStreamingJsonDecoderValue value;
+  value.type = FlatbuffersStreamingJsonDecoderValue::RawNumber;
+  value.number = number;
+  return set_value(value);
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::set_string(stx::string_view s)
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->set_string(s);
+  }
+
+  FlatbuffersStreamingJsonDecoderValue value;
+  value.type = FlatbuffersStreamingJsonDecoderValue::String;
+  value.s = s;
+  return set_value(value);
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::start_object()
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->start_object();
+  }
+
+  if ((skip_depth > 0) || frames.empty() || is_discarding_value())
+  {
+    skip_depth++;
+    return true;
+  }
+
+  auto& frame = frames.back();
+  if (frame.type == KeyedVectorFrame)
+  {
+    ESP_LOGE(TAG, "Object found in place of a key");
+    return false;
+  }
+
+  // A table or struct field, a keyed vector given as an object,
+  // or the next element of a vector of tables
+  // (a keyed vector element, when given as an array)
+  auto kind = frame.table->get_field_kind(frame.field);
+  bool is_field = (
+    (frame.type == TableFrame) &&
+    ((kind == DecoderObjectField) || (kind == DecoderKeyedVectorField))
+  );
+  bool is_element = (
+    (frame.type == VectorFrame) &&
+    ((kind == DecoderObjectVectorField) || (kind == DecoderKeyedVectorField))
+  );
+
+  if (is_field && !set_field())
+  {
+    return false;
+  }
+
+  if (is_field && (kind == DecoderKeyedVectorField))
+  {
+    push_frame(KeyedVectorFrame, frame.obj, frame.table, frame.field);
+    return true;
+  }
+
+  if (is_field || is_element)
+  {
+    const FlatbuffersStreamingJsonDecoderTable* child_table = nullptr;
+    auto child = frame.table->start_object(frame.obj, frame.field, &child_table);
+    if ((child == nullptr) || (child_table == nullptr))
+    {
+      return false;
+    }
+
+    push_frame(TableFrame, child, child_table, -1);
+    return true;
+  }
+
+  ESP_LOGE(TAG, "Object found for field %d of '%s'", frame.field, frame.table->name);
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::end_object()
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->end_object();
+  }
+
+  if (skip_depth > 0)
+  {
+    skip_depth--;
+    return ((skip_depth > 0) || frames.empty() || value_stored());
+  }
+
+  if (frames.size() <= 1)
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON object");
+    return false;
+  }
+
+  const auto& frame = frames.back();
+  if ((frame.type == TableFrame) &&
+      (frame.table->struct_fields_count > 0) &&
+      ((fields_set.size() - frame.fields_begin) != static_cast<size_t>(frame.table->struct_fields_count)))
+  {
+    ESP_LOGE(TAG, "Wrong number of initializers for struct '%s'", frame.table->name);
+    return false;
+  }
+
+  pop_frame();
+  return value_stored();
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::start_array()
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->start_array();
+  }
+
+  if ((skip_depth > 0) || frames.empty() || is_discarding_value())
+  {
+    skip_depth++;
+    return true;
+  }
+
+  auto& frame = frames.back();
+  if (frame.type == TableFrame)
+  {
+    switch (frame.table->get_field_kind(frame.field))
+    {
+      case DecoderScalarVectorField:
+      case DecoderObjectVectorField:
+      case DecoderKeyedVectorField:
+        // A keyed vector may also be given as an array of its elements
+        if (!set_field())
+        {
+          return false;
+        }
+
+        push_frame(VectorFrame, frame.obj, frame.table, frame.field);
+        return true;
+
+      default:
+        break;
+    }
+  }
+
+  ESP_LOGE(TAG, "Array found for field %d of '%s'", frame.field, frame.table->name);
+  return false;
+}
+
+bool
+FlatbuffersStreamingJsonDecoder::end_array()
+{
+  if (flexbuffer != nullptr)
+  {
+    return flexbuffer->end_array();
+  }
+
+  if (skip_depth > 0)
+  {
+    skip_depth--;
+    return ((skip_depth > 0) || frames.empty() || value_stored());
+  }
+
+  if ((frames.size() <= 1) || (frames.back().type != VectorFrame))
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON array");
+    return false;
+  }
+
+  pop_frame();
+  return value_stored();
+}
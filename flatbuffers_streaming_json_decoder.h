@@ -0,0 +1,411 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers_streaming_json_flexbuffer.h"
+#include "flatbuffers_streaming_json_number.h"
+
+#include "flatbuffers/flatbuffers.h"
+
+#include "stx/string_view.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Decodes streamed JSON events straight into gen-object-api native objects,
+// using per-table descriptors emitted at build time by
+// tools/flatbuffers_streaming_json_gen (no reflection, idl Parser or schema).
+// It takes the same events as FlatbuffersStreamingJsonBuilder.
+// Items with no schema at all are captured into a flexbuffer instead.
+
+struct FlatbuffersStreamingJsonDecoderValue
+{
+  enum Type
+  {
+    Null,
+    Bool,
+    Int,
+    Number,
+    // A number token, converted by the field's own type
+    RawNumber,
+    String,
+  };
+
+  Type type;
+  bool b;
+  int64_t i;
+  double d;
+  FlatbuffersStreamingJsonNumber number;
+  stx::string_view s;
+};
+
+enum FlatbuffersStreamingJsonDecoderFieldKind
+{
+  // A scalar, enum or string value
+  DecoderScalarField,
+  // A vector of scalars, enums or strings, each item is appended
+  DecoderScalarVectorField,
+  // A table or struct value
+  DecoderObjectField,
+  // A vector of tables or structs
+  DecoderObjectVectorField,
+  // A vector of {"id", "val"} tables, from a JSON object of {"key": val}
+  DecoderKeyedVectorField,
+  // Not supported by generated decoders (e.g. unions)
+  DecoderUnsupportedField,
+};
+
+struct FlatbuffersStreamingJsonDecoderTable
+{
+  // Fully qualified name
+  const char* name;
+
+  // Field id of a key, or -1
+  int (*find_field)(stx::string_view key);
+
+  FlatbuffersStreamingJsonDecoderFieldKind (*get_field_kind)(int field);
+
+  // Store a value in a field, or append it to a vector field
+  bool (*set_value)(void* obj, int field, const FlatbuffersStreamingJsonDecoderValue& value);
+
+  // Returns the object for a table or struct field (or appends one to a
+  // vector field), and its descriptor
+  void* (*start_object)(void* obj, int field, const FlatbuffersStreamingJsonDecoderTable** table);
+
+  // Keyed vector element tables, otherwise -1
+  int id_field;
+  int val_field;
+
+  // Structs must have each of their fields set, 0 for tables
+  int struct_fields_count;
+};
+
+// Specialized by the generated code, for each native object type
+template<typename ObjT>
+struct FlatbuffersStreamingJsonDecoderTraits;
+
+class FlatbuffersStreamingJsonDecoder
+{
+public:
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonDecoder";
+
+  void clear();
+
+  // Size the nesting state up front, so it does not grow mid-stream
+  void reserve(size_t depth);
+
+  // The root object is opened implicitly, following keys are its fields
+  bool start_root(void* obj, const FlatbuffersStreamingJsonDecoderTable* table);
+  bool finish_root();
+
+  // Capture the item as a flexbuffer map of its keys instead,
+  // complete after finish_root()
+  bool start_flexbuffer_root(FlatbuffersStreamingJsonFlexBufferCapture* capture);
+
+  bool set_key(stx::string_view key);
+
+  bool set_null();
+  bool set_bool(bool b);
+  bool set_int64(int64_t i);
+  bool set_number(double d);
+  bool set_raw_number(const FlatbuffersStreamingJsonNumber& number);
+  bool set_string(stx::string_view s);
+
+  bool start_object();
+  bool end_object();
+  bool start_array();
+  bool end_array();
+
+private:
+  enum FrameType
+  {
+    TableFrame,
+    VectorFrame,
+    KeyedVectorFrame,
+  };
+
+  struct Frame
+  {
+    FrameType type;
+
+    // Object being decoded, or the object holding this vector field
+    void* obj;
+    const FlatbuffersStreamingJsonDecoderTable* table;
+
+    // Field receiving the next value, or the vector field, -1 to discard
+    int field;
+
+    // Close this (keyed vector element) frame as soon as a value is stored
+    bool auto_close;
+
+    // Start of this frame's fields in fields_set
+    size_t fields_begin;
+  };
+
+  void push_frame(FrameType type, void* obj, const FlatbuffersStreamingJsonDecoderTable* table, int field);
+  void pop_frame();
+
+  bool set_value(const FlatbuffersStreamingJsonDecoderValue& value);
+  bool set_field();
+  bool value_stored();
+  bool is_discarding_value() const;
+
+  std::vector<Frame> frames;
+
+  // Fields given a value in each open table or struct, as the builder
+  // rejects any set more than once
+  std::vector<int> fields_set;
+
+  // Nesting depth of a discarded object/array value
+  int skip_depth = 0;
+
+  // Receives every event, for a flexbuffer item
+  FlatbuffersStreamingJsonFlexBufferCapture* flexbuffer = nullptr;
+};
+
+// Conversions used by the generated set_value() functions,
+// with the same range checks as FlatbuffersStreamingJsonBuilder,
+// which also allows numbers inside quotes
+template<typename T>
+inline bool
+flatbuffers_streaming_json_decode_integer(
+  const FlatbuffersStreamingJsonDecoderValue& value,
+  T& out)
+{
+  int64_t i = 0;
+  FlatbuffersStreamingJsonNumber number;
+  switch (value.type)
+  {
+    case FlatbuffersStreamingJsonDecoderValue::Int:
+      i = value.i;
+      break;
+
+    case FlatbuffersStreamingJsonDecoderValue::Bool:
+      i = value.b? 1 : 0;
+      break;
+
+    case FlatbuffersStreamingJsonDecoderValue::RawNumber:
+      return flatbuffers_streaming_json_number_to_integer(value.number, out);
+
+    case FlatbuffersStreamingJsonDecoderValue::String:
+      return (
+        flatbuffers_streaming_json_scan_number(value.s, number) &&
+        flatbuffers_streaming_json_number_to_integer(number, out)
+      );
+
+    case FlatbuffersStreamingJsonDecoderValue::Number:
+      // Only whole numbers fit an integer field
+      if (std::floor(value.d) != value.d)
+      {
+        return false;
+      }
+
+      // Integral values too large to be represented as int64_t
+      if (!std::numeric_limits<T>::is_signed &&
+          (value.d >= 9223372036854775808.0) &&
+          (value.d < 18446744073709551616.0) &&
+          (static_cast<uint64_t>(value.d) <= static_cast<uint64_t>(std::numeric_limits<T>::max())))
+      {
+        out = static_cast<T>(static_cast<uint64_t>(value.d));
+        return true;
+      }
+
+      if ((value.d < -9223372036854775808.0) ||
+          (value.d >= 9223372036854775808.0))
+      {
+        return false;
+      }
+      i = static_cast<int64_t>(value.d);
+      break;
+
+    default:
+      return false;
+  }
+
+  if (std::numeric_limits<T>::is_signed)
+  {
+    if ((i < static_cast<int64_t>(std::numeric_limits<T>::min())) ||
+        (i > static_cast<int64_t>(std::numeric_limits<T>::max())))
+    {
+      return false;
+    }
+  }
+  else if ((i < 0) ||
+           (static_cast<uint64_t>(i) > static_cast<uint64_t>(std::numeric_limits<T>::max())))
+  {
+    return false;
+  }
+
+  out = static_cast<T>(i);
+  return true;
+}
+
+// Any whole number, or "true" and "false" inside quotes
+inline bool
+flatbuffers_streaming_json_decode_bool(
+  const FlatbuffersStreamingJsonDecoderValue& value,
+  bool& out)
+{
+  if ((value.type == FlatbuffersStreamingJsonDecoderValue::String) &&
+      ((value.s == "true") || (value.s == "false")))
+  {
+    out = (value.s == "true");
+    return true;
+  }
+
+  int64_t i = 0;
+  if (flatbuffers_streaming_json_decode_integer(value, i))
+  {
+    out = (i != 0);
+    return true;
+  }
+  return false;
+}
+
+template<typename T>
+inline bool
+flatbuffers_streaming_json_decode_real(
+  const FlatbuffersStreamingJsonDecoderValue& value,
+  T& out)
+{
+  FlatbuffersStreamingJsonNumber number;
+  switch (value.type)
+  {
+    case FlatbuffersStreamingJsonDecoderValue::Number:
+      out = static_cast<T>(value.d);
+      return true;
+
+    case FlatbuffersStreamingJsonDecoderValue::Int:
+      out = static_cast<T>(value.i);
+      return true;
+
+    case FlatbuffersStreamingJsonDecoderValue::Bool:
+      out = static_cast<T>(value.b? 1 : 0);
+      return true;
+
+    case FlatbuffersStreamingJsonDecoderValue::RawNumber:
+      return flatbuffers_streaming_json_number_to_real(value.number, out);
+
+    case FlatbuffersStreamingJsonDecoderValue::String:
+      return (
+        flatbuffers_streaming_json_scan_number(value.s, number) &&
+        flatbuffers_streaming_json_number_to_real(number, out)
+      );
+
+    default:
+      return false;
+  }
+}
+
+inline bool
+flatbuffers_streaming_json_decode_string(
+  const FlatbuffersStreamingJsonDecoderValue& value,
+  std::string& out)
+{
+  if (value.type != FlatbuffersStreamingJsonDecoderValue::String)
+  {
+    return false;
+  }
+
+  out.assign(value.s.data(), value.s.size());
+  return true;
+}
+
+// Enums accept a value name, or its integer value
+template<typename T>
+inline bool
+flatbuffers_streaming_json_decode_enum(
+  const FlatbuffersStreamingJsonDecoderValue& value,
+  bool (*find_value)(stx::string_view name, int64_t& i),
+  T& out)
+{
+  FlatbuffersStreamingJsonDecoderValue named = value;
+  if ((value.type == FlatbuffersStreamingJsonDecoderValue::String) &&
+      find_value(value.s, named.i))
+  {
+    named.type = FlatbuffersStreamingJsonDecoderValue::Int;
+    return flatbuffers_streaming_json_decode_integer(named, out);
+  }
+
+  return flatbuffers_streaming_json_decode_integer(value, out);
+}
+
+// Struct fields are stored in place, as in the flatbuffer itself
+template<typename T>
+inline bool
+flatbuffers_streaming_json_decode_struct_integer(
+  const FlatbuffersStreamingJsonDecoderValue& value,
+  void* obj,
+  size_t offset)
+{
+  T v;
+  if (!flatbuffers_streaming_json_decode_integer(value, v))
+  {
+    return false;
+  }
+
+  flatbuffers::WriteScalar<T>(static_cast<uint8_t*>(obj) + offset, v);
+  return true;
+}
+
+inline bool
+flatbuffers_streaming_json_decode_struct_bool(
+  const FlatbuffersStreamingJsonDecoderValue& value,
+  void* obj,
+  size_t offset)
+{
+  bool v;
+  if (!flatbuffers_streaming_json_decode_bool(value, v))
+  {
+    return false;
+  }
+
+  flatbuffers::WriteScalar<uint8_t>(static_cast<uint8_t*>(obj) + offset, v? 1 : 0);
+  return true;
+}
+
+template<typename T>
+inline bool
+flatbuffers_streaming_json_decode_struct_real(
+  const FlatbuffersStreamingJsonDecoderValue& value,
+  void* obj,
+  size_t offset)
+{
+  T v;
+  if (!flatbuffers_streaming_json_decode_real(value, v))
+  {
+    return false;
+  }
+
+  flatbuffers::WriteScalar<T>(static_cast<uint8_t*>(obj) + offset, v);
+  return true;
+}
+
+template<typename T>
+inline bool
+flatbuffers_streaming_json_decode_struct_enum(
+  const FlatbuffersStreamingJsonDecoderValue& value,
+  bool (*find_value)(stx::string_view name, int64_t& i),
+  void* obj,
+  size_t offset)
+{
+  T v;
+  if (!flatbuffers_streaming_json_decode_enum(value, find_value, v))
+  {
+    return false;
+  }
+
+  flatbuffers::WriteScalar<T>(static_cast<uint8_t*>(obj) + offset, v);
+  return true;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_flexbuffer.h"
+
+#include "esp_log.h"
+
+#include <algorithm>
+
+constexpr char FlatbuffersStreamingJsonFlexBufferCapture::TAG[];
+
+FlatbuffersStreamingJsonFlexBufferCapture::FlatbuffersStreamingJsonFlexBufferCapture()
+: builder(0, flexbuffers::BUILDER_FLAG_SHARE_ALL)
+{
+}
+
+void
+FlatbuffersStreamingJsonFlexBufferCapture::clear()
+{
+  // Keep all allocated memory around for the next value
+  builder.Clear();
+  starts.clear();
+  is_map.clear();
+  map_keys.clear();
+  complete = false;
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::is_capturing() const
+{
+  return !starts.empty();
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::is_complete() const
+{
+  return complete;
+}
+
+const std::vector<uint8_t>&
+FlatbuffersStreamingJsonFlexBufferCapture::get_buffer() const
+{
+  return builder.GetBuffer();
+}
+
+void
+FlatbuffersStreamingJsonFlexBufferCapture::start_value()
+{
+  if (starts.empty())
+  {
+    clear();
+  }
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::value_added()
+{
+  if (starts.empty())
+  {
+    builder.Finish();
+    complete = true;
+  }
+  return true;
+}
+
+const char*
+FlatbuffersStreamingJsonFlexBufferCapture::terminated(stx::string_view s)
+{
+  scratch.assign(s.data(), s.size());
+  return scratch.c_str();
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::set_key(stx::string_view key)
+{
+  if (starts.empty() || !is_map.back())
+  {
+    ESP_LOGE(TAG, "Key '%.*s' found outside of an object", (int)key.size(), key.data());
+    return false;
+  }
+
+  if (!map_keys.add_key(key))
+  {
+    return false;
+  }
+
+  builder.Key(terminated(key), key.size());
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::set_null()
+{
+  start_value();
+  builder.Null();
+  return value_added();
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::set_bool(bool b)
+{
+  start_value();
+  builder.Bool(b);
+  return value_added();
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::set_int64(int64_t i)
+{
+  start_value();
+  builder.Int(i);
+  return value_added();
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::set_number(double d)
+{
+  start_value();
+  builder.Double(d);
+  return value_added();
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::set_raw_number(
+  const FlatbuffersStreamingJsonNumber& number
+)
+{
+  start_value();
+
+  const char real_chars[] = ".eE";
+  bool is_real = (
+    std::find_first_of(
+      number.text.begin(), number.text.end(),
+      real_chars, real_chars + (sizeof(real_chars) - 1)) != number.text.end()
+  );
+
+  int64_t i = 0;
+  uint64_t u = 0;
+  double d = 0.0;
+  if (!is_real && flatbuffers_streaming_json_number_to_integer(number, i))
+  {
+    builder.Int(i);
+  }
+  else if (!is_real && flatbuffers_streaming_json_number_to_integer(number, u))
+  {
+    builder.UInt(u);
+  }
+  else if (flatbuffers_streaming_json_number_to_real(number, d))
+  {
+    builder.Double(d);
+  }
+  else {
+    ESP_LOGE(TAG, "Number %.*s not representable in a flexbuffer",
+      (int)number.text.size(), number.text.data());
+    return false;
+  }
+
+  return value_added();
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::set_string(stx::string_view s)
+{
+  start_value();
+  builder.String(terminated(s), s.size());
+  return value_added();
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::start_object()
+{
+  start_value();
+  starts.push_back(builder.StartMap());
+  is_map.push_back(true);
+  map_keys.start_object();
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::end_object()
+{
+  if (starts.empty() || !is_map.back())
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON object");
+    return false;
+  }
+
+  if (!map_keys.end_object())
+  {
+    return false;
+  }
+
+  builder.EndMap(starts.back());
+  starts.pop_back();
+  is_map.pop_back();
+  return value_added();
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::start_array()
+{
+  start_value();
+  starts.push_back(builder.StartVector());
+  is_map.push_back(false);
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonFlexBufferCapture::end_array()
+{
+  if (starts.empty() || is_map.back())
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON array");
+    return false;
+  }
+
+  builder.EndVector(starts.back(), false, false);
+  starts.pop_back();
+  is_map.pop_back();
+  return value_added();
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers_streaming_json_number.h"
+#include "flatbuffers_streaming_json_object_keys.h"
+
+#include "flatbuffers/flexbuffers.h"
+
+#include "stx/string_view.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Captures one JSON value from streamed events into a flexbuffer, so a
+// subtree with no schema is kept in compact binary form in the same pass.
+// It takes the same events as FlatbuffersStreamingJsonBuilder.
+// Keys and strings are shared within the value, as flatc does for
+// (flexbuffer) fields; numbers with a fraction or exponent are doubles,
+// others integers. An object with a key set more than once, or a key with
+// an embedded NUL, fails the value: a flexbuffer map cannot hold them
+class FlatbuffersStreamingJsonFlexBufferCapture
+{
+public:
+  FlatbuffersStreamingJsonFlexBufferCapture();
+
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonFlexBufferCapture";
+
+  // Drop any value, the next event starts a new one
+  void clear();
+
+  // Inside a map or vector of the value
+  bool is_capturing() const;
+
+  // A whole value has been captured, and its flexbuffer finished
+  bool is_complete() const;
+
+  // Only valid once complete, and until the next value starts
+  const std::vector<uint8_t>& get_buffer() const;
+
+  bool set_key(stx::string_view key);
+
+  bool set_null();
+  bool set_bool(bool b);
+  bool set_int64(int64_t i);
+  bool set_number(double d);
+  bool set_raw_number(const FlatbuffersStreamingJsonNumber& number);
+  bool set_string(stx::string_view s);
+
+  bool start_object();
+  bool end_object();
+  bool start_array();
+  bool end_array();
+
+private:
+  FlatbuffersStreamingJsonFlexBufferCapture(const FlatbuffersStreamingJsonFlexBufferCapture&);
+  FlatbuffersStreamingJsonFlexBufferCapture& operator=(const FlatbuffersStreamingJsonFlexBufferCapture&);
+
+  // Before each value, a new value clears the last one
+  void start_value();
+
+  // After each value, the outermost one finishes the flexbuffer
+  bool value_added();
+
+  // Builder::Key and Builder::String copy the byte after the text too,
+  // expecting a null terminator, which a view into the stream lacks
+  const char* terminated(stx::string_view s);
+
+  flexbuffers::Builder builder;
+  std::string scratch;
+
+  // Stack positions of the open maps and vectors, and which they are
+  std::vector<size_t> starts;
+  std::vector<bool> is_map;
+
+  // Checked before each map is ended, EndMap asserts its keys are unique
+  FlatbuffersStreamingJsonObjectKeys map_keys;
+
+  bool complete = false;
+};
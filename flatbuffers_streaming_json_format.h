@@ -0,0 +1,462 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Number formatting for JSON output, into a caller's buffer without
+// snprintf (newlib's allocates for doubles). Reals are the shortest
+// digits that read back as the same value (Grisu2), e.g. 0.1f as 0.1
+
+// Enough for any formatted integer or real
+static constexpr size_t flatbuffers_streaming_json_max_number_size = 32;
+
+static const char flatbuffers_streaming_json_digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+// Returns the end of the digits written
+inline char*
+flatbuffers_streaming_json_format_uint(uint64_t value, char* out)
+{
+  // Written backwards, two digits at a time
+  char buf[20];
+  char* p = buf + sizeof(buf);
+  while (value >= 100)
+  {
+    auto pair = static_cast<size_t>(value % 100) * 2;
+    value /= 100;
+    *--p = flatbuffers_streaming_json_digit_pairs[pair + 1];
+    *--p = flatbuffers_streaming_json_digit_pairs[pair];
+  }
+
+  if (value >= 10)
+  {
+    auto pair = static_cast<size_t>(value) * 2;
+    *--p = flatbuffers_streaming_json_digit_pairs[pair + 1];
+    *--p = flatbuffers_streaming_json_digit_pairs[pair];
+  }
+  else {
+    *--p = static_cast<char>('0' + value);
+  }
+
+  size_t len = static_cast<size_t>((buf + sizeof(buf)) - p);
+  memcpy(out, p, len);
+  return (out + len);
+}
+
+inline char*
+flatbuffers_streaming_json_format_int(int64_t value, char* out)
+{
+  auto magnitude = static_cast<uint64_t>(value);
+  if (value < 0)
+  {
+    *out++ = '-';
+    magnitude = (0 - magnitude);
+  }
+  return flatbuffers_streaming_json_format_uint(magnitude, out);
+}
+
+// f * 2^e
+struct FlatbuffersStreamingJsonDiyFp
+{
+  uint64_t f;
+  int e;
+};
+
+inline FlatbuffersStreamingJsonDiyFp
+flatbuffers_streaming_json_normalize(FlatbuffersStreamingJsonDiyFp x)
+{
+  while ((x.f & 0x8000000000000000ULL) == 0)
+  {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+// The upper 64 bits of the product, rounded
+inline FlatbuffersStreamingJsonDiyFp
+flatbuffers_streaming_json_multiply(
+  FlatbuffersStreamingJsonDiyFp x,
+  FlatbuffersStreamingJsonDiyFp y)
+{
+  const uint64_t m32 = 0xFFFFFFFFULL;
+  uint64_t a = (x.f >> 32);
+  uint64_t b = (x.f & m32);
+  uint64_t c = (y.f >> 32);
+  uint64_t d = (y.f & m32);
+  uint64_t ac = (a * c);
+  uint64_t bc = (b * c);
+  uint64_t ad = (a * d);
+  uint64_t bd = (b * d);
+  uint64_t tmp = ((bd >> 32) + (ad & m32) + (bc & m32));
+  tmp += (1ULL << 31);
+  return {(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32)), (x.e + y.e + 64)};
+}
+
+// A normalized 10^-k, such that the binary exponent of its product
+// with 2^e is in [-60, -32]
+inline FlatbuffersStreamingJsonDiyFp
+flatbuffers_streaming_json_cached_power(int e, int& k)
+{
+  // 10^-348, 10^-340, ..., 10^340
+  static const uint64_t significands[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL,
+    0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL,
+    0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL,
+    0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL,
+    0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL,
+    0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL,
+    0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL,
+    0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL,
+    0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL,
+    0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL,
+    0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL,
+    0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL,
+    0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL,
+    0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL,
+    0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL,
+    0xaf87023b9bf0ee6bULL,
+    };
+    static const int16_t exponents[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+  };
+
+  double dk = ((-61 - e) * 0.30102999566398114) + 347;
+  int ik = static_cast<int>(dk);
+  if ((dk - ik) > 0.0)
+  {
+    ik++;
+  }
+
+  size_t index = static_cast<size_t>((ik >> 3) + 1);
+  k = -(-348 + static_cast<int>(index * 8));
+  return {significands[index], exponents[index]};
+}
+
+inline void
+flatbuffers_streaming_json_grisu_round(
+  char* digits,
+  int len,
+  uint64_t delta,
+  uint64_t rest,
+  uint64_t ten_kappa,
+  uint64_t wp_w)
+{
+  // Step the last digit down while that is still in range, and closer to w
+  while ((rest < wp_w) && ((delta - rest) >= ten_kappa) && (
+           ((rest + ten_kappa) < wp_w) ||
+           ((wp_w - rest) > ((rest + ten_kappa) - wp_w))))
+  {
+    digits[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+// The digits of a value w in (mp - delta, mp], scaled by 10^k
+inline void
+flatbuffers_streaming_json_digit_gen(
+  FlatbuffersStreamingJsonDiyFp w,
+  FlatbuffersStreamingJsonDiyFp mp,
+  uint64_t delta,
+  char* digits,
+  int& len,
+  int& k)
+{
+  static const uint64_t pow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL,
+  };
+
+  const FlatbuffersStreamingJsonDiyFp one = {(1ULL << -mp.e), mp.e};
+  uint64_t wp_w = (mp.f - w.f);
+  auto p1 = static_cast<uint32_t>(mp.f >> -one.e);
+  uint64_t p2 = (mp.f & (one.f - 1));
+
+  int kappa = 1;
+  while ((kappa < 10) && (p1 >= pow10[kappa]))
+  {
+    kappa++;
+  }
+
+  len = 0;
+
+  // The integral part
+  while (kappa > 0)
+  {
+    auto divisor = static_cast<uint32_t>(pow10[kappa - 1]);
+    auto d = (p1 / divisor);
+    p1 %= divisor;
+    if ((d != 0) || (len != 0))
+    {
+      digits[len++] = static_cast<char>('0' + d);
+    }
+    kappa--;
+
+    uint64_t rest = ((static_cast<uint64_t>(p1) << -one.e) + p2);
+    if (rest <= delta)
+    {
+      k += kappa;
+      flatbuffers_streaming_json_grisu_round(
+        digits, len, delta, rest, (pow10[kappa] << -one.e), wp_w);
+      return;
+    }
+  }
+
+  // The fractional part
+  while (true)
+  {
+    p2 *= 10;
+    delta *= 10;
+    auto d = static_cast<char>(p2 >> -one.e);
+    if ((d != 0) || (len != 0))
+    {
+      digits[len++] = static_cast<char>('0' + d);
+    }
+    p2 &= (one.f - 1);
+    kappa--;
+
+    if (p2 < delta)
+    {
+      k += kappa;
+      int index = -kappa;
+      flatbuffers_streaming_json_grisu_round(
+        digits, len, delta, p2, one.f, (wp_w * ((index < 20)? pow10[index] : 0)));
+      return;
+    }
+  }
+}
+
+// The digits of f * 2^e scaled by 10^k, for a value whose lower neighbour
+// is closer than its upper one when it is a power of 2
+inline void
+flatbuffers_streaming_json_grisu2(
+  uint64_t f,
+  int e,
+  bool lower_closer,
+  char* digits,
+  int& len,
+  int& k)
+{
+  // Halfway to the neighbouring values, with the same exponent
+  auto plus = flatbuffers_streaming_json_normalize({((f << 1) + 1), (e - 1)});
+  FlatbuffersStreamingJsonDiyFp minus = lower_closer?
+    FlatbuffersStreamingJsonDiyFp{((f << 2) - 1), (e - 2)} :
+    FlatbuffersStreamingJsonDiyFp{((f << 1) - 1), (e - 1)};
+  minus.f <<= (minus.e - plus.e);
+  minus.e = plus.e;
+
+  auto c_mk = flatbuffers_streaming_json_cached_power(plus.e, k);
+  auto w = flatbuffers_streaming_json_multiply(flatbuffers_streaming_json_normalize({f, e}), c_mk);
+  auto wp = flatbuffers_streaming_json_multiply(plus, c_mk);
+  auto wm = flatbuffers_streaming_json_multiply(minus, c_mk);
+
+  // Inside both boundaries, whichever way the products were rounded
+  wm.f++;
+  wp.f--;
+  flatbuffers_streaming_json_digit_gen(w, wp, (wp.f - wm.f), digits, len, k);
+}
+
+inline char*
+flatbuffers_streaming_json_format_exponent(int k, char* out)
+{
+  if (k < 0)
+  {
+    *out++ = '-';
+    k = -k;
+  }
+
+  if (k >= 100)
+  {
+    *out++ = static_cast<char>('0' + (k / 100));
+    k %= 100;
+    memcpy(out, &flatbuffers_streaming_json_digit_pairs[k * 2], 2);
+    out += 2;
+  }
+  else if (k >= 10)
+  {
+    memcpy(out, &flatbuffers_streaming_json_digit_pairs[k * 2], 2);
+    out += 2;
+  }
+  else {
+    *out++ = static_cast<char>('0' + k);
+  }
+  return out;
+}
+
+// Lay out len digits scaled by 10^k, in place, as a JSON number:
+// 12340000000.0, 12.34, 0.001234, 1e30 or 1.234e33
+inline char*
+flatbuffers_streaming_json_prettify(char* digits, int len, int k)
+{
+  // 10^(kk-1) <= v < 10^kk
+  int kk = (len + k);
+
+  if ((k >= 0) && (kk <= 21))
+  {
+    for (int i = len; i < kk; ++i)
+    {
+      digits[i] = '0';
+    }
+    digits[kk] = '.';
+    digits[kk + 1] = '0';
+    return &digits[kk + 2];
+  }
+  else if ((kk > 0) && (kk <= 21))
+  {
+    memmove(&digits[kk + 1], &digits[kk], static_cast<size_t>(len - kk));
+    digits[kk] = '.';
+    return &digits[len + 1];
+  }
+  else if ((kk > -6) && (kk <= 0))
+  {
+    int offset = (2 - kk);
+    memmove(&digits[offset], &digits[0], static_cast<size_t>(len));
+    digits[0] = '0';
+    digits[1] = '.';
+    for (int i = 2; i < offset; ++i)
+    {
+      digits[i] = '0';
+    }
+    return &digits[len + offset];
+  }
+  else if (len == 1)
+  {
+    digits[1] = 'e';
+    return flatbuffers_streaming_json_format_exponent(kk - 1, &digits[2]);
+  }
+  else {
+    memmove(&digits[2], &digits[1], static_cast<size_t>(len - 1));
+    digits[1] = '.';
+    digits[len + 1] = 'e';
+    return flatbuffers_streaming_json_format_exponent(kk - 1, &digits[len + 2]);
+  }
+}
+
+// Of a significand of significand_bits (without the hidden bit),
+// and an exponent biased by exponent_bias
+inline char*
+flatbuffers_streaming_json_format_real(
+  bool negative,
+  uint64_t significand,
+  int biased_exponent,
+  int significand_bits,
+  int exponent_bias,
+  char* out)
+{
+  const uint64_t hidden_bit = (1ULL << significand_bits);
+  // Infinity and NaN
+  if (biased_exponent == ((exponent_bias * 2) + 1))
+  {
+    memcpy(out, "null", 4);
+    return (out + 4);
+  }
+
+  if (negative)
+  {
+    *out++ = '-';
+  }
+
+  if ((biased_exponent == 0) && (significand == 0))
+  {
+    memcpy(out, "0.0", 3);
+    return (out + 3);
+  }
+
+  uint64_t f = significand;
+  int e = (1 - exponent_bias - significand_bits);
+  if (biased_exponent != 0)
+  {
+    f += hidden_bit;
+    e = (biased_exponent - exponent_bias - significand_bits);
+  }
+
+  int len = 0;
+  int k = 0;
+  flatbuffers_streaming_json_grisu2(
+    f, e, ((significand == 0) && (biased_exponent > 1)), out, len, k);
+  return flatbuffers_streaming_json_prettify(out, len, k);
+}
+
+// NaN and infinities, which JSON has no numbers for, are written as null
+inline char*
+flatbuffers_streaming_json_format_double(double value, char* out)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return flatbuffers_streaming_json_format_real(
+    ((bits >> 63) != 0),
+    (bits & ((1ULL << 52) - 1)),
+    static_cast<int>((bits >> 52) & 0x7FF),
+    52, 1023, out);
+}
+
+inline char*
+flatbuffers_streaming_json_format_float(float value, char* out)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return flatbuffers_streaming_json_format_real(
+    ((bits >> 31) != 0),
+    (bits & ((1UL << 23) - 1)),
+    static_cast<int>((bits >> 23) & 0xFF),
+    23, 127, out);
+}
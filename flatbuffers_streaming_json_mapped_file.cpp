@@ -0,0 +1,285 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_mapped_file.h"
+
+#include "esp_log.h"
+
+#ifndef ESP_PLATFORM
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+#include <cstring>
+
+constexpr char FlatbuffersStreamingJsonMappedInput::TAG[];
+
+FlatbuffersStreamingJsonMappedInput::FlatbuffersStreamingJsonMappedInput()
+{
+}
+
+FlatbuffersStreamingJsonMappedInput::~FlatbuffersStreamingJsonMappedInput()
+{
+  close();
+}
+
+#ifdef ESP_PLATFORM
+bool
+FlatbuffersStreamingJsonMappedInput::open(const esp_partition_t* partition, size_t offset, size_t size)
+{
+  close();
+
+  if ((partition == nullptr) || (offset > partition->size))
+  {
+    ESP_LOGE(TAG, "No partition region to map");
+    return false;
+  }
+
+  if (size == 0)
+  {
+    size = (partition->size - offset);
+  }
+
+  if (size > (partition->size - offset))
+  {
+    ESP_LOGE(TAG, "Region of %u bytes at %u is past the end of partition '%s'",
+      (unsigned)size, (unsigned)offset, partition->label);
+    return false;
+  }
+
+  // Whole 64KB MMU pages are mapped, the pointer is to offset within them
+  const void* ptr = nullptr;
+  esp_err_t err = esp_partition_mmap(partition, offset, size, SPI_FLASH_MMAP_DATA, &ptr, &handle);
+  if (err != ESP_OK)
+  {
+    ESP_LOGE(TAG, "Couldn't map partition '%s', err = %d", partition->label, err);
+    return false;
+  }
+
+  map_data = static_cast<const char*>(ptr);
+  map_size = size;
+  opened = true;
+  return true;
+}
+
+void
+FlatbuffersStreamingJsonMappedInput::close()
+{
+  if (opened)
+  {
+    spi_flash_munmap(handle);
+  }
+
+  handle = 0;
+  map_data = nullptr;
+  map_size = 0;
+  opened = false;
+}
+#else
+bool
+FlatbuffersStreamingJsonMappedInput::open(const char* path)
+{
+  close();
+
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    ESP_LOGE(TAG, "Couldn't open '%s', err = %s", path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    ESP_LOGE(TAG, "Couldn't stat '%s', err = %s", path, strerror(errno));
+    ::close(fd);
+    return false;
+  }
+
+  // mmap refuses a zero length
+  if (st.st_size > 0)
+  {
+    void* ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED)
+    {
+      ESP_LOGE(TAG, "Couldn't map '%s', err = %s", path, strerror(errno));
+      ::close(fd);
+      return false;
+    }
+
+    // Read front to back, so read ahead aggressively
+    madvise(ptr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    map_data = static_cast<const char*>(ptr);
+    map_size = static_cast<size_t>(st.st_size);
+  }
+
+  // The mapping holds its own reference to the file
+  ::close(fd);
+
+  opened = true;
+  return true;
+}
+
+void
+FlatbuffersStreamingJsonMappedInput::close()
+{
+  if (map_data != nullptr)
+  {
+    munmap(const_cast<char*>(map_data), map_size);
+  }
+
+  map_data = nullptr;
+  map_size = 0;
+  opened = false;
+}
+#endif
+
+bool
+FlatbuffersStreamingJsonMappedInput::is_open() const
+{
+  return opened;
+}
+
+const char*
+FlatbuffersStreamingJsonMappedInput::data() const
+{
+  return map_data;
+}
+
+size_t
+FlatbuffersStreamingJsonMappedInput::size() const
+{
+  return map_size;
+}
+
+#ifndef ESP_PLATFORM
+constexpr char FlatbuffersStreamingJsonMappedOutput::TAG[];
+constexpr size_t FlatbuffersStreamingJsonMappedOutput::alignment;
+
+FlatbuffersStreamingJsonMappedOutput::FlatbuffersStreamingJsonMappedOutput()
+{
+}
+
+FlatbuffersStreamingJsonMappedOutput::~FlatbuffersStreamingJsonMappedOutput()
+{
+  close();
+}
+
+bool
+FlatbuffersStreamingJsonMappedOutput::open(const char* path, size_t capacity)
+{
+  close();
+
+  if (capacity == 0)
+  {
+    ESP_LOGE(TAG, "Mapped output needs a capacity");
+    return false;
+  }
+
+  fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    ESP_LOGE(TAG, "Couldn't create '%s', err = %s", path, strerror(errno));
+    return false;
+  }
+
+  // Sparse, blocks are only allocated as pages are written
+  if (ftruncate(fd, static_cast<off_t>(capacity)) != 0)
+  {
+    ESP_LOGE(TAG, "Couldn't size '%s' to %u bytes, err = %s", path, (unsigned)capacity, strerror(errno));
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+
+  void* ptr = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ptr == MAP_FAILED)
+  {
+    ESP_LOGE(TAG, "Couldn't map '%s', err = %s", path, strerror(errno));
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+
+  map_data = static_cast<uint8_t*>(ptr);
+  map_size = capacity;
+  len = 0;
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonMappedOutput::close()
+{
+  if (fd < 0)
+  {
+    return true;
+  }
+
+  bool ok = (munmap(map_data, map_size) == 0);
+  ok = ok && (ftruncate(fd, static_cast<off_t>(len)) == 0);
+  if (!ok)
+  {
+    ESP_LOGE(TAG, "Couldn't trim mapped output to %u bytes, err = %s", (unsigned)len, strerror(errno));
+  }
+
+  ok = (::close(fd) == 0) && ok;
+
+  fd = -1;
+  map_data = nullptr;
+  map_size = 0;
+  len = 0;
+  return ok;
+}
+
+bool
+FlatbuffersStreamingJsonMappedOutput::is_open() const
+{
+  return (fd >= 0);
+}
+
+bool
+FlatbuffersStreamingJsonMappedOutput::write(const uint8_t* record, size_t record_len)
+{
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  // A size-prefixed buffer is aligned from its prefix. Zeros before it
+  // are skipped as padding when read back
+  size_t prefix = (len + alignment - 1) & ~(alignment - 1);
+  if ((prefix > map_size) || (record_len > (map_size - prefix)))
+  {
+    ESP_LOGE(TAG, "Mapped output of %u bytes is full", (unsigned)map_size);
+    return false;
+  }
+
+  // The file was zero filled when it was sized
+  memcpy(map_data + prefix, record, record_len);
+  len = (prefix + record_len);
+  return true;
+}
+
+size_t
+FlatbuffersStreamingJsonMappedOutput::size() const
+{
+  return len;
+}
+
+size_t
+FlatbuffersStreamingJsonMappedOutput::get_capacity() const
+{
+  return map_size;
+}
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+// A read-only memory mapping of captured JSON (or size-prefixed
+// flatbuffers), for the visitor's parse_buffer() or
+// FlatbuffersStreamingJsonStreamReader, so a large capture is paged in
+// as it is read instead of copied through a stream.
+// On the host this is a file, on ESP32 a flash partition: the VFS
+// (SPIFFS, FAT on SD) cannot map files, those are read with parse_stream()
+class FlatbuffersStreamingJsonMappedInput
+{
+public:
+  FlatbuffersStreamingJsonMappedInput();
+  ~FlatbuffersStreamingJsonMappedInput();
+
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonMappedInput";
+
+#ifdef ESP_PLATFORM
+  // Map size bytes of the partition from offset, or the rest of it for 0.
+  // Erased flash after the JSON is not whitespace, so pass its size
+  bool open(const esp_partition_t* partition, size_t offset=0, size_t size=0);
+#else
+  // Map the whole file, an empty one maps to no data
+  bool open(const char* path);
+#endif
+
+  void close();
+
+  bool is_open() const;
+
+  const char* data() const;
+  size_t size() const;
+
+private:
+  FlatbuffersStreamingJsonMappedInput(const FlatbuffersStreamingJsonMappedInput&);
+  FlatbuffersStreamingJsonMappedInput& operator=(const FlatbuffersStreamingJsonMappedInput&);
+
+  const char* map_data = nullptr;
+  size_t map_size = 0;
+  bool opened = false;
+
+#ifdef ESP_PLATFORM
+  spi_flash_mmap_handle_t handle = 0;
+#endif
+};
+
+#ifndef ESP_PLATFORM
+// A preallocated output file, mapped for writing, which a sink subscription
+// appends its size-prefixed flatbuffers to. Each one starts 8-byte
+// aligned, so they can be read back in place from a
+// FlatbuffersStreamingJsonMappedInput of the file.
+// Host only, flash mappings on ESP32 are read-only
+class FlatbuffersStreamingJsonMappedOutput
+{
+public:
+  FlatbuffersStreamingJsonMappedOutput();
+  ~FlatbuffersStreamingJsonMappedOutput();
+
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonMappedOutput";
+
+  static constexpr size_t alignment = 8;
+
+  // Create (or truncate) the file, sized to capacity bytes
+  bool open(const char* path, size_t capacity);
+
+  // Unmap, and trim the file to the bytes written
+  bool close();
+
+  bool is_open() const;
+
+  // One size-prefixed flatbuffer, as given to a sink.
+  // False once it would not fit in the capacity left
+  bool write(const uint8_t* record, size_t len);
+
+  size_t size() const;
+  size_t get_capacity() const;
+
+private:
+  FlatbuffersStreamingJsonMappedOutput(const FlatbuffersStreamingJsonMappedOutput&);
+  FlatbuffersStreamingJsonMappedOutput& operator=(const FlatbuffersStreamingJsonMappedOutput&);
+
+  int fd = -1;
+  uint8_t* map_data = nullptr;
+  size_t map_size = 0;
+  size_t len = 0;
+};
+#endif
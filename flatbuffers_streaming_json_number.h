@@ -0,0 +1,276 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "stx/string_view.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+// A number token, scanned once into its decimal digits and exponent,
+// then converted exactly once into the type of the field receiving it
+struct FlatbuffersStreamingJsonNumber
+{
+  // The token as written, only valid during the event
+  stx::string_view text;
+
+  bool negative;
+
+  // Significant digits, scaled by 10^exponent
+  uint64_t mantissa;
+  int32_t exponent;
+
+  // Non-zero digits were dropped from the mantissa, so it is inexact
+  bool truncated;
+};
+
+// Accepts what strtod() accepts from the tokenizer's number characters:
+// [+-] digits [. digits] [(e|E) [+-] digits], with at least one mantissa digit
+inline bool
+flatbuffers_streaming_json_scan_number(
+  stx::string_view text,
+  FlatbuffersStreamingJsonNumber& number)
+{
+  number.text = text;
+  number.negative = false;
+  number.mantissa = 0;
+  number.exponent = 0;
+  number.truncated = false;
+
+  auto p = text.data();
+  auto end = p + text.size();
+
+  if ((p != end) && ((*p == '-') || (*p == '+')))
+  {
+    number.negative = (*p == '-');
+    ++p;
+  }
+
+  size_t digits = 0;
+  int32_t exponent = 0;
+  bool is_fraction = false;
+  for (; p != end; ++p)
+  {
+    if ((*p == '.') && !is_fraction)
+    {
+      is_fraction = true;
+      continue;
+    }
+
+    if ((*p < '0') || (*p > '9'))
+    {
+      break;
+    }
+
+    digits++;
+    auto digit = static_cast<unsigned>(*p - '0');
+    if (number.mantissa <= ((std::numeric_limits<uint64_t>::max() - digit) / 10))
+    {
+      number.mantissa = (number.mantissa * 10) + digit;
+      exponent -= is_fraction? 1 : 0;
+    }
+    else {
+      // Further digits only scale the mantissa
+      number.truncated = (number.truncated || (digit != 0));
+      exponent += is_fraction? 0 : 1;
+    }
+  }
+
+  if (digits == 0)
+  {
+    return false;
+  }
+
+  if ((p != end) && ((*p == 'e') || (*p == 'E')))
+  {
+    ++p;
+
+    bool negative_exponent = false;
+    if ((p != end) && ((*p == '-') || (*p == '+')))
+    {
+      negative_exponent = (*p == '-');
+      ++p;
+    }
+
+    if (p == end)
+    {
+      return false;
+    }
+
+    int32_t e = 0;
+    for (; (p != end) && (*p >= '0') && (*p <= '9'); ++p)
+    {
+      // Saturate, far past any representable value
+      e = (e < 100000)? ((e * 10) + (*p - '0')) : e;
+    }
+    exponent += negative_exponent? -e : e;
+  }
+
+  number.exponent = exponent;
+  return (p == end);
+}
+
+// Whole numbers only, written in any form (e.g. 3.0 or 1e3)
+template<typename T>
+inline bool
+flatbuffers_streaming_json_number_to_integer(
+  const FlatbuffersStreamingJsonNumber& number,
+  T& out)
+{
+  if (number.truncated)
+  {
+    return false;
+  }
+
+  uint64_t m = number.mantissa;
+  int32_t e = number.exponent;
+  for (; (e < 0) && (m != 0) && ((m % 10) == 0); ++e)
+  {
+    m /= 10;
+  }
+  if ((e < 0) && (m != 0))
+  {
+    return false;
+  }
+
+  for (; (e > 0) && (m != 0); --e)
+  {
+    if (m > (std::numeric_limits<uint64_t>::max() / 10))
+    {
+      return false;
+    }
+    m *= 10;
+  }
+
+  if (number.negative)
+  {
+    // The magnitude of the most negative value is one past its maximum
+    auto limit = static_cast<uint64_t>(std::numeric_limits<T>::max());
+    if (!std::numeric_limits<T>::is_signed)
+    {
+      limit = 0;
+    }
+    else {
+      limit += 1;
+    }
+
+    if (m > limit)
+    {
+      return false;
+    }
+    out = (m == 0)? 0 : static_cast<T>(-static_cast<T>(m - 1) - 1);
+    return true;
+  }
+
+  if (m > static_cast<uint64_t>(std::numeric_limits<T>::max()))
+  {
+    return false;
+  }
+  out = static_cast<T>(m);
+  return true;
+}
+
+// Exact powers of ten, for the fast paths below
+template<typename T>
+struct FlatbuffersStreamingJsonExactPowers;
+
+template<>
+struct FlatbuffersStreamingJsonExactPowers<double>
+{
+  // Every integer up to 2^53, and 10^22, are exact doubles
+  static constexpr uint64_t max_mantissa = (uint64_t(1) << 53);
+  static constexpr int32_t max_exponent = 22;
+
+  static double get(int32_t e)
+  {
+    static const double powers[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    return powers[e];
+  }
+
+  static double convert(const char* s, char** end)
+  {
+    return strtod(s, end);
+  }
+};
+
+template<>
+struct FlatbuffersStreamingJsonExactPowers<float>
+{
+  // Every integer up to 2^24, and 10^10, are exact floats
+  static constexpr uint64_t max_mantissa = (uint64_t(1) << 24);
+  static constexpr int32_t max_exponent = 10;
+
+  static float get(int32_t e)
+  {
+    static const float powers[] = {
+      1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+    };
+    return powers[e];
+  }
+
+  static float convert(const char* s, char** end)
+  {
+    return strtof(s, end);
+  }
+};
+
+// Correctly rounded, straight to the field's type. With an exact mantissa
+// and power of ten, a single multiply or divide rounds correctly (Clinger's
+// fast path), which covers typical sensor values without strtod().
+// Other values fall back to strtod() or strtof()
+template<typename T>
+inline bool
+flatbuffers_streaming_json_number_to_real(
+  const FlatbuffersStreamingJsonNumber& number,
+  T& out)
+{
+  typedef FlatbuffersStreamingJsonExactPowers<T> Powers;
+
+  if (!number.truncated && (number.mantissa <= Powers::max_mantissa))
+  {
+    auto e = number.exponent;
+    if ((number.mantissa == 0) || ((e >= 0) && (e <= Powers::max_exponent)))
+    {
+      out = static_cast<T>(number.mantissa) * Powers::get((number.mantissa == 0)? 0 : e);
+      out = number.negative? -out : out;
+      return true;
+    }
+    else if ((e < 0) && (e >= -Powers::max_exponent))
+    {
+      out = static_cast<T>(number.mantissa) / Powers::get(-e);
+      out = number.negative? -out : out;
+      return true;
+    }
+  }
+
+  // strtod() needs a terminated copy
+  char buf[64];
+  std::string long_buf;
+  const char* s = buf;
+  if (number.text.size() < sizeof(buf))
+  {
+    memcpy(buf, number.text.data(), number.text.size());
+    buf[number.text.size()] = '\0';
+  }
+  else {
+    long_buf.assign(number.text.data(), number.text.size());
+    s = long_buf.c_str();
+  }
+
+  char* end = nullptr;
+  out = Powers::convert(s, &end);
+  return (end == s + number.text.size());
+}
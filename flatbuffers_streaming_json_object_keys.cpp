@@ -0,0 +1,98 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_object_keys.h"
+
+#include "esp_log.h"
+
+#include <algorithm>
+
+constexpr char FlatbuffersStreamingJsonObjectKeys::TAG[];
+
+FlatbuffersStreamingJsonObjectKeys::FlatbuffersStreamingJsonObjectKeys()
+{
+}
+
+void
+FlatbuffersStreamingJsonObjectKeys::clear()
+{
+  keys.clear();
+  key_ends.clear();
+  first_keys.clear();
+}
+
+void
+FlatbuffersStreamingJsonObjectKeys::start_object()
+{
+  first_keys.push_back(key_ends.size());
+}
+
+bool
+FlatbuffersStreamingJsonObjectKeys::add_key(stx::string_view key)
+{
+  if (first_keys.empty())
+  {
+    ESP_LOGE(TAG, "Key '%.*s' found outside of an object", (int)key.size(), key.data());
+    return false;
+  }
+
+  if (std::find(key.begin(), key.end(), '\0') != key.end())
+  {
+    ESP_LOGE(TAG, "Key '%.*s' contains a null character", (int)key.size(), key.data());
+    return false;
+  }
+
+  keys.append(key.data(), key.size());
+  key_ends.push_back(keys.size());
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonObjectKeys::end_object()
+{
+  if (first_keys.empty())
+  {
+    ESP_LOGE(TAG, "Unbalanced JSON object");
+    return false;
+  }
+
+  size_t first_key = first_keys.back();
+  size_t object_start = (first_key > 0)? key_ends[first_key - 1] : 0;
+
+  sorted_keys.clear();
+  size_t key_start = object_start;
+  for (size_t k = first_key; k < key_ends.size(); ++k)
+  {
+    sorted_keys.emplace_back(keys.data() + key_start, key_ends[k] - key_start);
+    key_start = key_ends[k];
+  }
+
+  std::sort(sorted_keys.begin(), sorted_keys.end(),
+    [](const stx::string_view& a, const stx::string_view& b)
+    {
+      return (a.compare(b) < 0);
+    });
+
+  bool unique = true;
+  for (size_t k = 1; unique && (k < sorted_keys.size()); ++k)
+  {
+    if (sorted_keys[k].compare(sorted_keys[k - 1]) == 0)
+    {
+      ESP_LOGE(TAG, "Key '%.*s' set more than once in an object",
+        (int)sorted_keys[k].size(), sorted_keys[k].data());
+      unique = false;
+    }
+  }
+
+  // The enclosing object's keys are next, even after a failure
+  keys.resize(object_start);
+  key_ends.resize(first_key);
+  first_keys.pop_back();
+  return unique;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "stx/string_view.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// The keys of each open JSON object, for values whose objects must have
+// unique keys without embedded NULs: a flexbuffer map, whose EndMap asserts
+// its keys are unique, and compares them as null terminated strings.
+// Keys are kept back to back, and checked as each object ends
+class FlatbuffersStreamingJsonObjectKeys
+{
+public:
+  FlatbuffersStreamingJsonObjectKeys();
+
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonObjectKeys";
+
+  // Drop all open objects, keeping allocated memory for the next value
+  void clear();
+
+  void start_object();
+
+  // False for a key with an embedded NUL, or outside of any object
+  bool add_key(stx::string_view key);
+
+  // False if the innermost object had any key more than once
+  bool end_object();
+
+private:
+  FlatbuffersStreamingJsonObjectKeys(const FlatbuffersStreamingJsonObjectKeys&);
+  FlatbuffersStreamingJsonObjectKeys& operator=(const FlatbuffersStreamingJsonObjectKeys&);
+
+  // Keys of the open objects back to back, with the end of each
+  std::string keys;
+  std::vector<size_t> key_ends;
+
+  // Index into key_ends of each open object's first key
+  std::vector<size_t> first_keys;
+
+  // The innermost object's keys, sorted to find any duplicate
+  std::vector<stx::string_view> sorted_keys;
+};
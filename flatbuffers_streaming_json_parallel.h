@@ -0,0 +1,415 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers_streaming_json_compiled_schema.h"
+#include "flatbuffers_streaming_json_parser.h"
+#include "flatbuffers_streaming_json_tokenizer.h"
+#include "flatbuffers_streaming_json_visitor.h"
+
+#include "stx/string_view.hpp"
+
+#include "esp_log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class FlatbuffersStreamingJsonParallelOrder
+{
+  // Callbacks are called one at a time, in document order
+  InOrder,
+
+  // Callbacks are called as soon as each range is parsed, concurrently
+  Unordered,
+};
+
+// Parses a large array held in memory on several threads (for hosts).
+// A pre-scan skips over the array's elements to find their boundaries,
+// then contiguous ranges of elements are parsed by a pool of workers,
+// each with its own parser and visitor sharing the compiled schema.
+// Each range is delivered as the item a segmented subscription would give:
+// {"key": [elements of the range]}, with the callback on a worker thread.
+// Only the array's elements are delivered, and checked by the workers.
+// The pre-scan tokenizes the objects along the path, but skips every
+// other value, matching only its quotes and brackets: malformed JSON
+// outside the array may go unnoticed
+template<typename MessageT, typename ErrorT>
+class FlatbuffersStreamingJsonParallelParser
+{
+private:
+  FlatbuffersStreamingJsonParallelParser(const FlatbuffersStreamingJsonParallelParser &);
+  FlatbuffersStreamingJsonParallelParser &operator=(const FlatbuffersStreamingJsonParallelParser &);
+
+  // do include space for null terminating byte
+  const char TAG[40] = "FlatbuffersStreamingJsonParallelParser";
+
+  typedef FlatbuffersStreamingJsonVisitor<MessageT, ErrorT> VisitorT;
+
+  // Finds the array at a path of object keys, and where each element ends,
+  // without decoding the elements themselves
+  class Locator
+  {
+  public:
+    Locator(const std::vector<std::string>& _path)
+    : path(_path)
+    , tokenizer(*this)
+    {
+    }
+
+    bool scan(const char* data, size_t len)
+    {
+      return (tokenizer.feed(data, len) && tokenizer.finish());
+    }
+
+    bool is_found() const
+    {
+      return found;
+    }
+
+    const std::string& get_error() const
+    {
+      return tokenizer.get_error();
+    }
+
+    // After the '[', each ',' between elements, then the ']'
+    std::vector<size_t> delimiters;
+
+    bool set_null() { return value(); }
+    bool set_bool(bool) { return value(); }
+    bool set_raw_number(const FlatbuffersStreamingJsonNumber&) { return value(); }
+    bool set_string(stx::string_view) { return value(); }
+
+    bool parse_array_start()
+    {
+      if (at_target)
+      {
+        at_target = false;
+        in_target = true;
+        delimiters.push_back(tokenizer.get_position());
+      }
+      return true;
+    }
+
+    bool begin_array_item()
+    {
+      if (in_target && (elements++ > 0))
+      {
+        delimiters.push_back(tokenizer.get_position());
+      }
+
+      // The path only leads through objects
+      tokenizer.skip_value();
+      return true;
+    }
+
+    bool parse_array_stop(size_t)
+    {
+      if (in_target)
+      {
+        in_target = false;
+        found = true;
+        delimiters.push_back(tokenizer.get_position());
+      }
+      return true;
+    }
+
+    bool parse_object_start()
+    {
+      return value();
+    }
+
+    bool begin_object_item(stx::string_view key)
+    {
+      keys.push_back(key.to_string());
+
+      bool on_path = (
+        !found &&
+        (keys.size() <= path.size()) &&
+        std::equal(keys.begin(), keys.end(), path.begin())
+      );
+
+      if (!on_path)
+      {
+        tokenizer.skip_value();
+      }
+      else if (keys.size() == path.size())
+      {
+        at_target = true;
+      }
+      return true;
+    }
+
+    bool end_object_item()
+    {
+      keys.pop_back();
+      return true;
+    }
+
+    bool parse_object_stop()
+    {
+      return true;
+    }
+
+  private:
+    // Any value other than an array, where the array was expected
+    bool value()
+    {
+      at_target = false;
+      return true;
+    }
+
+    const std::vector<std::string>& path;
+    std::vector<std::string> keys;
+
+    bool at_target = false;
+    bool in_target = false;
+    bool found = false;
+    size_t elements = 0;
+
+    FlatbuffersStreamingJsonTokenizer<Locator> tokenizer;
+  };
+
+  // A per-thread parse context
+  struct Worker
+  {
+    Worker(
+      const FlatbuffersStreamingJsonCompiledSchema& compiled_schema,
+      FlatbuffersStreamingJsonBuildMode build_mode)
+    : parser(compiled_schema)
+    , visitor(parser, build_mode)
+    {
+    }
+
+    FlatbuffersStreamingJsonParser parser;
+    VisitorT visitor;
+  };
+
+  // Bytes of the elements in a range, without their enclosing brackets
+  struct Range
+  {
+    size_t begin;
+    size_t end;
+  };
+
+public:
+  // A thread count of 0 uses one per hardware thread
+  FlatbuffersStreamingJsonParallelParser(
+    const FlatbuffersStreamingJsonCompiledSchema& _compiled_schema,
+    size_t _threads=0,
+    FlatbuffersStreamingJsonBuildMode _build_mode=FlatbuffersStreamingJsonBuildMode::DirectBuilder
+  )
+  : compiled_schema(_compiled_schema)
+  , threads(_threads)
+  , build_mode(_build_mode)
+  {
+    if (threads == 0)
+    {
+      threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+  }
+
+  // Elements are grouped into ranges of at least this many bytes
+  void set_range_size(size_t _range_size)
+  {
+    range_size = std::max<size_t>(_range_size, 1);
+  }
+
+  // Parse the array at array_path (a path of object keys, without wildcards)
+  // of a whole document. Returns false if the document or any range was
+  // invalid, or any callback returned false
+  bool parse(
+    const char* data,
+    size_t len,
+    const std::vector<std::string>& array_path,
+    std::function<bool(const MessageT&)> callback,
+    FlatbuffersStreamingJsonParallelOrder order=FlatbuffersStreamingJsonParallelOrder::InOrder)
+  {
+    if (array_path.empty())
+    {
+      ESP_LOGE(TAG, "Parallel parsing needs the path of an array");
+      return false;
+    }
+
+    Locator locator(array_path);
+    if (!locator.scan(data, len))
+    {
+      ESP_LOGE(TAG, "Unable to parse JSON response, err = %s", locator.get_error().c_str());
+      return false;
+    }
+
+    if (!locator.is_found())
+    {
+      ESP_LOGE(TAG, "No array found at the path to parse in parallel");
+      return false;
+    }
+
+    split_ranges(locator.delimiters);
+
+    // The range is parsed as the one item of {"key": [range]}
+    prefix = "{";
+    append_json_string(prefix, array_path.back());
+    prefix += ":[";
+
+    while (workers.size() < std::min(threads, ranges.size()))
+    {
+      workers.emplace_back(new Worker(compiled_schema, build_mode));
+    }
+
+    next_range = 0;
+    next_delivery = 0;
+    failures = 0;
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers.size(); ++i)
+    {
+      pool.emplace_back(
+        &FlatbuffersStreamingJsonParallelParser::work, this,
+        std::ref(*workers[i]), data, array_path.back(), std::ref(callback), order);
+    }
+
+    // This thread is a worker too
+    work(*workers[0], data, array_path.back(), callback, order);
+
+    for (auto& thread : pool)
+    {
+      thread.join();
+    }
+
+    return (failures == 0);
+  }
+
+private:
+  void split_ranges(const std::vector<size_t>& delimiters)
+  {
+    ranges.clear();
+
+    // An empty array is one empty range, as the whole item would be
+    size_t begin = delimiters.front() + 1;
+    for (size_t i = 1; i < delimiters.size(); ++i)
+    {
+      auto end = delimiters[i];
+      if (((end - begin) >= range_size) || ((i + 1) == delimiters.size()))
+      {
+        ranges.push_back({begin, end});
+        begin = end + 1;
+      }
+    }
+  }
+
+  static void append_json_string(std::string& out, const std::string& s)
+  {
+    out += '"';
+    for (auto ch : s)
+    {
+      if ((ch == '"') || (ch == '\\'))
+      {
+        out += '\\';
+        out += ch;
+      }
+      else if ((ch >= 0) && (ch < 0x20))
+      {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(ch));
+        out += buf;
+      }
+      else {
+        out += ch;
+      }
+    }
+    out += '"';
+  }
+
+  // Claim ranges in order until none are left, so faster workers take more
+  void work(
+    Worker& worker,
+    const char* data,
+    const std::string& key,
+    const std::function<bool(const MessageT&)>& callback,
+    FlatbuffersStreamingJsonParallelOrder order)
+  {
+    bool in_order = (order == FlatbuffersStreamingJsonParallelOrder::InOrder);
+    size_t range = 0;
+
+    worker.visitor.clear_subscriptions();
+    worker.visitor.template subscribe<MessageT>(
+      {key},
+      std::function<bool(const MessageT&)>(
+        [&](const MessageT& obj)
+        {
+          if (in_order)
+          {
+            wait_for_delivery(range);
+          }
+          return (!callback || callback(obj));
+        }));
+
+    while ((range = next_range++) < ranges.size())
+    {
+      const auto& r = ranges[range];
+
+      auto& visitor = worker.visitor;
+      visitor.begin_stream();
+      bool ok = (
+        visitor.feed(prefix.data(), prefix.size()) &&
+        visitor.feed(data + r.begin, r.end - r.begin) &&
+        visitor.feed("]}", 2)
+      );
+      ok = visitor.finish() && ok;
+
+      if (!ok)
+      {
+        failures++;
+      }
+
+      if (in_order)
+      {
+        // Also when the range failed, and delivered nothing
+        wait_for_delivery(range);
+
+        std::lock_guard<std::mutex> lock(delivery_mutex);
+        next_delivery = range + 1;
+        delivery_cond.notify_all();
+      }
+    }
+  }
+
+  // Every earlier range is claimed already, so this always ends
+  void wait_for_delivery(size_t range)
+  {
+    std::unique_lock<std::mutex> lock(delivery_mutex);
+    delivery_cond.wait(lock, [&]() { return (next_delivery == range); });
+  }
+
+  const FlatbuffersStreamingJsonCompiledSchema& compiled_schema;
+  size_t threads;
+  FlatbuffersStreamingJsonBuildMode build_mode;
+  size_t range_size = 256 * 1024;
+
+  // Kept between parses, with their capacities
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  // State of the current parse
+  std::vector<Range> ranges;
+  std::string prefix;
+  std::atomic<size_t> next_range;
+  std::atomic<size_t> failures;
+
+  std::mutex delivery_mutex;
+  std::condition_variable delivery_cond;
+  size_t next_delivery = 0;
+};
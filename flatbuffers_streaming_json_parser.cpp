@@ -15,41 +15,62 @@ FlatbuffersStreamingJsonParser::FlatbuffersStreamingJsonParser(
   stx::string_view text_schema,
   stx::string_view binary_schema
 )
+: owned_schema(new FlatbuffersStreamingJsonCompiledSchema(text_schema, binary_schema))
+, compiled_schema(*owned_schema)
 {
-  // Allow trailing commas, and optional quotes around identifiers/values
-  flatbuffers_parser.opts.strict_json = false;
+  // Parse the text schema up front, as is_ready() reports it
+  load_text_schema();
+}
 
-  // Support additional (ignored) fields present in JSON but not in the schema
-  flatbuffers_parser.opts.skip_unexpected_fields_in_json = true;
+FlatbuffersStreamingJsonParser::FlatbuffersStreamingJsonParser(
+  stx::string_view binary_schema
+)
+: owned_schema(new FlatbuffersStreamingJsonCompiledSchema(binary_schema))
+, compiled_schema(*owned_schema)
+{
+}
 
-  did_parse_text_schema = parse_flatbuffers_text_schema(text_schema);
-  if (did_parse_text_schema)
-  {
-    // Success
-    ESP_LOGI(TAG, "Successfully parsed text flatbuffer schema buffer");
-  }
+FlatbuffersStreamingJsonParser::FlatbuffersStreamingJsonParser(
+  const FlatbuffersStreamingJsonCompiledSchema& _compiled_schema
+)
+: compiled_schema(_compiled_schema)
+{
+}
 
-  did_parse_binary_schema = parse_flatbuffers_binary_schema(binary_schema);
-  if (did_parse_binary_schema)
-  {
-    // Success
-    ESP_LOGI(TAG, "Successfully parsed binary flatbuffer schema buffer");
+bool
+FlatbuffersStreamingJsonParser::is_ready() const
+{
+  return (compiled_schema.is_ready() && !did_fail_text_schema);
+}
 
-    // Print the namespaced-name of the (default) root object
-    ESP_LOGI(TAG, "Default root table: %s", schema->root_table()->name()->c_str());
-  }
+bool
+FlatbuffersStreamingJsonParser::has_text_schema() const
+{
+  return (compiled_schema.has_text_schema() && !did_fail_text_schema);
 }
 
 bool
-FlatbuffersStreamingJsonParser::is_ready() const
+FlatbuffersStreamingJsonParser::has_binary_schema() const
 {
-  return (did_parse_text_schema & did_parse_binary_schema);
+  return compiled_schema.has_binary_schema();
 }
 
-const flatbuffers::Parser&
-FlatbuffersStreamingJsonParser::get_flatbuffers_parser() const
+const FlatbuffersStreamingJsonCompiledSchema&
+FlatbuffersStreamingJsonParser::get_compiled_schema() const
 {
-  return flatbuffers_parser;
+  return compiled_schema;
+}
+
+const flatbuffers::Parser*
+FlatbuffersStreamingJsonParser::find_flatbuffers_parser() const
+{
+  return flatbuffers_parser.get();
+}
+
+const reflection::Schema*
+FlatbuffersStreamingJsonParser::get_flatbuffers_schema() const
+{
+  return compiled_schema.get_flatbuffers_schema();
 }
 
 const reflection::Object*
@@ -57,84 +78,181 @@ FlatbuffersStreamingJsonParser::get_flatbuffers_table(
   flatbuffers::uoffset_t index
 ) const
 {
-  return schema? schema->objects()->Get(index) : (reflection::Object*)nullptr;
+  return compiled_schema.get_flatbuffers_table(index);
+}
+
+const reflection::Object*
+FlatbuffersStreamingJsonParser::get_flatbuffers_table(
+  const char* name
+) const
+{
+  return compiled_schema.get_flatbuffers_table(name);
 }
 
 const reflection::Object*
 FlatbuffersStreamingJsonParser::get_flatbuffers_root_table() const
 {
-  return schema? schema->root_table() : nullptr;
+  return compiled_schema.get_flatbuffers_root_table();
 }
 
-bool
-FlatbuffersStreamingJsonParser::parse_flatbuffers_text_schema(
-  stx::string_view buf
+const FlatbuffersStreamingJsonSchemaIndex&
+FlatbuffersStreamingJsonParser::get_schema_index() const
+{
+  return compiled_schema.get_schema_index();
+}
+
+const FlatbuffersStreamingJsonStats&
+FlatbuffersStreamingJsonParser::get_stats() const
+{
+  return stats;
+}
+
+void
+FlatbuffersStreamingJsonParser::reset_stats()
+{
+  stats.clear();
+}
+
+void
+FlatbuffersStreamingJsonParser::set_verify_policy(
+  FlatbuffersStreamingJsonVerifyPolicy policy,
+  uint32_t sample_interval
 )
 {
-  // Load flatbuffers text schema file from buffer
-  // Check for a non-zero buffer length
-  if (!buf.empty())
+  verify_policy = policy;
+  verify_sample_interval = (sample_interval > 0)? sample_interval : 1;
+  verify_sample_count = 0;
+}
+
+FlatbuffersStreamingJsonVerifyPolicy
+FlatbuffersStreamingJsonParser::get_verify_policy() const
+{
+  return verify_policy;
+}
+
+bool
+FlatbuffersStreamingJsonParser::should_verify_built()
+{
+  bool ok = true;
+  switch (verify_policy)
+  {
+    case FlatbuffersStreamingJsonVerifyPolicy::Never:
+      ok = false;
+      break;
+
+    case FlatbuffersStreamingJsonVerifyPolicy::Sampled:
+      // The first buffer is always verified
+      ok = (verify_sample_count == 0);
+      verify_sample_count = ((verify_sample_count + 1) % verify_sample_interval);
+      break;
+
+    case FlatbuffersStreamingJsonVerifyPolicy::DebugOnly:
+#ifdef NDEBUG
+      ok = false;
+#endif
+      break;
+
+    default:
+      break;
+  }
+
+  if (!ok)
+  {
+    FLATBUFFERS_STREAMING_JSON_STATS_ADD(stats, verifications_skipped, 1);
+  }
+
+  return ok;
+}
+
+const uint8_t*
+FlatbuffersStreamingJsonParser::get_parsed_buffer_pointer() const
+{
+  return flatbuffers_parser? flatbuffers_parser->builder_.GetBufferPointer() : nullptr;
+}
+
+size_t
+FlatbuffersStreamingJsonParser::get_parsed_size() const
+{
+  return flatbuffers_parser? flatbuffers_parser->builder_.GetSize() : 0;
+}
+
+const flatbuffers::StructDef*
+FlatbuffersStreamingJsonParser::prepare(const char* type_name)
+{
+  if ((type_name == nullptr) || !load_text_schema())
+  {
+    return nullptr;
+  }
+
+  for (const auto& prepared_type : prepared_types)
   {
-    // Check for a nullptr terminated buffer
-    char eof = buf[buf.size() - 1];
-    if (eof == 0x00)
+    if (prepared_type.first == type_name)
     {
-      bool ok = flatbuffers_parser.Parse(buf.data(), nullptr);
-      if (ok)
-      {
-        return true;
-      }
-      else {
-        ESP_LOGE(TAG, "Invalid text flatbuffer schema buffer");
-      }
-    }
-    else {
-      ESP_LOGE(TAG, "nullptr byte missing from text flatbuffer schema buffer");
+      return prepared_type.second;
     }
   }
-  else {
-    ESP_LOGE(TAG, "0 length text flatbuffer schema buffer found");
+
+  // Look up the name in the symbol table once, unknown types are cached too
+  flatbuffers::StructDef* struct_def = nullptr;
+  if (flatbuffers_parser->SetRootType(type_name))
+  {
+    struct_def = flatbuffers_parser->root_struct_def_;
   }
 
-  return false;
+  prepared_types.push_back(std::make_pair(type_name, struct_def));
+  return struct_def;
 }
 
 bool
-FlatbuffersStreamingJsonParser::parse_flatbuffers_binary_schema(
-  stx::string_view buf
+FlatbuffersStreamingJsonParser::set_root_type(
+  const flatbuffers::StructDef* struct_def
 )
 {
-  // Load flatbuffers text schema file from buffer
-  // Check for a non-zero buffer length
-  if (!buf.empty())
+  if (struct_def == nullptr)
   {
-    // Check for a nullptr terminated buffer
-    char eof = buf[buf.size() - 1];
-    if (eof == 0x00)
-    {
-      // Verify the buffer as valid flatbuffer
-      flatbuffers::Verifier verifier(
-        reinterpret_cast<const uint8_t *>(buf.data()), buf.size());
-      if (reflection::VerifySchemaBuffer(verifier))
-      {
-        // Parse a buffer containing the binary schema
-        schema = reflection::GetSchema(buf.data());
-        if (schema != nullptr)
-        {
-          return true;
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Invalid binary flatbuffer schema buffer");
-      }
-    }
-    else {
-      ESP_LOGE(TAG, "nullptr byte missing from text flatbuffer schema buffer");
-    }
+    return false;
+  }
+
+  // Same effect as SetRootType(), without the symbol table lookup.
+  // Parse() does not modify the root StructDef, it is only non-const in Parser
+  flatbuffers_parser->root_struct_def_ = const_cast<flatbuffers::StructDef*>(struct_def);
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonParser::load_text_schema()
+{
+  if (flatbuffers_parser)
+  {
+    return did_parse_text_schema;
+  }
+
+  if (did_fail_text_schema || !compiled_schema.has_text_schema())
+  {
+    return false;
+  }
+
+  // Only this parser's own symbol table is built, the schema text is shared
+  flatbuffers_parser.reset(new flatbuffers::Parser());
+
+  // Allow trailing commas, and optional quotes around identifiers/values
+  flatbuffers_parser->opts.strict_json = false;
+
+  // Support additional (ignored) fields present in JSON but not in the schema
+  flatbuffers_parser->opts.skip_unexpected_fields_in_json = true;
+
+  // Load flatbuffers text schema file from buffer, already null terminated
+  did_parse_text_schema = flatbuffers_parser->Parse(
+    compiled_schema.get_text_schema().data(), nullptr);
+  if (did_parse_text_schema)
+  {
+    // Success
+    ESP_LOGI(TAG, "Successfully parsed text flatbuffer schema buffer");
   }
   else {
-    ESP_LOGE(TAG, "0 length binary flatbuffer schema buffer found");
+    ESP_LOGE(TAG, "Invalid text flatbuffer schema buffer");
+    did_fail_text_schema = true;
   }
 
-  return false;
+  return did_parse_text_schema;
 }
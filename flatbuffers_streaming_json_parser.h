@@ -9,6 +9,10 @@
  */
 #pragma once
 
+#include "flatbuffers_streaming_json_compiled_schema.h"
+#include "flatbuffers_streaming_json_schema_index.h"
+#include "flatbuffers_streaming_json_stats.h"
+
 #include "flatbuffers/idl.h"
 #include "flatbuffers/reflection.h"
 
@@ -16,77 +20,158 @@
 
 #include "esp_log.h"
 
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
+
+// How buffers this library builds itself from the schema are verified,
+// before they are delivered. Buffers from anywhere else (given to verify()
+// or unpack()), and binary schemas, are always verified
+enum class FlatbuffersStreamingJsonVerifyPolicy
+{
+  Always,
+
+  // Trust the builder's output
+  Never,
+
+  // Only every sample_interval'th buffer
+  Sampled,
+
+  // Always, unless built with NDEBUG
+  DebugOnly,
+};
 
+// The mutable state of parsing, for one task at a time.
+// Parsers sharing one FlatbuffersStreamingJsonCompiledSchema may each be
+// used concurrently
 class FlatbuffersStreamingJsonParser
 {
 public:
+  // Owns its schemas, the text schema is parsed here
   FlatbuffersStreamingJsonParser(
     stx::string_view text_schema,
     stx::string_view binary_schema
   );
 
+  // Binary schema only, used in place (e.g. straight from flash), so it must
+  // outlive the parser. Nothing is parsed at startup besides the field index.
+  // Enough for the direct builder and generated decoders, but not for
+  // re-serialized JSON items, which need the text schema
+  explicit FlatbuffersStreamingJsonParser(
+    stx::string_view binary_schema
+  );
+
+  // Shares schemas with other parsers, which must outlive this one.
+  // A text schema is only parsed once this parser needs it,
+  // for re-serialized JSON items, or by load_text_schema()
+  explicit FlatbuffersStreamingJsonParser(
+    const FlatbuffersStreamingJsonCompiledSchema& _compiled_schema
+  );
+
   // do include space for null terminating byte
   static constexpr char TAG[] = "FlatbuffersStreamingJsonParser";
 
+  // Every schema given to the constructor was loaded
   bool is_ready() const;
 
-  const flatbuffers::Parser& get_flatbuffers_parser() const;
+  bool has_text_schema() const;
+  bool has_binary_schema() const;
+
+  const FlatbuffersStreamingJsonCompiledSchema& get_compiled_schema() const;
+
+  // Parse the shared text schema into this parser's own symbol table now,
+  // rather than for the first re-serialized item. False without one
+  bool load_text_schema();
 
+  // The text schema's parser, nullptr until it is parsed (by the
+  // constructor, or load_text_schema()), or without a text schema
+  const flatbuffers::Parser* find_flatbuffers_parser() const;
+
+  const reflection::Schema* get_flatbuffers_schema() const;
   const reflection::Object* get_flatbuffers_table(flatbuffers::uoffset_t index) const;
+  const reflection::Object* get_flatbuffers_table(const char* name) const;
   const reflection::Object* get_flatbuffers_root_table() const;
 
-  template<typename ObjT>
-  bool
+  // Field lookups for the binary schema, built once it is parsed
+  const FlatbuffersStreamingJsonSchemaIndex& get_schema_index() const;
+
+  // Parse, verify and unpack phases, for every caller of this parser
+  const FlatbuffersStreamingJsonStats& get_stats() const;
+  void reset_stats();
+
+  // For buffers built by parse() or the direct builder
+  void set_verify_policy(
+    FlatbuffersStreamingJsonVerifyPolicy policy,
+    uint32_t sample_interval = 64);
+  FlatbuffersStreamingJsonVerifyPolicy get_verify_policy() const;
+
+  // The buffer holding the table returned by the last parse(),
+  // until the next call to parse()
+  const uint8_t* get_parsed_buffer_pointer() const;
+  size_t get_parsed_size() const;
+
+  // Resolve a root type once, for repeated parse() calls of that type.
+  // The handle is owned by the parser, and nullptr if the type is unknown
+  const flatbuffers::StructDef* prepare(const char* type_name);
+
+  template<typename TableT>
+  const flatbuffers::StructDef*
+  prepare()
+  {
+    return prepare(TableT::GetFullyQualifiedName());
+  }
+
+  // Returns the verified root table, stored in the internal builder.
+  // It is only valid until the next call to parse()
+  template<typename TableT>
+  const TableT*
   parse(
-    const std::string& json,
-    ObjT& obj
+    const std::string& json
   )
   {
-    bool ok = is_ready();
+    return parse<TableT>(prepare<TableT>(), json);
+  }
+
+  // As above, with the root type already resolved by prepare()
+  template<typename TableT>
+  const TableT*
+  parse(
+    const flatbuffers::StructDef* struct_def,
+    const std::string& json
+  )
+  {
+    bool ok = load_text_schema();
     // Attempt to parse the JSON stream into a flatbuffer of template type
     if (ok)
     {
-      auto root_type = ObjT::TableType::GetFullyQualifiedName();
+      auto root_type = TableT::GetFullyQualifiedName();
       // Determine whether to expect to parse an Error type or a Message type
-      ok = flatbuffers_parser.SetRootType(root_type);
+      ok = set_root_type(struct_def);
 
       // We are set up for the root type of flatbuffer now
       if (ok)
       {
+        // The builder is cleared by Parse(), keeping its allocated memory
         // Parse JSON output stream into flatbuffer
-        ok = flatbuffers_parser.Parse(json.c_str(), nullptr);
+        {
+          FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, parse);
+          ok = flatbuffers_parser->Parse(json.c_str(), nullptr);
+        }
 
         if (ok)
         {
-          // Here, flatbuffers_parser.builder_ contains a binary buffer
+          FLATBUFFERS_STREAMING_JSON_STATS_MAX(
+            stats, peak_builder_size, flatbuffers_parser->builder_.GetSize());
+
+          // Here, flatbuffers_parser->builder_ contains a binary buffer
           // that is the finished parsed data.
-          // Create a generatic verifier for it
-          flatbuffers::Verifier verifier(
-            flatbuffers_parser.builder_.GetBufferPointer(),
-            flatbuffers_parser.builder_.GetSize());
-
-          // Verify as valid message type
-          ok = verifier.VerifyBuffer<typename ObjT::TableType>(nullptr);
-          if (ok)
-          {
-            // Instantiate a C++ gen-object-api object for the message
-            const auto flatbuf = flatbuffers::GetRoot<typename ObjT::TableType>(
-              flatbuffers_parser.builder_.GetBufferPointer()
-            );
-
-            // Unpack the binary into the C++ object
-            flatbuf->UnPackTo(&obj);
-            return true;
-          }
-          else {
-            ESP_LOGE(TAG,
-              "Couldn't verify flatbuffer of type '%s'",
-              root_type
-            );
-          }
+          return verify_built<TableT>(
+            flatbuffers_parser->builder_.GetBufferPointer(),
+            flatbuffers_parser->builder_.GetSize());
         }
         else {
+          FLATBUFFERS_STREAMING_JSON_STATS_ADD(stats, parse_failures, 1);
           ESP_LOGE(TAG,
             "Couldn't parse JSON string '%s' into valid flatbuffer of type '%s'",
             json.c_str(),
@@ -102,19 +187,171 @@ public:
       }
     }
     else {
-      ESP_LOGE(TAG, "Parser not ready");
+      ESP_LOGE(TAG, "Parser has no text schema, for JSON of type '%s'",
+        TableT::GetFullyQualifiedName());
+    }
+
+    return nullptr;
+  }
+
+  template<typename ObjT>
+  bool
+  parse(
+    const std::string& json,
+    ObjT& obj
+  )
+  {
+    auto flatbuf = parse<typename ObjT::TableType>(json);
+    if (flatbuf != nullptr)
+    {
+      unpack(flatbuf, obj);
+      return true;
     }
 
     return false;
   }
 
+  // Returns the root table of a finished flatbuffer, if it is valid
+  template<typename TableT>
+  const TableT*
+  verify(
+    const uint8_t* buf,
+    size_t len
+  )
+  {
+    FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, verify);
+
+    // Create a generic verifier for the finished flatbuffer
+    flatbuffers::Verifier verifier(buf, len);
+
+    // Verify as valid message type
+    bool ok = verifier.VerifyBuffer<TableT>(nullptr);
+    if (ok)
+    {
+      // Instantiate a C++ gen-object-api object for the message
+      return flatbuffers::GetRoot<TableT>(buf);
+    }
+    else {
+      FLATBUFFERS_STREAMING_JSON_STATS_ADD(stats, verifier_failures, 1);
+      ESP_LOGE(TAG,
+        "Couldn't verify flatbuffer of type '%s'",
+        TableT::GetFullyQualifiedName()
+      );
+    }
+
+    return nullptr;
+  }
+
+  // As verify(), for a buffer finished with its size prefix
+  template<typename TableT>
+  const TableT*
+  verify_size_prefixed(
+    const uint8_t* buf,
+    size_t len
+  )
+  {
+    FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, verify);
+
+    flatbuffers::Verifier verifier(buf, len);
+
+    bool ok = verifier.VerifySizePrefixedBuffer<TableT>(nullptr);
+    if (ok)
+    {
+      return flatbuffers::GetSizePrefixedRoot<TableT>(buf);
+    }
+    else {
+      FLATBUFFERS_STREAMING_JSON_STATS_ADD(stats, verifier_failures, 1);
+      ESP_LOGE(TAG,
+        "Couldn't verify size-prefixed flatbuffer of type '%s'",
+        TableT::GetFullyQualifiedName()
+      );
+    }
+
+    return nullptr;
+  }
+
+  // As verify(), for a buffer built from the schema by this library,
+  // so only verified as set_verify_policy() asks
+  template<typename TableT>
+  const TableT*
+  verify_built(
+    const uint8_t* buf,
+    size_t len
+  )
+  {
+    if (should_verify_built())
+    {
+      return verify<TableT>(buf, len);
+    }
+
+    return (len >= sizeof(flatbuffers::uoffset_t))? flatbuffers::GetRoot<TableT>(buf) : nullptr;
+  }
+
+  template<typename TableT>
+  const TableT*
+  verify_built_size_prefixed(
+    const uint8_t* buf,
+    size_t len
+  )
+  {
+    if (should_verify_built())
+    {
+      return verify_size_prefixed<TableT>(buf, len);
+    }
+
+    return (len >= (2 * sizeof(flatbuffers::uoffset_t)))? flatbuffers::GetSizePrefixedRoot<TableT>(buf) : nullptr;
+  }
+
+  template<typename ObjT>
+  bool
+  unpack(
+    const uint8_t* buf,
+    size_t len,
+    ObjT& obj
+  )
+  {
+    auto flatbuf = verify<typename ObjT::TableType>(buf, len);
+    if (flatbuf != nullptr)
+    {
+      unpack(flatbuf, obj);
+      return true;
+    }
+
+    return false;
+  }
+
+  // Unpack a verified root table into the C++ object
+  template<typename TableT, typename ObjT>
+  void
+  unpack(
+    const TableT* flatbuf,
+    ObjT& obj
+  )
+  {
+    FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, unpack);
+    flatbuf->UnPackTo(&obj);
+  }
+
 private:
-  bool parse_flatbuffers_text_schema(stx::string_view buf);
-  bool parse_flatbuffers_binary_schema(stx::string_view buf);
+  bool set_root_type(const flatbuffers::StructDef* struct_def);
+
+  bool should_verify_built();
 
+  // Only allocated with a compiled schema of its own
+  std::unique_ptr<FlatbuffersStreamingJsonCompiledSchema> owned_schema;
+  const FlatbuffersStreamingJsonCompiledSchema& compiled_schema;
+
+  // Only allocated along with a text schema
+  std::unique_ptr<flatbuffers::Parser> flatbuffers_parser;
   bool did_parse_text_schema = false;
-  bool did_parse_binary_schema = false;
+  bool did_fail_text_schema = false;
+
+  // Root types resolved by prepare(), by type name
+  std::vector<std::pair<std::string, flatbuffers::StructDef*>> prepared_types;
+
+  FlatbuffersStreamingJsonVerifyPolicy verify_policy = FlatbuffersStreamingJsonVerifyPolicy::Always;
+  uint32_t verify_sample_interval = 64;
+  uint32_t verify_sample_count = 0;
 
-  const reflection::Schema* schema;
-  flatbuffers::Parser flatbuffers_parser;
+  FlatbuffersStreamingJsonStats stats;
 };
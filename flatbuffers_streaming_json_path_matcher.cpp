@@ -0,0 +1,143 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_path_matcher.h"
+
+#include <cstring>
+
+constexpr size_t FlatbuffersStreamingJsonPathMatcher::npos;
+
+void
+FlatbuffersStreamingJsonPathMatcher::clear()
+{
+  paths.clear();
+  depth = 0;
+}
+
+size_t
+FlatbuffersStreamingJsonPathMatcher::add_path(
+  const std::vector<std::string>& path)
+{
+  constexpr char wildcard_sym[] = "*";
+
+  Path compiled;
+  compiled.segments.reserve(path.size());
+  for (const auto& key : path)
+  {
+    compiled.segments.push_back({key, (key == wildcard_sym)});
+  }
+  compiled.matched = 0;
+
+  paths.push_back(compiled);
+  return (paths.size() - 1);
+}
+
+size_t
+FlatbuffersStreamingJsonPathMatcher::size() const
+{
+  return paths.size();
+}
+
+void
+FlatbuffersStreamingJsonPathMatcher::reset()
+{
+  for (auto& path : paths)
+  {
+    path.matched = 0;
+  }
+  depth = 0;
+}
+
+void
+FlatbuffersStreamingJsonPathMatcher::push_key(stx::string_view key)
+{
+  for (auto& path : paths)
+  {
+    // Only extend a path which is matched all the way to the current depth
+    if ((path.matched == depth) &&
+        (path.matched < path.segments.size()))
+    {
+      const auto& segment = path.segments[path.matched];
+      if (segment.wildcard || (
+            (segment.key.size() == key.size()) &&
+            (memcmp(segment.key.data(), key.data(), key.size()) == 0)))
+      {
+        path.matched++;
+      }
+    }
+  }
+
+  depth++;
+}
+
+void
+FlatbuffersStreamingJsonPathMatcher::pop_key()
+{
+  if (depth == 0)
+  {
+    return;
+  }
+
+  depth--;
+  for (auto& path : paths)
+  {
+    if (path.matched > depth)
+    {
+      path.matched = depth;
+    }
+  }
+}
+
+size_t
+FlatbuffersStreamingJsonPathMatcher::get_depth() const
+{
+  return depth;
+}
+
+bool
+FlatbuffersStreamingJsonPathMatcher::is_matched(size_t id) const
+{
+  if (id >= paths.size())
+  {
+    return false;
+  }
+
+  // All segments matched, and not since left (matched is clamped on pop)
+  return (paths[id].matched == paths[id].segments.size());
+}
+
+size_t
+FlatbuffersStreamingJsonPathMatcher::get_first_matched() const
+{
+  for (size_t id = 0; id < paths.size(); ++id)
+  {
+    if (is_matched(id))
+    {
+      return id;
+    }
+  }
+
+  return npos;
+}
+
+bool
+FlatbuffersStreamingJsonPathMatcher::is_reachable() const
+{
+  for (const auto& path : paths)
+  {
+    // A prefix of the path, or the whole path, is matched
+    if ((path.matched == depth) ||
+        (path.matched == path.segments.size()))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "stx/string_view.hpp"
+
+#include <string>
+#include <vector>
+
+// Matches the current key path against a set of paths, incrementally.
+// Each path tracks how many of its leading keys are matched so far,
+// so each key pushed costs at most one comparison per path.
+// A "*" key matches any key, an empty path matches everything.
+class FlatbuffersStreamingJsonPathMatcher
+{
+public:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  // Remove all paths
+  void clear();
+
+  // Returns the id of the compiled path
+  size_t add_path(const std::vector<std::string>& path);
+  size_t size() const;
+
+  // Return to the document root, keeping the compiled paths
+  void reset();
+
+  void push_key(stx::string_view key);
+  void pop_key();
+
+  size_t get_depth() const;
+
+  // The current key path is at, or nested under, path id
+  bool is_matched(size_t id) const;
+
+  // Id of the first path matched by the current key path, or npos
+  size_t get_first_matched() const;
+
+  // Some path is matched, or could still be matched by keys nested under
+  // the current key path. Otherwise the current subtree can be skipped
+  bool is_reachable() const;
+
+private:
+  struct Segment
+  {
+    std::string key;
+    bool wildcard;
+  };
+
+  struct Path
+  {
+    std::vector<Segment> segments;
+
+    // Count of leading segments matched by the current key path
+    size_t matched;
+  };
+
+  std::vector<Path> paths;
+
+  // Number of keys in the current key path
+  size_t depth = 0;
+};
@@ -0,0 +1,185 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_pipeline.h"
+
+#include "esp_log.h"
+
+constexpr char FlatbuffersStreamingJsonPipeline::TAG[];
+
+FlatbuffersStreamingJsonPipeline::FlatbuffersStreamingJsonPipeline(
+  const FlatbuffersStreamingJsonCompiledSchema& compiled_schema,
+  size_t ring_size,
+  int _core,
+  uint32_t _stack_size,
+  unsigned _priority
+)
+: parser(compiled_schema)
+, ring(ring_size)
+, core(_core)
+, stack_size(_stack_size)
+, priority(_priority)
+, failures(0)
+{
+}
+
+FlatbuffersStreamingJsonPipeline::~FlatbuffersStreamingJsonPipeline()
+{
+  stop();
+}
+
+bool
+FlatbuffersStreamingJsonPipeline::start()
+{
+  if (running)
+  {
+    return true;
+  }
+
+  ring.reopen();
+  failures = 0;
+
+#ifdef ESP_PLATFORM
+  auto ret = xTaskCreatePinnedToCore(
+    &consumer_task,
+    "fbs_json_pipeline",
+    stack_size,
+    this,
+    priority,
+    &task,
+    (core < 0)? tskNO_AFFINITY : core);
+  running = (ret == pdPASS);
+#else
+  thread = std::thread(&consumer_task, this);
+  running = true;
+#endif
+
+  if (!running)
+  {
+    ESP_LOGE(TAG, "Could not start pipeline task");
+  }
+  return running;
+}
+
+void
+FlatbuffersStreamingJsonPipeline::stop()
+{
+  if (!running)
+  {
+    return;
+  }
+
+  ring.close();
+
+#ifdef ESP_PLATFORM
+  stopped.take();
+  task = nullptr;
+#else
+  thread.join();
+#endif
+
+  running = false;
+}
+
+bool
+FlatbuffersStreamingJsonPipeline::is_running() const
+{
+  return running;
+}
+
+bool
+FlatbuffersStreamingJsonPipeline::submit(
+  FlatbuffersStreamingJsonSubscription* subscription,
+  ItemKind kind,
+  const uint8_t* data,
+  size_t len)
+{
+  if (!running)
+  {
+    ESP_LOGE(TAG, "Pipeline not started");
+    return false;
+  }
+
+  return ring.push(subscription, kind, data, len);
+}
+
+bool
+FlatbuffersStreamingJsonPipeline::can_submit(size_t len) const
+{
+  return ring.can_fit(len);
+}
+
+void
+FlatbuffersStreamingJsonPipeline::wait_idle()
+{
+  if (running)
+  {
+    ring.wait_empty();
+  }
+}
+
+bool
+FlatbuffersStreamingJsonPipeline::flush()
+{
+  wait_idle();
+  return (failures.exchange(0) == 0);
+}
+
+const FlatbuffersStreamingJsonParser&
+FlatbuffersStreamingJsonPipeline::get_parser() const
+{
+  return parser;
+}
+
+const FlatbuffersStreamingJsonRing&
+FlatbuffersStreamingJsonPipeline::get_ring() const
+{
+  return ring;
+}
+
+void
+FlatbuffersStreamingJsonPipeline::consumer_task(void* arg)
+{
+  auto pipeline = static_cast<FlatbuffersStreamingJsonPipeline*>(arg);
+  pipeline->consume();
+
+#ifdef ESP_PLATFORM
+  pipeline->stopped.give();
+  vTaskDelete(nullptr);
+#endif
+}
+
+void
+FlatbuffersStreamingJsonPipeline::consume()
+{
+  // Until the ring is closed and drained
+  while (auto record = ring.front())
+  {
+    auto subscription = static_cast<FlatbuffersStreamingJsonSubscription*>(
+      const_cast<void*>(record->context));
+
+    bool ok = false;
+    if (record->kind == BufferItem)
+    {
+      ok = subscription->dispatch_buffer(parser, record->data(), record->size);
+    }
+    else {
+      item_json.assign(reinterpret_cast<const char*>(record->data()), record->size);
+      ok = subscription->dispatch_json(parser, item_json);
+    }
+
+    if (!ok)
+    {
+      failures++;
+    }
+
+    // Only now may the producer reuse the space, or flush() return
+    ring.pop();
+  }
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers_streaming_json_compiled_schema.h"
+#include "flatbuffers_streaming_json_parser.h"
+#include "flatbuffers_streaming_json_ring.h"
+#include "flatbuffers_streaming_json_subscription.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#else
+#include <thread>
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Dispatches items on a task of its own (pinned to another core on ESP32),
+// while the visitor's task keeps lexing the stream.
+// The visitor copies each completed item into the ring, as re-serialized
+// JSON or a directly built flatbuffer, blocking while the ring is full.
+// The consumer then parses or verifies it, and runs its callback there
+class FlatbuffersStreamingJsonPipeline
+{
+public:
+  enum ItemKind
+  {
+    JsonItem,
+    BufferItem,
+  };
+
+  // The consumer's parser shares the compiled schema with the visitor's
+  FlatbuffersStreamingJsonPipeline(
+    const FlatbuffersStreamingJsonCompiledSchema& compiled_schema,
+    size_t ring_size,
+    int core=1,
+    uint32_t stack_size=16 * 1024,
+    unsigned priority=5
+  );
+
+  ~FlatbuffersStreamingJsonPipeline();
+
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonPipeline";
+
+  bool start();
+
+  // Dispatch everything already submitted, then end the consumer task
+  void stop();
+
+  bool is_running() const;
+
+  // The subscription must stay registered until the item is dispatched
+  bool submit(
+    FlatbuffersStreamingJsonSubscription* subscription,
+    ItemKind kind,
+    const uint8_t* data,
+    size_t len);
+
+  // Whether an item of this size fits in the ring at all
+  bool can_submit(size_t len) const;
+
+  // Wait until every submitted item is dispatched
+  void wait_idle();
+
+  // As wait_idle(), returns false if any item failed since the last flush()
+  bool flush();
+
+  // The consumer's parser, e.g. for its stats. Only read it after flush()
+  const FlatbuffersStreamingJsonParser& get_parser() const;
+
+  const FlatbuffersStreamingJsonRing& get_ring() const;
+
+private:
+  FlatbuffersStreamingJsonPipeline(const FlatbuffersStreamingJsonPipeline&);
+  FlatbuffersStreamingJsonPipeline& operator=(const FlatbuffersStreamingJsonPipeline&);
+
+  static void consumer_task(void* arg);
+  void consume();
+
+  FlatbuffersStreamingJsonParser parser;
+  FlatbuffersStreamingJsonRing ring;
+
+  int core;
+  uint32_t stack_size;
+  unsigned priority;
+  bool running = false;
+
+  // Consumer state, keeps its capacity between items
+  std::string item_json;
+  std::atomic<size_t> failures;
+
+#ifdef ESP_PLATFORM
+  TaskHandle_t task = nullptr;
+  FlatbuffersStreamingJsonSignal stopped;
+#else
+  std::thread thread;
+#endif
+};
@@ -0,0 +1,305 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_ring.h"
+
+#include "esp_log.h"
+
+#include <cstring>
+
+constexpr char FlatbuffersStreamingJsonRing::TAG[];
+constexpr size_t FlatbuffersStreamingJsonRing::alignment;
+constexpr size_t FlatbuffersStreamingJsonRing::header_size;
+
+// Marks the unused end of the region, the next record is at its start
+static constexpr uint32_t wrap_size = UINT32_MAX;
+
+#ifdef ESP_PLATFORM
+FlatbuffersStreamingJsonSignal::FlatbuffersStreamingJsonSignal()
+: semaphore(xSemaphoreCreateBinary())
+{
+}
+
+FlatbuffersStreamingJsonSignal::~FlatbuffersStreamingJsonSignal()
+{
+  vSemaphoreDelete(semaphore);
+}
+
+void
+FlatbuffersStreamingJsonSignal::give()
+{
+  xSemaphoreGive(semaphore);
+}
+
+void
+FlatbuffersStreamingJsonSignal::take()
+{
+  xSemaphoreTake(semaphore, portMAX_DELAY);
+}
+#else
+FlatbuffersStreamingJsonSignal::FlatbuffersStreamingJsonSignal()
+{
+}
+
+FlatbuffersStreamingJsonSignal::~FlatbuffersStreamingJsonSignal()
+{
+}
+
+void
+FlatbuffersStreamingJsonSignal::give()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  given = true;
+  cond.notify_one();
+}
+
+void
+FlatbuffersStreamingJsonSignal::take()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  cond.wait(lock, [this]() { return given; });
+  given = false;
+}
+#endif
+
+FlatbuffersStreamingJsonRing::FlatbuffersStreamingJsonRing(
+  uint8_t* _buf,
+  size_t _capacity
+)
+: buf(_buf)
+, capacity(_capacity & ~(alignment - 1))
+, head(0)
+, tail(0)
+, closed(false)
+, consumer_waiting(false)
+, producer_waiting(false)
+{
+}
+
+FlatbuffersStreamingJsonRing::FlatbuffersStreamingJsonRing(
+  size_t _capacity
+)
+: capacity(align_size(_capacity))
+, own_buf(true)
+, head(0)
+, tail(0)
+, closed(false)
+, consumer_waiting(false)
+, producer_waiting(false)
+{
+  // Allocated as uint64_t, for payload alignment
+  buf = reinterpret_cast<uint8_t*>(new uint64_t[capacity / sizeof(uint64_t)]);
+}
+
+FlatbuffersStreamingJsonRing::~FlatbuffersStreamingJsonRing()
+{
+  if (own_buf)
+  {
+    delete[] reinterpret_cast<uint64_t*>(buf);
+  }
+}
+
+size_t
+FlatbuffersStreamingJsonRing::align_size(size_t size)
+{
+  return ((size + alignment - 1) & ~(alignment - 1));
+}
+
+bool
+FlatbuffersStreamingJsonRing::can_fit(size_t size) const
+{
+  return ((header_size + align_size(size)) <= capacity);
+}
+
+size_t
+FlatbuffersStreamingJsonRing::get_free(size_t h) const
+{
+  size_t t = tail.load();
+  size_t used = (h >= t)? (h - t) : ((h + (2 * capacity)) - t);
+  return (capacity - used);
+}
+
+size_t
+FlatbuffersStreamingJsonRing::advance(size_t index, size_t n) const
+{
+  index += n;
+  return (index >= (2 * capacity))? (index - (2 * capacity)) : index;
+}
+
+bool
+FlatbuffersStreamingJsonRing::push(
+  const void* context,
+  uint32_t kind,
+  const uint8_t* data,
+  size_t size)
+{
+  size_t record_size = header_size + align_size(size);
+  if (record_size > capacity)
+  {
+    ESP_LOGE(TAG, "Record of %u bytes can not fit in %u bytes",
+      (unsigned)size, (unsigned)capacity);
+    return false;
+  }
+
+  size_t h = head.load(std::memory_order_relaxed);
+  size_t pos = (h % capacity);
+  size_t end_space = (capacity - pos);
+
+  // Records are contiguous, skip the end of the region if it is too short
+  size_t needed = (record_size <= end_space)? record_size : (end_space + record_size);
+
+  bool was_full = false;
+  while (get_free(h) < needed)
+  {
+    if (closed.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    // Backpressure, until the consumer catches up
+    if (!was_full)
+    {
+      was_full = true;
+      full_count++;
+    }
+
+    // Check again once the consumer can see we wait, so no pop() is missed
+    producer_waiting.store(true);
+    if (get_free(h) < needed)
+    {
+      popped.take();
+    }
+    producer_waiting.store(false);
+  }
+
+  if (record_size > end_space)
+  {
+    if (end_space >= header_size)
+    {
+      auto wrap = reinterpret_cast<Record*>(buf + pos);
+      wrap->size = wrap_size;
+    }
+
+    h = advance(h, end_space);
+    pos = 0;
+  }
+
+  auto record = reinterpret_cast<Record*>(buf + pos);
+  record->context = context;
+  record->kind = kind;
+  record->size = static_cast<uint32_t>(size);
+  if (size > 0)
+  {
+    memcpy(buf + pos + header_size, data, size);
+  }
+
+  // Publish the record, after its contents
+  head.store(advance(h, record_size));
+  if (consumer_waiting.load())
+  {
+    pushed.give();
+  }
+  return true;
+}
+
+void
+FlatbuffersStreamingJsonRing::wait_empty()
+{
+  size_t h = head.load(std::memory_order_relaxed);
+  while (tail.load() != h)
+  {
+    producer_waiting.store(true);
+    if (tail.load() != h)
+    {
+      popped.take();
+    }
+    producer_waiting.store(false);
+  }
+}
+
+void
+FlatbuffersStreamingJsonRing::close()
+{
+  closed.store(true, std::memory_order_release);
+  pushed.give();
+}
+
+void
+FlatbuffersStreamingJsonRing::reopen()
+{
+  closed.store(false, std::memory_order_release);
+}
+
+const FlatbuffersStreamingJsonRing::Record*
+FlatbuffersStreamingJsonRing::front()
+{
+  size_t t = tail.load(std::memory_order_relaxed);
+  while (t == head.load())
+  {
+    // Records pushed before close() are still delivered
+    if (closed.load())
+    {
+      if (t == head.load())
+      {
+        return nullptr;
+      }
+      break;
+    }
+
+    // Check again once the producer can see we wait, so no push() is missed
+    consumer_waiting.store(true);
+    if ((t == head.load()) && !closed.load())
+    {
+      pushed.take();
+    }
+    consumer_waiting.store(false);
+  }
+
+  size_t pos = (t % capacity);
+  size_t end_space = (capacity - pos);
+  if ((end_space < header_size) ||
+      (reinterpret_cast<const Record*>(buf + pos)->size == wrap_size))
+  {
+    // The producer wrapped around, there is always a record at the start
+    t = advance(t, end_space);
+    pos = 0;
+  }
+
+  auto record = reinterpret_cast<const Record*>(buf + pos);
+  front_end = advance(t, header_size + align_size(record->size));
+  return record;
+}
+
+void
+FlatbuffersStreamingJsonRing::pop()
+{
+  tail.store(front_end);
+  if (producer_waiting.load())
+  {
+    popped.give();
+  }
+}
+
+bool
+FlatbuffersStreamingJsonRing::empty() const
+{
+  return (tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire));
+}
+
+size_t
+FlatbuffersStreamingJsonRing::get_capacity() const
+{
+  return capacity;
+}
+
+size_t
+FlatbuffersStreamingJsonRing::get_full_count() const
+{
+  return full_count;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Wakes one waiting task, a wakeup given while nobody waits is kept
+class FlatbuffersStreamingJsonSignal
+{
+public:
+  FlatbuffersStreamingJsonSignal();
+  ~FlatbuffersStreamingJsonSignal();
+
+  void give();
+  void take();
+
+private:
+  FlatbuffersStreamingJsonSignal(const FlatbuffersStreamingJsonSignal&);
+  FlatbuffersStreamingJsonSignal& operator=(const FlatbuffersStreamingJsonSignal&);
+
+#ifdef ESP_PLATFORM
+  SemaphoreHandle_t semaphore;
+#else
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool given = false;
+#endif
+};
+
+// Single producer, single consumer queue of variable sized records,
+// stored contiguously in one fixed region.
+// The indices are lock-free, the signals are only used to block:
+// push() waits while the ring is full, front() waits while it is empty
+class FlatbuffersStreamingJsonRing
+{
+public:
+  struct Record
+  {
+    // Opaque to the ring
+    const void* context;
+    uint32_t kind;
+
+    // Payload bytes, which follow this header
+    uint32_t size;
+
+    const uint8_t* data() const
+    {
+      return reinterpret_cast<const uint8_t*>(this) + header_size;
+    }
+  };
+
+  // Payloads start 8-byte aligned
+  static constexpr size_t alignment = 8;
+  static constexpr size_t header_size = (
+    (sizeof(Record) + alignment - 1) & ~(alignment - 1));
+
+  // Use a caller-provided region, 8-byte aligned
+  FlatbuffersStreamingJsonRing(uint8_t* _buf, size_t _capacity);
+
+  // Allocate the region once, up front
+  explicit FlatbuffersStreamingJsonRing(size_t _capacity);
+
+  ~FlatbuffersStreamingJsonRing();
+
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonRing";
+
+  // Producer: copy a record in, waiting for space.
+  // Returns false if it could never fit, or the ring is closed
+  bool push(const void* context, uint32_t kind, const uint8_t* data, size_t size);
+
+  // Producer: wait until the consumer has popped every record
+  void wait_empty();
+
+  // Producer: no more records, front() returns nullptr once empty
+  void close();
+
+  // Before reuse, once the consumer has seen the ring closed
+  void reopen();
+
+  // Consumer: the oldest record, waiting for one.
+  // It stays valid until pop()
+  const Record* front();
+  void pop();
+
+  bool empty() const;
+  size_t get_capacity() const;
+
+  // A record of this payload size can be pushed, once there is space
+  bool can_fit(size_t size) const;
+
+  // Producer waits, when the ring was full
+  size_t get_full_count() const;
+
+private:
+  FlatbuffersStreamingJsonRing(const FlatbuffersStreamingJsonRing&);
+  FlatbuffersStreamingJsonRing& operator=(const FlatbuffersStreamingJsonRing&);
+
+  static size_t align_size(size_t size);
+
+  size_t get_free(size_t h) const;
+
+  // An index moved on by n bytes, n at most capacity
+  size_t advance(size_t index, size_t n) const;
+
+  uint8_t* buf = nullptr;
+  size_t capacity = 0;
+  bool own_buf = false;
+
+  // Bytes written and read, modulo twice the capacity, so a full ring is
+  // told apart from an empty one and neither wraps at 2^32 on ESP32.
+  // The positions are these modulo capacity
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+  std::atomic<bool> closed;
+
+  // The signals are only given while the other side waits on them
+  std::atomic<bool> consumer_waiting;
+  std::atomic<bool> producer_waiting;
+
+  // Consumer only, where the front record ends
+  size_t front_end = 0;
+
+  size_t full_count = 0;
+
+  FlatbuffersStreamingJsonSignal pushed;
+  FlatbuffersStreamingJsonSignal popped;
+};
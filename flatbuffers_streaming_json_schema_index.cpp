@@ -0,0 +1,302 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_schema_index.h"
+
+#include "flatbuffers/hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+static bool
+equals(stx::string_view a, const flatbuffers::String* b)
+{
+  return (
+    (b != nullptr) &&
+    (a.size() == b->size()) &&
+    (memcmp(a.data(), b->c_str(), a.size()) == 0)
+  );
+}
+
+// FNV-1a, as flatbuffers::HashFnv1a, for keys which are not null-terminated
+uint32_t
+FlatbuffersStreamingJsonSchemaIndex::hash(const char* data, size_t len)
+{
+  uint32_t h = flatbuffers::FnvTraits<uint32_t>::kOffsetBasis;
+  for (size_t i = 0; i < len; ++i)
+  {
+    h ^= static_cast<uint8_t>(data[i]);
+    h *= flatbuffers::FnvTraits<uint32_t>::kFnvPrime;
+  }
+  return h;
+}
+
+bool
+FlatbuffersStreamingJsonSchemaIndex::build(
+  const reflection::Schema* schema,
+  const std::vector<FlatbuffersStreamingJsonKeyedTable>& keyed_tables
+)
+{
+  clear();
+
+  if ((schema == nullptr) || (schema->objects() == nullptr))
+  {
+    return false;
+  }
+
+  auto objects = schema->objects();
+
+  // Size everything first, so pointers between entries stay valid
+  size_t fields_count = 0;
+  size_t slots_count = 0;
+  for (flatbuffers::uoffset_t i = 0; i < objects->size(); ++i)
+  {
+    auto object_fields = objects->Get(i)->fields();
+    size_t n = (object_fields != nullptr)? object_fields->size() : 0;
+
+    // At most half full
+    size_t table_slots = 1;
+    while (table_slots < (n * 2))
+    {
+      table_slots <<= 1;
+    }
+
+    fields_count += n;
+    slots_count += table_slots;
+  }
+
+  tables.resize(objects->size());
+  fields.reserve(fields_count);
+  slots.assign(slots_count, Slot{0, 0});
+  fields_by_id.assign(fields_count, nullptr);
+  tables_by_address.reserve(objects->size());
+
+  size_t slots_begin = 0;
+  for (flatbuffers::uoffset_t i = 0; i < objects->size(); ++i)
+  {
+    auto object = objects->Get(i);
+    auto& table = tables[i];
+    table.object = object;
+    table.index = i;
+    table.id_field = nullptr;
+    table.val_field = nullptr;
+    table.is_sorted = false;
+    table.slots_begin = slots_begin;
+    table.fields_by_id_begin = fields.size();
+
+    auto object_fields = object->fields();
+    size_t n = (object_fields != nullptr)? object_fields->size() : 0;
+
+    size_t table_slots = 1;
+    while (table_slots < (n * 2))
+    {
+      table_slots <<= 1;
+    }
+    table.slots_mask = static_cast<uint32_t>(table_slots - 1);
+    table.fields_count = n;
+    slots_begin += table_slots;
+
+    for (size_t f = 0; f < n; ++f)
+    {
+      auto field = object_fields->Get(f);
+
+      Field info;
+      info.field = field;
+      info.child = nullptr;
+
+      auto type = field->type();
+      info.is_flexbuffer = (
+        (type->base_type() == reflection::Vector) &&
+        (type->element() == reflection::UByte) &&
+        (field->attributes() != nullptr) &&
+        (field->attributes()->LookupByKey("flexbuffer") != nullptr)
+      );
+      flexbuffer_fields = (flexbuffer_fields || info.is_flexbuffer);
+
+      if ((type->base_type() == reflection::Obj) || (
+            (type->base_type() == reflection::Vector) &&
+            (type->element() == reflection::Obj)))
+      {
+        if ((type->index() >= 0) && (static_cast<flatbuffers::uoffset_t>(type->index()) < objects->size()))
+        {
+          info.child = &tables[type->index()];
+        }
+      }
+
+      fields.push_back(info);
+
+      // Ids are 0..n-1
+      if (field->id() < n)
+      {
+        fields_by_id[table.fields_by_id_begin + field->id()] = &fields.back();
+      }
+
+      // Linear probing, the table always has an empty slot
+      auto name = field->name();
+      auto h = hash(name->c_str(), name->size());
+      auto s = (h & table.slots_mask);
+      while (slots[table.slots_begin + s].field_idx != 0)
+      {
+        s = ((s + 1) & table.slots_mask);
+      }
+      slots[table.slots_begin + s] = Slot{h, static_cast<uint32_t>(fields.size())};
+    }
+
+    tables_by_address.push_back(std::make_pair(object, i));
+  }
+
+  std::sort(tables_by_address.begin(), tables_by_address.end());
+
+  for (auto& table : tables)
+  {
+    const char* id_name = "id";
+    const char* val_name = "val";
+    for (const auto& keyed_table : keyed_tables)
+    {
+      if (strcmp(table.object->name()->c_str(), keyed_table.table) == 0)
+      {
+        id_name = keyed_table.key_field;
+        val_name = keyed_table.val_field;
+      }
+    }
+
+    auto id_field = get_field(&table, id_name);
+    auto val_field = get_field(&table, val_name);
+    if ((id_field != nullptr) && (val_field != nullptr) && (id_field != val_field))
+    {
+      table.id_field = id_field;
+      table.val_field = val_field;
+      table.is_sorted = (
+        id_field->field->key() &&
+        (id_field->field->type()->base_type() == reflection::String)
+      );
+    }
+  }
+
+  for (const auto& keyed_table : keyed_tables)
+  {
+    auto object = schema->objects()->LookupByKey(keyed_table.table);
+    auto table = get_table(object);
+    if ((table == nullptr) || (table->id_field == nullptr))
+    {
+      return false;
+    }
+  }
+
+  root_table = get_table(schema->root_table());
+  return true;
+}
+
+void
+FlatbuffersStreamingJsonSchemaIndex::clear()
+{
+  tables.clear();
+  fields.clear();
+  slots.clear();
+  fields_by_id.clear();
+  tables_by_address.clear();
+  root_table = nullptr;
+  flexbuffer_fields = false;
+}
+
+bool
+FlatbuffersStreamingJsonSchemaIndex::empty() const
+{
+  return tables.empty();
+}
+
+const FlatbuffersStreamingJsonSchemaIndex::Table*
+FlatbuffersStreamingJsonSchemaIndex::get_table(
+  flatbuffers::uoffset_t index
+) const
+{
+  return (index < tables.size())? &tables[index] : nullptr;
+}
+
+const FlatbuffersStreamingJsonSchemaIndex::Table*
+FlatbuffersStreamingJsonSchemaIndex::get_table(
+  const reflection::Object* object
+) const
+{
+  if (object == nullptr)
+  {
+    return nullptr;
+  }
+
+  auto it = std::lower_bound(
+    tables_by_address.begin(),
+    tables_by_address.end(),
+    std::make_pair(object, static_cast<flatbuffers::uoffset_t>(0)));
+  if ((it != tables_by_address.end()) && (it->first == object))
+  {
+    return &tables[it->second];
+  }
+
+  return nullptr;
+}
+
+const FlatbuffersStreamingJsonSchemaIndex::Table*
+FlatbuffersStreamingJsonSchemaIndex::get_root_table() const
+{
+  return root_table;
+}
+
+const FlatbuffersStreamingJsonSchemaIndex::Field*
+FlatbuffersStreamingJsonSchemaIndex::get_field(
+  const Table* table,
+  stx::string_view name
+) const
+{
+  if (table == nullptr)
+  {
+    return nullptr;
+  }
+
+  auto h = hash(name.data(), name.size());
+  auto s = (h & table->slots_mask);
+  while (true)
+  {
+    const auto& slot = slots[table->slots_begin + s];
+    if (slot.field_idx == 0)
+    {
+      return nullptr;
+    }
+
+    if (slot.hash == h)
+    {
+      const auto& field = fields[slot.field_idx - 1];
+      if (equals(name, field.field->name()))
+      {
+        return &field;
+      }
+    }
+
+    s = ((s + 1) & table->slots_mask);
+  }
+}
+
+const FlatbuffersStreamingJsonSchemaIndex::Field*
+FlatbuffersStreamingJsonSchemaIndex::get_field_by_id(
+  const Table* table,
+  size_t id
+) const
+{
+  if ((table == nullptr) || (id >= table->fields_count))
+  {
+    return nullptr;
+  }
+
+  return fields_by_id[table->fields_by_id_begin + id];
+}
+
+bool
+FlatbuffersStreamingJsonSchemaIndex::has_flexbuffer_fields() const
+{
+  return flexbuffer_fields;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers/reflection.h"
+
+#include "stx/string_view.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The key and value fields of a table, which a JSON object of
+// {"key": val, ...} is re-written as a vector of.
+// Tables not listed are keyed by fields named "id" and "val"
+struct FlatbuffersStreamingJsonKeyedTable
+{
+  // Fully qualified, e.g. "ns.Entry"
+  const char* table;
+  const char* key_field;
+  const char* val_field;
+};
+
+// Per-table field lookups for a binary schema, built once.
+// Replaces LookupByKey (a binary search with strcmp) on every JSON key
+// with a hash of the key, and at most a few comparisons.
+// Each field also has its child table resolved up front.
+class FlatbuffersStreamingJsonSchemaIndex
+{
+public:
+  struct Table;
+
+  struct Field
+  {
+    const reflection::Field* field;
+
+    // Table of an Obj field, or of the elements of a vector of Obj
+    // (unions are resolved from their type field instead)
+    const Table* child;
+
+    // A [ubyte] field with the (flexbuffer) attribute, which holds any JSON
+    // value. flatc 1.7 only writes attributes declared in the schema to
+    // .bfbs, so the schema needs: attribute "flexbuffer";
+    bool is_flexbuffer;
+  };
+
+  struct Table
+  {
+    const reflection::Object* object;
+    flatbuffers::uoffset_t index;
+
+    // A keyed table, a JSON object of {"key": val, ...} is re-written
+    // as a vector of these. nullptr unless the table has both
+    const Field* id_field;
+    const Field* val_field;
+
+    // The id field has the (key) attribute, so vectors of this table
+    // are sorted by id, as LookupByKey expects
+    bool is_sorted;
+
+    // This table's open-addressed slots, a power of 2 in size
+    size_t slots_begin;
+    uint32_t slots_mask;
+
+    // This table's fields in id order
+    size_t fields_by_id_begin;
+    size_t fields_count;
+  };
+
+  // False if a keyed table, or one of its fields, is not in the schema
+  bool build(
+    const reflection::Schema* schema,
+    const std::vector<FlatbuffersStreamingJsonKeyedTable>& keyed_tables={});
+  void clear();
+
+  bool empty() const;
+
+  const Table* get_table(flatbuffers::uoffset_t index) const;
+
+  // Resolve a table from the schema, by address
+  const Table* get_table(const reflection::Object* object) const;
+
+  const Table* get_root_table() const;
+
+  // nullptr if the table has no field of that name
+  const Field* get_field(const Table* table, stx::string_view name) const;
+
+  // nullptr if the table has no field of that id
+  const Field* get_field_by_id(const Table* table, size_t id) const;
+
+  // Any table has a (flexbuffer) field
+  bool has_flexbuffer_fields() const;
+
+  static uint32_t hash(const char* data, size_t len);
+
+private:
+  struct Slot
+  {
+    uint32_t hash;
+    // Index into fields, + 1. 0 is an empty slot
+    uint32_t field_idx;
+  };
+
+  std::vector<Table> tables;
+  std::vector<Field> fields;
+  std::vector<Slot> slots;
+  std::vector<const Field*> fields_by_id;
+
+  // Sorted by address
+  std::vector<std::pair<const reflection::Object*, flatbuffers::uoffset_t>> tables_by_address;
+
+  const Table* root_table = nullptr;
+  bool flexbuffer_fields = false;
+};
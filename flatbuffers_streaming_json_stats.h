@@ -0,0 +1,123 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+// Hot-path counters, compiled in with -DFLATBUFFERS_STREAMING_JSON_STATS=1.
+// When disabled, the stats struct still exists (so telemetry code builds
+// either way) but it is never updated, and no counters are read
+#ifndef FLATBUFFERS_STREAMING_JSON_STATS
+#define FLATBUFFERS_STREAMING_JSON_STATS 0
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+#if FLATBUFFERS_STREAMING_JSON_STATS
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#else
+#include <chrono>
+#endif
+#endif
+
+// Cycle counts are CPU cycles on ESP32 (at microsecond resolution),
+// nanoseconds on a host.
+// Fields which a component does not measure stay 0
+struct FlatbuffersStreamingJsonStats
+{
+  static constexpr bool enabled = (FLATBUFFERS_STREAMING_JSON_STATS != 0);
+
+  // Visitor
+  uint64_t bytes_consumed = 0;
+  uint64_t items_emitted = 0;
+  uint64_t item_failures = 0;
+
+  // Tokenizing and path matching, excluding the phases below
+  uint64_t lex_cycles = 0;
+  // Re-serializing matched JSON (or building it, in direct builder mode)
+  uint64_t serialize_cycles = 0;
+  // Finishing and delivering each item, including all of the parser phases
+  uint64_t process_cycles = 0;
+  // User callbacks only
+  uint64_t callback_cycles = 0;
+
+  size_t peak_item_json_size = 0;
+
+  // Parser
+  uint64_t parse_cycles = 0;
+  uint64_t verify_cycles = 0;
+  uint64_t unpack_cycles = 0;
+
+  uint64_t parse_failures = 0;
+  uint64_t verifier_failures = 0;
+  // Built buffers delivered unverified, by the verify policy
+  uint64_t verifications_skipped = 0;
+
+  size_t peak_builder_size = 0;
+
+  void clear()
+  {
+    *this = FlatbuffersStreamingJsonStats();
+  }
+};
+
+#if FLATBUFFERS_STREAMING_JSON_STATS
+
+// 64 bits on both, so no span wraps: CCOUNT is only 32 bits, and wraps
+// every ~18 s at 240 MHz, so the ESP32 counts from esp_timer instead
+inline uint64_t
+flatbuffers_streaming_json_cycles()
+{
+#ifdef ESP_PLATFORM
+  return static_cast<uint64_t>(esp_timer_get_time()) * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+#else
+  return static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Adds the cycles spent in its scope to a counter
+class FlatbuffersStreamingJsonStatsTimer
+{
+public:
+  explicit FlatbuffersStreamingJsonStatsTimer(uint64_t& _counter)
+  : counter(_counter)
+  , start(flatbuffers_streaming_json_cycles())
+  {
+  }
+
+  ~FlatbuffersStreamingJsonStatsTimer()
+  {
+    counter += flatbuffers_streaming_json_cycles() - start;
+  }
+
+private:
+  uint64_t& counter;
+  uint64_t start;
+};
+
+#define FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, phase) \
+  FlatbuffersStreamingJsonStatsTimer phase##_timer((stats).phase##_cycles)
+
+#define FLATBUFFERS_STREAMING_JSON_STATS_ADD(stats, field, n) \
+  do { (stats).field += (n); } while (0)
+
+#define FLATBUFFERS_STREAMING_JSON_STATS_MAX(stats, field, n) \
+  do { if ((n) > (stats).field) { (stats).field = (n); } } while (0)
+
+#else
+
+#define FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, phase) do {} while (0)
+#define FLATBUFFERS_STREAMING_JSON_STATS_ADD(stats, field, n) do {} while (0)
+#define FLATBUFFERS_STREAMING_JSON_STATS_MAX(stats, field, n) do {} while (0)
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers/flatbuffers.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Walks a region of size-prefixed flatbuffers in place, e.g. a file read
+// back or mapped from flash, as written by a sink subscription or batch.
+// A zero length prefix is alignment padding, and is skipped.
+// A record cut off at the end of the region is left unread, so reading can
+// resume from get_offset() once the rest has arrived
+class FlatbuffersStreamingJsonStreamReader
+{
+public:
+  FlatbuffersStreamingJsonStreamReader(const uint8_t* _data, size_t _len)
+  : data(_data)
+  , len(_len)
+  {
+  }
+
+  // The next buffer, without its size prefix
+  bool next(const uint8_t*& buf, size_t& buf_len)
+  {
+    while ((len - offset) >= sizeof(flatbuffers::uoffset_t))
+    {
+      auto record_len = flatbuffers::ReadScalar<flatbuffers::uoffset_t>(data + offset);
+      if (record_len == 0)
+      {
+        offset += sizeof(flatbuffers::uoffset_t);
+        continue;
+      }
+
+      if (record_len > (len - offset - sizeof(flatbuffers::uoffset_t)))
+      {
+        return false;
+      }
+
+      buf = data + offset + sizeof(flatbuffers::uoffset_t);
+      buf_len = record_len;
+      offset += (sizeof(flatbuffers::uoffset_t) + record_len);
+      return true;
+    }
+
+    return false;
+  }
+
+  // The next root table, or nullptr for a buffer which fails verification
+  // (skipped, so reading can go on). False once no whole record is left
+  template<typename TableT>
+  bool next_root(const TableT*& root, bool verify = true)
+  {
+    const uint8_t* buf = nullptr;
+    size_t buf_len = 0;
+    if (!next(buf, buf_len))
+    {
+      return false;
+    }
+
+    root = nullptr;
+    if (verify)
+    {
+      flatbuffers::Verifier verifier(buf, buf_len);
+      if (!verifier.VerifyBuffer<TableT>(nullptr))
+      {
+        return true;
+      }
+    }
+
+    root = flatbuffers::GetRoot<TableT>(buf);
+    return true;
+  }
+
+  // Bytes consumed, up to the end of the last whole record
+  size_t get_offset() const
+  {
+    return offset;
+  }
+
+  bool at_end() const
+  {
+    return (offset == len);
+  }
+
+private:
+  const uint8_t* data;
+  size_t len;
+  size_t offset = 0;
+};
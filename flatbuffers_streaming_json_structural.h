@@ -0,0 +1,175 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Structural index of 64-byte blocks, with SSE2 or NEON on hosts.
+// Without either (e.g. on ESP32), the tokenizer keeps its word-at-a-time scans
+#ifndef FLATBUFFERS_STREAMING_JSON_SIMD
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+#define FLATBUFFERS_STREAMING_JSON_SIMD 1
+#else
+#define FLATBUFFERS_STREAMING_JSON_SIMD 0
+#endif
+#endif
+
+#if FLATBUFFERS_STREAMING_JSON_SIMD
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <arm_neon.h>
+#endif
+
+// Bit i of each mask is set for byte i of the block
+struct FlatbuffersStreamingJsonStructuralBlock
+{
+  static constexpr size_t size = 64;
+
+  uint64_t quote;
+  uint64_t backslash;
+
+  // '[' or '{'
+  uint64_t open;
+
+  // ']' or '}'
+  uint64_t close;
+
+  // Bytes below 0x20, which end a string body
+  uint64_t control;
+};
+
+#if defined(__SSE2__)
+inline void
+flatbuffers_streaming_json_index_block(
+  const char* data,
+  FlatbuffersStreamingJsonStructuralBlock& block)
+{
+  block = FlatbuffersStreamingJsonStructuralBlock();
+
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i fold = _mm_set1_epi8(0x20);
+  const __m128i open = _mm_set1_epi8('{');
+  const __m128i close = _mm_set1_epi8('}');
+  const __m128i control = _mm_set1_epi8(0x1f);
+
+  for (size_t i = 0; i < FlatbuffersStreamingJsonStructuralBlock::size; i += 16)
+  {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+
+    // ('[' | 0x20) == '{' and (']' | 0x20) == '}'
+    auto folded = _mm_or_si128(v, fold);
+
+    auto mask = [&](__m128i eq)
+    {
+      return (static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(eq))) << i);
+    };
+
+    block.quote |= mask(_mm_cmpeq_epi8(v, quote));
+    block.backslash |= mask(_mm_cmpeq_epi8(v, backslash));
+    block.open |= mask(_mm_cmpeq_epi8(folded, open));
+    block.close |= mask(_mm_cmpeq_epi8(folded, close));
+    block.control |= mask(_mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+  }
+}
+#else
+// One bit per byte of 4 compared vectors
+inline uint64_t
+flatbuffers_streaming_json_movemask(
+  uint8x16_t m0,
+  uint8x16_t m1,
+  uint8x16_t m2,
+  uint8x16_t m3)
+{
+  const uint8x16_t bits = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+  };
+
+  auto sum0 = vpaddq_u8(vandq_u8(m0, bits), vandq_u8(m1, bits));
+  auto sum1 = vpaddq_u8(vandq_u8(m2, bits), vandq_u8(m3, bits));
+  sum0 = vpaddq_u8(sum0, sum1);
+  sum0 = vpaddq_u8(sum0, sum0);
+  return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+inline void
+flatbuffers_streaming_json_index_block(
+  const char* data,
+  FlatbuffersStreamingJsonStructuralBlock& block)
+{
+  auto p = reinterpret_cast<const uint8_t*>(data);
+  uint8x16_t v[4] = {
+    vld1q_u8(p), vld1q_u8(p + 16), vld1q_u8(p + 32), vld1q_u8(p + 48),
+  };
+
+  auto index = [&](uint8_t b, bool folded)
+  {
+    uint8x16_t m[4];
+    for (size_t i = 0; i < 4; ++i)
+    {
+      // ('[' | 0x20) == '{' and (']' | 0x20) == '}'
+      auto x = folded? vorrq_u8(v[i], vdupq_n_u8(0x20)) : v[i];
+      m[i] = vceqq_u8(x, vdupq_n_u8(b));
+    }
+    return flatbuffers_streaming_json_movemask(m[0], m[1], m[2], m[3]);
+  };
+
+  block.quote = index('"', false);
+  block.backslash = index('\\', false);
+  block.open = index('{', true);
+  block.close = index('}', true);
+  block.control = flatbuffers_streaming_json_movemask(
+    vcltq_u8(v[0], vdupq_n_u8(0x20)),
+    vcltq_u8(v[1], vdupq_n_u8(0x20)),
+    vcltq_u8(v[2], vdupq_n_u8(0x20)),
+    vcltq_u8(v[3], vdupq_n_u8(0x20)));
+}
+#endif
+
+// Bytes escaped by a backslash. The carry is set when the block ends in an
+// odd run of backslashes, so the next block's first byte is escaped
+inline uint64_t
+flatbuffers_streaming_json_find_escaped(
+  uint64_t backslash,
+  uint64_t& carry)
+{
+  const uint64_t even_bits = 0x5555555555555555ULL;
+
+  // An escaped backslash starts no escape of its own
+  backslash &= ~carry;
+  uint64_t follows_escape = ((backslash << 1) | carry);
+
+  // Runs of backslashes starting on odd bits, added through to their ends
+  uint64_t odd_starts = (backslash & ~even_bits & ~follows_escape);
+  uint64_t sequences_on_even = (odd_starts + backslash);
+  carry = (sequences_on_even < odd_starts)? 1 : 0;
+
+  // Every other byte after the start of a run is escaped, up to one past it
+  uint64_t invert_mask = (sequences_on_even << 1);
+  return ((even_bits ^ invert_mask) & follows_escape);
+}
+
+// Bit i is the parity of bits 0..i, so between a pair of quotes
+// (from the opening quote, up to but not the closing quote) it is set
+inline uint64_t
+flatbuffers_streaming_json_prefix_xor(uint64_t x)
+{
+  x ^= (x << 1);
+  x ^= (x << 2);
+  x ^= (x << 4);
+  x ^= (x << 8);
+  x ^= (x << 16);
+  x ^= (x << 32);
+  return x;
+}
+#endif
@@ -0,0 +1,605 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers_streaming_json_batch.h"
+#include "flatbuffers_streaming_json_decoder.h"
+#include "flatbuffers_streaming_json_parser.h"
+#include "flatbuffers_streaming_json_stream_reader.h"
+
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A path to deliver items from, with the type and callback to deliver them as.
+// The visitor only sees this type-erased interface,
+// so one pass can deliver any number of differently typed items
+class FlatbuffersStreamingJsonSubscription
+{
+public:
+  FlatbuffersStreamingJsonSubscription(
+    const std::vector<std::string>& _path
+  )
+  : path(_path)
+  {
+  }
+
+  virtual ~FlatbuffersStreamingJsonSubscription()
+  {
+  }
+
+  const std::vector<std::string>& get_path() const
+  {
+    return path;
+  }
+
+  // Fully qualified name of the item's root table
+  virtual const char* get_table_name() const = 0;
+
+  // Parse a re-serialized JSON item, and deliver it
+  virtual bool dispatch_json(
+    FlatbuffersStreamingJsonParser& parser,
+    const std::string& json) = 0;
+
+  // Verify a directly built flatbuffer item, and deliver it
+  virtual bool dispatch_buffer(
+    FlatbuffersStreamingJsonParser& parser,
+    const uint8_t* buf,
+    size_t len) = 0;
+
+  // Directly built items are finished with a size prefix,
+  // which dispatch_buffer() then receives as part of the buffer
+  virtual bool is_size_prefixed() const
+  {
+    return false;
+  }
+
+  // Directly built items are built into one shared buffer until
+  // is_shared_batch_full(), then dispatch_buffer() receives them all
+  // as one FlatbuffersStreamingJsonSharedBatch
+  virtual bool is_shared_batch() const
+  {
+    return false;
+  }
+
+  // After each item, with the items and bytes of the batch so far
+  virtual bool is_shared_batch_full(size_t, size_t) const
+  {
+    return false;
+  }
+
+  // Subscriptions with a generated decoder receive the item's events
+  // directly, in place of the builder or re-serialized JSON
+  virtual FlatbuffersStreamingJsonDecoder* start_decoding()
+  {
+    return nullptr;
+  }
+
+  // Deliver the decoded item
+  virtual bool dispatch_decoded()
+  {
+    return false;
+  }
+
+  // The stream is complete, deliver anything still held back
+  virtual bool finish_stream()
+  {
+    return true;
+  }
+
+  // A new stream begins, drop anything still held back
+  virtual void clear_stream()
+  {
+  }
+
+  // Deliver an item whose value is an array in segments, each a whole item
+  // holding the next run of elements: once it has max_elements of them,
+  // or has grown past max_bytes (0 for no limit)
+  void set_segment_limits(size_t _max_elements, size_t _max_bytes)
+  {
+    segment_max_elements = _max_elements;
+    segment_max_bytes = _max_bytes;
+  }
+
+  bool is_segmented() const
+  {
+    return ((segment_max_elements > 0) || (segment_max_bytes > 0));
+  }
+
+  // Before an element, with the segment so far
+  bool is_segment_full(size_t elements, size_t bytes) const
+  {
+    return (
+      ((segment_max_elements > 0) && (elements >= segment_max_elements)) ||
+      ((segment_max_bytes > 0) && (bytes >= segment_max_bytes))
+    );
+  }
+
+protected:
+  std::vector<std::string> path;
+
+  size_t segment_max_elements = 0;
+  size_t segment_max_bytes = 0;
+};
+
+template<typename ObjT>
+class FlatbuffersStreamingJsonTypedSubscription
+: public FlatbuffersStreamingJsonSubscription
+{
+public:
+  typedef typename ObjT::TableType TableT;
+
+  FlatbuffersStreamingJsonTypedSubscription(
+    const std::vector<std::string>& _path,
+    std::function<bool(const ObjT&)> _callback
+  )
+  : FlatbuffersStreamingJsonSubscription(_path)
+  , callback(_callback)
+  {
+  }
+
+  // Zero-copy, the callback receives the verified root table directly.
+  // It points into the builder, and is only valid during the callback
+  FlatbuffersStreamingJsonTypedSubscription(
+    const std::vector<std::string>& _path,
+    std::function<bool(const TableT*)> _table_callback
+  )
+  : FlatbuffersStreamingJsonSubscription(_path)
+  , table_callback(_table_callback)
+  {
+  }
+
+  const char* get_table_name() const override
+  {
+    return TableT::GetFullyQualifiedName();
+  }
+
+  bool dispatch_json(
+    FlatbuffersStreamingJsonParser& parser,
+    const std::string& json) override
+  {
+    // Resolve the root type on first use, instead of once per item
+    // (again for another parser, e.g. a pipeline's)
+    if ((struct_def == nullptr) || (prepared_parser != &parser))
+    {
+      struct_def = parser.prepare<TableT>();
+      prepared_parser = &parser;
+    }
+
+    return dispatch(parser, parser.parse<TableT>(struct_def, json));
+  }
+
+  bool dispatch_buffer(
+    FlatbuffersStreamingJsonParser& parser,
+    const uint8_t* buf,
+    size_t len) override
+  {
+    return dispatch(parser, parser.verify_built<TableT>(buf, len));
+  }
+
+private:
+  bool dispatch(
+    FlatbuffersStreamingJsonParser& parser,
+    const TableT* flatbuf)
+  {
+    if (flatbuf == nullptr)
+    {
+      return false;
+    }
+
+    if (table_callback)
+    {
+      return table_callback(flatbuf);
+    }
+
+    if (callback)
+    {
+      // Unpack the binary into the C++ object
+      ObjT obj;
+      parser.unpack(flatbuf, obj);
+      return callback(obj);
+    }
+
+    return true;
+  }
+
+  std::function<bool(const ObjT&)> callback;
+  std::function<bool(const TableT*)> table_callback;
+
+  const flatbuffers::StructDef* struct_def = nullptr;
+  const FlatbuffersStreamingJsonParser* prepared_parser = nullptr;
+};
+
+
+// Decodes items with the descriptors from tools/flatbuffers_streaming_json_gen,
+// which specialize FlatbuffersStreamingJsonDecoderTraits<ObjT>.
+// Needs no schema, so the parser may have none
+template<typename ObjT>
+class FlatbuffersStreamingJsonDecodedSubscription
+: public FlatbuffersStreamingJsonSubscription
+{
+public:
+  FlatbuffersStreamingJsonDecodedSubscription(
+    const std::vector<std::string>& _path,
+    std::function<bool(const ObjT&)> _callback
+  )
+  : FlatbuffersStreamingJsonSubscription(_path)
+  , callback(_callback)
+  {
+  }
+
+  const char* get_table_name() const override
+  {
+    return FlatbuffersStreamingJsonDecoderTraits<ObjT>::get_table()->name;
+  }
+
+  bool dispatch_json(
+    FlatbuffersStreamingJsonParser&,
+    const std::string&) override
+  {
+    return false;
+  }
+
+  bool dispatch_buffer(
+    FlatbuffersStreamingJsonParser&,
+    const uint8_t*,
+    size_t) override
+  {
+    return false;
+  }
+
+  FlatbuffersStreamingJsonDecoder* start_decoding() override
+  {
+    // Each item starts from a default-constructed object
+    obj = ObjT();
+
+    // A failed start leaves the decoder empty, so the item fails
+    decoder.start_root(&obj, FlatbuffersStreamingJsonDecoderTraits<ObjT>::get_table());
+    return &decoder;
+  }
+
+  bool dispatch_decoded() override
+  {
+    return (
+      decoder.finish_root() &&
+      (!callback || callback(obj))
+    );
+  }
+
+private:
+  std::function<bool(const ObjT&)> callback;
+
+  FlatbuffersStreamingJsonDecoder decoder;
+  ObjT obj;
+};
+
+// Captures each item into a flexbuffer, without a schema: a map holding the
+// item's key and value (or the whole document, for an empty path).
+// Read it with flexbuffers::GetRoot(buf, len), it is only valid during the callback
+class FlatbuffersStreamingJsonFlexBufferSubscription
+: public FlatbuffersStreamingJsonSubscription
+{
+public:
+  FlatbuffersStreamingJsonFlexBufferSubscription(
+    const std::vector<std::string>& _path,
+    std::function<bool(const uint8_t*, size_t)> _callback
+  )
+  : FlatbuffersStreamingJsonSubscription(_path)
+  , callback(_callback)
+  {
+  }
+
+  const char* get_table_name() const override
+  {
+    return "";
+  }
+
+  bool dispatch_json(
+    FlatbuffersStreamingJsonParser&,
+    const std::string&) override
+  {
+    return false;
+  }
+
+  bool dispatch_buffer(
+    FlatbuffersStreamingJsonParser&,
+    const uint8_t*,
+    size_t) override
+  {
+    return false;
+  }
+
+  FlatbuffersStreamingJsonDecoder* start_decoding() override
+  {
+    decoder.start_flexbuffer_root(&capture);
+    return &decoder;
+  }
+
+  bool dispatch_decoded() override
+  {
+    if (!decoder.finish_root())
+    {
+      return false;
+    }
+
+    const auto& buf = capture.get_buffer();
+    return (!callback || callback(buf.data(), buf.size()));
+  }
+
+private:
+  std::function<bool(const uint8_t*, size_t)> callback;
+
+  FlatbuffersStreamingJsonDecoder decoder;
+  FlatbuffersStreamingJsonFlexBufferCapture capture;
+};
+
+
+// Collects verified items, delivering up to max_items of them at once,
+// or fewer once the next would take the batch past max_bytes.
+// The rest are delivered when the stream finishes
+template<typename TableT>
+class FlatbuffersStreamingJsonBatchedSubscription
+: public FlatbuffersStreamingJsonSubscription
+{
+public:
+  typedef FlatbuffersStreamingJsonBatch<TableT> BatchT;
+
+  FlatbuffersStreamingJsonBatchedSubscription(
+    const std::vector<std::string>& _path,
+    size_t _max_items,
+    size_t _max_bytes,
+    std::function<bool(const BatchT&)> _batch_callback
+  )
+  : FlatbuffersStreamingJsonSubscription(_path)
+  , max_items(_max_items)
+  , max_bytes(_max_bytes)
+  , batch_callback(_batch_callback)
+  {
+    batch.reserve(max_bytes, max_items);
+  }
+
+  const char* get_table_name() const override
+  {
+    return TableT::GetFullyQualifiedName();
+  }
+
+  bool dispatch_json(
+    FlatbuffersStreamingJsonParser& parser,
+    const std::string& json) override
+  {
+    if ((struct_def == nullptr) || (prepared_parser != &parser))
+    {
+      struct_def = parser.prepare<TableT>();
+      prepared_parser = &parser;
+    }
+
+    return (
+      (parser.parse<TableT>(struct_def, json) != nullptr) &&
+      add(parser.get_parsed_buffer_pointer(), parser.get_parsed_size())
+    );
+  }
+
+  bool dispatch_buffer(
+    FlatbuffersStreamingJsonParser& parser,
+    const uint8_t* buf,
+    size_t len) override
+  {
+    return (
+      (parser.verify_built<TableT>(buf, len) != nullptr) &&
+      add(buf, len)
+    );
+  }
+
+  bool finish_stream() override
+  {
+    return deliver();
+  }
+
+  void clear_stream() override
+  {
+    batch.clear();
+  }
+
+private:
+  bool add(const uint8_t* buf, size_t len)
+  {
+    bool ok = true;
+
+    // This item would not fit, deliver the batch so far first
+    if (!batch.empty() && (batch.get_size_with(len) > max_bytes))
+    {
+      ok = deliver();
+    }
+
+    batch.append(buf, len);
+
+    if (batch.size() >= max_items)
+    {
+      ok = deliver() && ok;
+    }
+
+    return ok;
+  }
+
+  bool deliver()
+  {
+    if (batch.empty())
+    {
+      return true;
+    }
+
+    bool ok = (!batch_callback || batch_callback(BatchT(batch)));
+    batch.clear();
+    return ok;
+  }
+
+  size_t max_items;
+  size_t max_bytes;
+  std::function<bool(const BatchT&)> batch_callback;
+
+  FlatbuffersStreamingJsonBatchBuffer batch;
+
+  const flatbuffers::StructDef* struct_def = nullptr;
+  const FlatbuffersStreamingJsonParser* prepared_parser = nullptr;
+};
+
+
+// Writes each verified item to a sink (file, ring, socket, ...) as a
+// size-prefixed flatbuffer, without unpacking it, for store-and-forward.
+// Each write is one whole record: a little-endian uoffset_t length, then the
+// buffer. Records are only 4-byte aligned within the stream, read them back
+// with FlatbuffersStreamingJsonStreamReader
+template<typename TableT>
+class FlatbuffersStreamingJsonSinkSubscription
+: public FlatbuffersStreamingJsonSubscription
+{
+public:
+  FlatbuffersStreamingJsonSinkSubscription(
+    const std::vector<std::string>& _path,
+    std::function<bool(const uint8_t*, size_t)> _write
+  )
+  : FlatbuffersStreamingJsonSubscription(_path)
+  , write(_write)
+  {
+  }
+
+  const char* get_table_name() const override
+  {
+    return TableT::GetFullyQualifiedName();
+  }
+
+  bool is_size_prefixed() const override
+  {
+    return true;
+  }
+
+  bool dispatch_json(
+    FlatbuffersStreamingJsonParser& parser,
+    const std::string& json) override
+  {
+    if ((struct_def == nullptr) || (prepared_parser != &parser))
+    {
+      struct_def = parser.prepare<TableT>();
+      prepared_parser = &parser;
+    }
+
+    if (parser.parse<TableT>(struct_def, json) == nullptr)
+    {
+      return false;
+    }
+
+    // The idl parser's buffer has no prefix. Copy it in after a prefix and
+    // a root offset of its own, so it stays aligned from the record's start
+    // as a size-prefixed buffer is, and its own root offset goes unused
+    auto buf = parser.get_parsed_buffer_pointer();
+    auto len = parser.get_parsed_size();
+    auto root = flatbuffers::ReadScalar<flatbuffers::uoffset_t>(buf);
+    record.resize((2 * sizeof(flatbuffers::uoffset_t)) + len);
+    flatbuffers::WriteScalar<flatbuffers::uoffset_t>(
+      record.data(), static_cast<flatbuffers::uoffset_t>(sizeof(flatbuffers::uoffset_t) + len));
+    flatbuffers::WriteScalar<flatbuffers::uoffset_t>(
+      record.data() + sizeof(flatbuffers::uoffset_t),
+      static_cast<flatbuffers::uoffset_t>(sizeof(flatbuffers::uoffset_t) + root));
+    memcpy(record.data() + (2 * sizeof(flatbuffers::uoffset_t)), buf, len);
+
+    return (!write || write(record.data(), record.size()));
+  }
+
+  // Built with its prefix, so it is written straight from the builder
+  bool dispatch_buffer(
+    FlatbuffersStreamingJsonParser& parser,
+    const uint8_t* buf,
+    size_t len) override
+  {
+    return (
+      (parser.verify_built_size_prefixed<TableT>(buf, len) != nullptr) &&
+      (!write || write(buf, len))
+    );
+  }
+
+private:
+  std::function<bool(const uint8_t*, size_t)> write;
+
+  // A re-serialized item, with its prefix
+  std::vector<uint8_t> record;
+
+  const flatbuffers::StructDef* struct_def = nullptr;
+  const FlatbuffersStreamingJsonParser* prepared_parser = nullptr;
+};
+
+
+// Builds up to max_items items into one flatbuffer, or until it has grown
+// past max_bytes, so repeated strings and identical vtables are stored once
+// per batch instead of once per item (for forwarding or storing the batch).
+// Only with the direct builder: re-serialized items are each parsed into a
+// buffer of their own, which cannot share with the next.
+// The rest are delivered when the stream finishes
+template<typename TableT>
+class FlatbuffersStreamingJsonSharedBatchSubscription
+: public FlatbuffersStreamingJsonSubscription
+{
+public:
+  typedef FlatbuffersStreamingJsonSharedBatch<TableT> BatchT;
+
+  FlatbuffersStreamingJsonSharedBatchSubscription(
+    const std::vector<std::string>& _path,
+    size_t _max_items,
+    size_t _max_bytes,
+    std::function<bool(const BatchT&)> _batch_callback
+  )
+  : FlatbuffersStreamingJsonSubscription(_path)
+  , max_items(_max_items)
+  , max_bytes(_max_bytes)
+  , batch_callback(_batch_callback)
+  {
+  }
+
+  const char* get_table_name() const override
+  {
+    return TableT::GetFullyQualifiedName();
+  }
+
+  bool is_shared_batch() const override
+  {
+    return true;
+  }
+
+  bool is_shared_batch_full(size_t items, size_t bytes) const override
+  {
+    return (
+      (items >= max_items) ||
+      ((max_bytes > 0) && (bytes >= max_bytes))
+    );
+  }
+
+  bool dispatch_json(
+    FlatbuffersStreamingJsonParser&,
+    const std::string&) override
+  {
+    return false;
+  }
+
+  bool dispatch_buffer(
+    FlatbuffersStreamingJsonParser& parser,
+    const uint8_t* buf,
+    size_t len) override
+  {
+    return (
+      (parser.verify_built<typename BatchT::RootT>(buf, len) != nullptr) &&
+      (!batch_callback || batch_callback(BatchT(buf, len)))
+    );
+  }
+
+private:
+  size_t max_items;
+  size_t max_bytes;
+  std::function<bool(const BatchT&)> batch_callback;
+};
@@ -0,0 +1,1168 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers_streaming_json_number.h"
+#include "flatbuffers_streaming_json_structural.h"
+
+#include "stx/string_view.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Resumable (push) JSON tokenizer.
+// Input may be split at any byte, all parsing state is kept between feed()
+// calls on an explicit stack, instead of the call stack as in picojson.
+//
+// Context receives the same SAX events as a picojson context,
+// with each recursive picojson call split into begin/end halves,
+// and numbers given as scanned tokens instead of int64_t or double:
+//   set_null(), set_bool(b), set_raw_number(n), set_string(s)
+//   parse_array_start(), begin_array_item(), parse_array_stop(n)
+//   parse_object_start(), begin_object_item(key), end_object_item(),
+//   parse_object_stop()
+//
+// From begin_object_item(), the context may call skip_value() to discard
+// the item's value: it is then scanned for quotes and brackets only,
+// with no events, and nothing inside is decoded or validated.
+// From any event, skip_rest() discards the rest of the innermost container
+// in the same way, and stop() ends the input after the current byte.
+//
+// Skipped values and string bodies are scanned a word at a time, or with a
+// structural index of whole 64-byte blocks where SIMD is available
+template<typename Context>
+class FlatbuffersStreamingJsonTokenizer
+{
+public:
+  FlatbuffersStreamingJsonTokenizer(Context& _ctx)
+  : ctx(_ctx)
+  {
+  }
+
+  void clear()
+  {
+    state = ValueState;
+    escape_state = NoEscape;
+    containers.clear();
+    token.clear();
+    string_view_data = nullptr;
+    err.clear();
+    literal = nullptr;
+    skip_pending = false;
+    skip_rest_pending = false;
+    skip_container = false;
+    stop_pending = false;
+    position = 0;
+  }
+
+  // Size the token buffers and container stack up front
+  void reserve(size_t string_size, size_t depth)
+  {
+    token.reserve(string_size);
+    key.reserve(string_size);
+    containers.reserve(depth);
+  }
+
+  // Returns false once the input (or the context) has failed,
+  // further input is then ignored. Once stopped, it is ignored too
+  bool feed(const char* data, size_t len)
+  {
+    size_t i = 0;
+    while (i < len)
+    {
+      if (state == ErrorState)
+      {
+        return false;
+      }
+
+      if (state == StoppedState)
+      {
+        return true;
+      }
+
+      // Consume runs of string body, number or whitespace in bulk,
+      // leaving only the delimiting byte for the state machine
+      size_t run = scan_run(data + i, len - i);
+      if (run > 0)
+      {
+        i += run;
+        position += run;
+        continue;
+      }
+
+      if (consume(data[i]) == false)
+      {
+        set_error(data + i, len - i);
+        return false;
+      }
+
+      i++;
+      position++;
+
+      // Requested by the context, during that byte's events
+      if (stop_pending)
+      {
+        stop_pending = false;
+        state = StoppedState;
+      }
+      else if (skip_rest_pending)
+      {
+        start_skip_rest();
+      }
+    }
+
+    return (state != ErrorState);
+  }
+
+  // Signal the end of input, a complete document must have been seen
+  bool finish()
+  {
+    if (state == ErrorState)
+    {
+      return false;
+    }
+
+    if (state == StoppedState)
+    {
+      return true;
+    }
+
+    // A top-level number has no closing delimiter
+    if ((state == NumberState) && containers.empty())
+    {
+      if (end_number() == false)
+      {
+        set_error(nullptr, 0);
+        return false;
+      }
+    }
+
+    if (state != DoneState)
+    {
+      err = "unexpected end of input";
+      state = ErrorState;
+      return false;
+    }
+
+    return true;
+  }
+
+  // Discard the next value, up to its end_object_item()
+  void skip_value()
+  {
+    skip_pending = true;
+  }
+
+  // Discard the rest of the innermost array or object, after this event.
+  // Its parse_array_stop() (with the count seen so far) or
+  // parse_object_stop() still follows
+  void skip_rest()
+  {
+    skip_rest_pending = true;
+  }
+
+  // Consume no more input after this event's byte. finish() then succeeds,
+  // and get_position() is where the input was left
+  void stop()
+  {
+    stop_pending = true;
+  }
+
+  bool is_done() const
+  {
+    return (state == DoneState);
+  }
+
+  bool is_stopped() const
+  {
+    return (state == StoppedState);
+  }
+
+  // Bytes consumed since clear(). During an event for a bracket or comma,
+  // the offset of that byte
+  size_t get_position() const
+  {
+    return position;
+  }
+
+  const std::string& get_error() const
+  {
+    return err;
+  }
+
+private:
+  enum State
+  {
+    // Expecting any value
+    ValueState,
+    // Just after '[', expecting a value or ']'
+    FirstArrayItemState,
+    // Just after '{', expecting a key or '}'
+    FirstObjectKeyState,
+    // After ',' in an object, expecting a key
+    ObjectKeyState,
+    // After a key, expecting ':'
+    ColonState,
+    // Expecting ',' or the enclosing ']' / '}'
+    AfterValueState,
+    StringState,
+    NumberState,
+    LiteralState,
+    // Skipping a string, array or object value
+    SkipState,
+    // Skipping a number or literal value, up to its delimiter
+    SkipScalarState,
+    // The top-level value is complete
+    DoneState,
+    // Stopped by the context, before the end of the input
+    StoppedState,
+    ErrorState,
+  };
+
+  enum EscapeState
+  {
+    NoEscape,
+    // After '\'
+    Escape,
+    // Reading 4 hex digits of a \u escape
+    UnicodeHex,
+    // Expecting the "\u" of a low surrogate
+    SurrogateBackslash,
+    SurrogateU,
+  };
+
+  struct Container
+  {
+    // '[' or '{'
+    char type;
+    size_t count;
+  };
+
+  static bool is_whitespace(char ch)
+  {
+    return ((ch == ' ') || (ch == '\t') || (ch == '\n') || (ch == '\r'));
+  }
+
+  static bool is_number_char(char ch)
+  {
+    return (
+      ((ch >= '0') && (ch <= '9')) ||
+      (ch == '+') || (ch == '-') ||
+      (ch == 'e') || (ch == 'E') ||
+      (ch == '.')
+    );
+  }
+
+  // Bytes which end (or need decoding within) a string body
+  static bool is_string_special(char ch)
+  {
+    return ((ch == '"') || (ch == '\\') || ((ch >= 0) && (ch < 0x20)));
+  }
+
+  // Word-at-a-time (SWAR) byte search, a word is 4 bytes on ESP32
+  typedef size_t Word;
+
+  static Word repeat_byte(uint8_t b)
+  {
+    return ((~static_cast<Word>(0) / 0xff) * b);
+  }
+
+  // Non-zero if any byte of w is zero
+  static Word has_zero_byte(Word w)
+  {
+    return ((w - repeat_byte(0x01)) & ~w & repeat_byte(0x80));
+  }
+
+  static Word has_byte(Word w, uint8_t b)
+  {
+    return has_zero_byte(w ^ repeat_byte(b));
+  }
+
+  // Non-zero if any byte of w is below 0x20
+  static Word has_control_byte(Word w)
+  {
+    return ((w - repeat_byte(0x20)) & ~w & repeat_byte(0x80));
+  }
+
+  static Word has_string_special(Word w)
+  {
+    return (has_byte(w, '"') | has_byte(w, '\\') | has_control_byte(w));
+  }
+
+  // Returns the length of the leading run of string body
+  static size_t scan_string(const char* data, size_t len)
+  {
+    const char* p = data;
+    const char* end = data + len;
+
+#if FLATBUFFERS_STREAMING_JSON_SIMD
+    // Most strings end within a few words, before a block would pay off
+    size_t words = 0;
+#endif
+    while ((end - p) >= static_cast<ptrdiff_t>(sizeof(Word)))
+    {
+      Word w;
+      memcpy(&w, p, sizeof(w));
+      if (has_string_special(w))
+      {
+        break;
+      }
+      p += sizeof(Word);
+
+#if FLATBUFFERS_STREAMING_JSON_SIMD
+      if (++words == (16 / sizeof(Word)))
+      {
+        while ((end - p) >= static_cast<ptrdiff_t>(FlatbuffersStreamingJsonStructuralBlock::size))
+        {
+          FlatbuffersStreamingJsonStructuralBlock block;
+          flatbuffers_streaming_json_index_block(p, block);
+
+          uint64_t special = (block.quote | block.backslash | block.control);
+          if (special != 0)
+          {
+            return ((p - data) + __builtin_ctzll(special));
+          }
+          p += FlatbuffersStreamingJsonStructuralBlock::size;
+        }
+      }
+#endif
+    }
+
+    while ((p != end) && !is_string_special(*p))
+    {
+      ++p;
+    }
+
+    return (p - data);
+  }
+
+  // Bytes which matter while skipping: quotes and backslashes in a string,
+  // otherwise quotes and brackets.
+  // ('[' | 0x20) == '{' and (']' | 0x20) == '}'
+  static bool is_skip_special(char ch, bool in_string)
+  {
+    if (in_string)
+    {
+      return ((ch == '"') || (ch == '\\'));
+    }
+
+    char folded = (ch | 0x20);
+    return ((ch == '"') || (folded == '{') || (folded == '}'));
+  }
+
+  static Word has_skip_special(Word w, bool in_string)
+  {
+    if (in_string)
+    {
+      return (has_byte(w, '"') | has_byte(w, '\\'));
+    }
+
+    Word folded = (w | repeat_byte(0x20));
+    return (has_byte(w, '"') | has_byte(folded, '{') | has_byte(folded, '}'));
+  }
+
+  // Returns the length of the leading run without any special bytes
+  static size_t scan_skip(const char* data, size_t len, bool in_string)
+  {
+    const char* p = data;
+    const char* end = data + len;
+
+    while ((end - p) >= static_cast<ptrdiff_t>(sizeof(Word)))
+    {
+      Word w;
+      memcpy(&w, p, sizeof(w));
+      if (has_skip_special(w, in_string))
+      {
+        break;
+      }
+      p += sizeof(Word);
+    }
+
+    while ((p != end) && !is_skip_special(*p, in_string))
+    {
+      ++p;
+    }
+
+    return (p - data);
+  }
+
+#if FLATBUFFERS_STREAMING_JSON_SIMD
+  // Skips whole blocks, up to the byte which ends the skipped value:
+  // its closing quote, or the bracket which closes it.
+  // Brackets within strings are masked out with the block's quotes,
+  // once those escaped by an odd run of backslashes are removed.
+  // (In invalid input, a backslash outside a string also escapes here)
+  size_t scan_skip_blocks(const char* data, size_t len)
+  {
+    typedef FlatbuffersStreamingJsonStructuralBlock Block;
+
+    size_t i = 0;
+    uint64_t escape_carry = 0;
+    for (; (len - i) >= Block::size; i += Block::size)
+    {
+      Block block;
+      flatbuffers_streaming_json_index_block(data + i, block);
+
+      uint64_t escaped = flatbuffers_streaming_json_find_escaped(block.backslash, escape_carry);
+      uint64_t quote = (block.quote & ~escaped);
+      uint64_t in_string = (
+        flatbuffers_streaming_json_prefix_xor(quote) ^
+        (skip_in_string? ~static_cast<uint64_t>(0) : 0)
+      );
+
+      if (skip_depth == 0)
+      {
+        // A skipped string value, ending at its closing quote
+        if (quote != 0)
+        {
+          return (i + __builtin_ctzll(quote));
+        }
+        continue;
+      }
+
+      uint64_t open = (block.open & ~in_string);
+      uint64_t close = (block.close & ~in_string);
+
+      // Too few closing brackets to end the value in this block
+      auto opens = static_cast<size_t>(__builtin_popcountll(open));
+      auto closes = static_cast<size_t>(__builtin_popcountll(close));
+      if (closes < skip_depth)
+      {
+        skip_depth = (skip_depth + opens - closes);
+      }
+      else {
+        for (uint64_t brackets = (open | close); brackets != 0; brackets &= (brackets - 1))
+        {
+          auto k = __builtin_ctzll(brackets);
+          if ((open >> k) & 1)
+          {
+            skip_depth++;
+          }
+          else if (skip_depth == 1)
+          {
+            // consume_skip() closes the value
+            skip_in_string = false;
+            return (i + k);
+          }
+          else {
+            skip_depth--;
+          }
+        }
+      }
+
+      skip_in_string = ((in_string >> 63) != 0);
+    }
+
+    // The next byte is escaped, consume_skip() takes it
+    skip_escape = (escape_carry != 0);
+    return i;
+  }
+#endif
+
+  static bool is_delimiter(char ch)
+  {
+    return (is_whitespace(ch) || (ch == ',') || (ch == ']') || (ch == '}'));
+  }
+
+  size_t scan_run(const char* data, size_t len)
+  {
+    const char* p = data;
+    const char* end = data + len;
+
+    switch (state)
+    {
+      case SkipState:
+        if (skip_escape)
+        {
+          return 0;
+        }
+#if FLATBUFFERS_STREAMING_JSON_SIMD
+        if (len >= FlatbuffersStreamingJsonStructuralBlock::size)
+        {
+          return scan_skip_blocks(data, len);
+        }
+#endif
+        return scan_skip(data, len, skip_in_string);
+
+      case SkipScalarState:
+        while ((p != end) && !is_delimiter(*p))
+        {
+          ++p;
+        }
+        break;
+
+      case StringState:
+        if (escape_state != NoEscape)
+        {
+          return 0;
+        }
+
+        p += scan_string(data, len);
+
+        // A whole value string, without escapes, is passed on in place
+        if ((p != data) && token.empty() && !is_key && (p != end) && (*p == '"'))
+        {
+          string_view_data = data;
+          string_view_size = (p - data);
+          break;
+        }
+        token.append(data, p - data);
+        break;
+
+      case NumberState:
+        while ((p != end) && is_number_char(*p))
+        {
+          ++p;
+        }
+        token.append(data, p - data);
+        break;
+
+      case LiteralState:
+      case StoppedState:
+      case ErrorState:
+        return 0;
+
+      default:
+        while ((p != end) && is_whitespace(*p))
+        {
+          ++p;
+        }
+        break;
+    }
+
+    return (p - data);
+  }
+
+  bool consume(char ch)
+  {
+    switch (state)
+    {
+      case StringState:
+        return consume_string(ch);
+
+      case NumberState:
+        if (is_number_char(ch))
+        {
+          token.push_back(ch);
+          return true;
+        }
+
+        // The delimiter belongs to the enclosing state
+        return (end_number() && consume(ch));
+
+      case LiteralState:
+        if (ch != literal[literal_idx])
+        {
+          return false;
+        }
+
+        literal_idx++;
+        if (literal[literal_idx] == '\0')
+        {
+          return end_literal();
+        }
+        return true;
+
+      case SkipState:
+        return consume_skip(ch);
+
+      case SkipScalarState:
+        if (!is_delimiter(ch))
+        {
+          return true;
+        }
+
+        // The delimiter belongs to the enclosing state
+        return (value_done() && consume(ch));
+
+      case ErrorState:
+        return false;
+
+      default:
+        break;
+    }
+
+    if (is_whitespace(ch))
+    {
+      return true;
+    }
+
+    switch (state)
+    {
+      case ValueState:
+        return start_value(ch);
+
+      case FirstArrayItemState:
+        if (ch == ']')
+        {
+          return end_array();
+        }
+
+        containers.back().count++;
+        if (ctx.begin_array_item() == false)
+        {
+          return false;
+        }
+        state = ValueState;
+
+        if (skip_rest_pending)
+        {
+          // This byte already belongs to the rest
+          start_skip_rest();
+          return consume(ch);
+        }
+        return start_value(ch);
+
+      case FirstObjectKeyState:
+        if (ch == '}')
+        {
+          return end_object();
+        }
+        // fall through
+
+      case ObjectKeyState:
+        if (ch != '"')
+        {
+          return false;
+        }
+        start_string(true);
+        return true;
+
+      case ColonState:
+        if (ch != ':')
+        {
+          return false;
+        }
+
+        containers.back().count++;
+        state = ValueState;
+        return ctx.begin_object_item(stx::string_view(key.data(), key.size()));
+
+      case AfterValueState:
+        if (ch == ',')
+        {
+          if (containers.back().type == '[')
+          {
+            containers.back().count++;
+            state = ValueState;
+            return ctx.begin_array_item();
+          }
+
+          state = ObjectKeyState;
+          return true;
+        }
+
+        if ((ch == ']') && (containers.back().type == '['))
+        {
+          return end_array();
+        }
+
+        if ((ch == '}') && (containers.back().type == '{'))
+        {
+          return end_object();
+        }
+        return false;
+
+      case DoneState:
+        // Like picojson, stop after the first complete value
+        return true;
+
+      default:
+        return false;
+    }
+  }
+
+  bool start_value(char ch)
+  {
+    if (skip_pending)
+    {
+      skip_pending = false;
+      return start_skip(ch);
+    }
+
+    switch (ch)
+    {
+      case '"':
+        start_string(false);
+        return true;
+
+      case '[':
+        containers.push_back({'[', 0});
+        state = FirstArrayItemState;
+        return ctx.parse_array_start();
+
+      case '{':
+        containers.push_back({'{', 0});
+        state = FirstObjectKeyState;
+        return ctx.parse_object_start();
+
+      case 't':
+        return start_literal("true");
+
+      case 'f':
+        return start_literal("false");
+
+      case 'n':
+        return start_literal("null");
+
+      default:
+        if (((ch >= '0') && (ch <= '9')) || (ch == '-'))
+        {
+          token.clear();
+          token.push_back(ch);
+          state = NumberState;
+          return true;
+        }
+        return false;
+    }
+  }
+
+  bool start_skip(char ch)
+  {
+    skip_depth = 0;
+    skip_in_string = false;
+    skip_escape = false;
+
+    switch (ch)
+    {
+      case '"':
+        skip_in_string = true;
+        break;
+
+      case '[':
+      case '{':
+        skip_depth = 1;
+        break;
+
+      default:
+        // Still reject anything which cannot start a value
+        if (!(((ch >= '0') && (ch <= '9')) || (ch == '-') ||
+              (ch == 't') || (ch == 'f') || (ch == 'n')))
+        {
+          return false;
+        }
+        state = SkipScalarState;
+        return true;
+    }
+
+    state = SkipState;
+    return true;
+  }
+
+  // Only called for special bytes, others are consumed by scan_skip()
+  bool consume_skip(char ch)
+  {
+    if (skip_escape)
+    {
+      skip_escape = false;
+      return true;
+    }
+
+    if (skip_in_string)
+    {
+      if (ch == '\\')
+      {
+        skip_escape = true;
+      }
+      else if (ch == '"')
+      {
+        skip_in_string = false;
+        if (skip_depth == 0)
+        {
+          return value_done();
+        }
+      }
+      return true;
+    }
+
+    switch (ch)
+    {
+      case '"':
+        skip_in_string = true;
+        return true;
+
+      case '[':
+      case '{':
+        skip_depth++;
+        return true;
+
+      case ']':
+      case '}':
+        skip_depth--;
+        if (skip_depth > 0)
+        {
+          return true;
+        }
+
+        if (skip_container)
+        {
+          // The bracket closes the container being skipped, as usual
+          skip_container = false;
+          if (ch != ((containers.back().type == '[')? ']' : '}'))
+          {
+            return false;
+          }
+          return ((ch == ']')? end_array() : end_object());
+        }
+        return value_done();
+
+      default:
+        return true;
+    }
+  }
+
+  // Skip from a token boundary to the innermost container's closing bracket
+  void start_skip_rest()
+  {
+    if (containers.empty() || (state == DoneState))
+    {
+      skip_rest_pending = false;
+      return;
+    }
+
+    if ((state == ValueState) && (containers.back().type == '{'))
+    {
+      // An object item's value is pending, it is skipped, and its
+      // end_object_item() delivered first
+      skip_pending = true;
+      return;
+    }
+
+    if ((state != ValueState) &&
+        (state != FirstArrayItemState) &&
+        (state != FirstObjectKeyState) &&
+        (state != ObjectKeyState) &&
+        (state != AfterValueState))
+    {
+      // Still within that value
+      return;
+    }
+
+    skip_rest_pending = false;
+    skip_pending = false;
+    skip_container = true;
+    skip_depth = 1;
+    skip_in_string = false;
+    skip_escape = false;
+    state = SkipState;
+  }
+
+  // Called once any value is complete
+  bool value_done()
+  {
+    if (containers.empty())
+    {
+      state = DoneState;
+      return true;
+    }
+
+    state = AfterValueState;
+    if (containers.back().type == '{')
+    {
+      return ctx.end_object_item();
+    }
+    return true;
+  }
+
+  bool end_array()
+  {
+    auto count = containers.back().count;
+    containers.pop_back();
+    return (ctx.parse_array_stop(count) && value_done());
+  }
+
+  bool end_object()
+  {
+    containers.pop_back();
+    return (ctx.parse_object_stop() && value_done());
+  }
+
+  bool start_literal(const char* _literal)
+  {
+    literal = _literal;
+    literal_idx = 1;
+    state = LiteralState;
+    return true;
+  }
+
+  bool end_literal()
+  {
+    bool ok = false;
+    switch (literal[0])
+    {
+      case 't':
+        ok = ctx.set_bool(true);
+        break;
+      case 'f':
+        ok = ctx.set_bool(false);
+        break;
+      default:
+        ok = ctx.set_null();
+        break;
+    }
+
+    literal = nullptr;
+    return (ok && value_done());
+  }
+
+  bool end_number()
+  {
+    // Scanned once here, the context converts it for its field
+    FlatbuffersStreamingJsonNumber number;
+    if (!flatbuffers_streaming_json_scan_number(stx::string_view(token.data(), token.size()), number))
+    {
+      return false;
+    }
+    return (ctx.set_raw_number(number) && value_done());
+  }
+
+  void start_string(bool _is_key)
+  {
+    is_key = _is_key;
+    escape_state = NoEscape;
+    token.clear();
+    state = StringState;
+  }
+
+  bool end_string()
+  {
+    if (is_key)
+    {
+      // Hold the key until its ':' is seen
+      key.swap(token);
+      state = ColonState;
+      return true;
+    }
+
+    auto s = stx::string_view(token.data(), token.size());
+    if (string_view_data != nullptr)
+    {
+      // Into the input, still valid until feed() returns
+      s = stx::string_view(string_view_data, string_view_size);
+      string_view_data = nullptr;
+    }
+
+    return (
+      ctx.set_string(s) &&
+      value_done()
+    );
+  }
+
+  bool consume_string(char ch)
+  {
+    switch (escape_state)
+    {
+      case NoEscape:
+        if (ch == '"')
+        {
+          return end_string();
+        }
+
+        if (ch == '\\')
+        {
+          escape_state = Escape;
+          return true;
+        }
+
+        if ((ch >= 0) && (ch < 0x20))
+        {
+          // Control characters must be escaped
+          return false;
+        }
+
+        token.push_back(ch);
+        return true;
+
+      case Escape:
+        escape_state = NoEscape;
+        switch (ch)
+        {
+          case '"':  token.push_back('"');  return true;
+          case '\\': token.push_back('\\'); return true;
+          case '/':  token.push_back('/');  return true;
+          case 'b':  token.push_back('\b'); return true;
+          case 'f':  token.push_back('\f'); return true;
+          case 'n':  token.push_back('\n'); return true;
+          case 'r':  token.push_back('\r'); return true;
+          case 't':  token.push_back('\t'); return true;
+          case 'u':
+            escape_state = UnicodeHex;
+            hex_digits = 0;
+            code_unit = 0;
+            high_surrogate = 0;
+            return true;
+          default:
+            return false;
+        }
+
+      case UnicodeHex:
+        return consume_hex(ch);
+
+      case SurrogateBackslash:
+        if (ch != '\\')
+        {
+          return false;
+        }
+        escape_state = SurrogateU;
+        return true;
+
+      case SurrogateU:
+        if (ch != 'u')
+        {
+          return false;
+        }
+        escape_state = UnicodeHex;
+        hex_digits = 0;
+        code_unit = 0;
+        return true;
+    }
+
+    return false;
+  }
+
+  bool consume_hex(char ch)
+  {
+    int v = -1;
+    if ((ch >= '0') && (ch <= '9'))
+    {
+      v = ch - '0';
+    }
+    else if ((ch >= 'a') && (ch <= 'f'))
+    {
+      v = ch - 'a' + 10;
+    }
+    else if ((ch >= 'A') && (ch <= 'F'))
+    {
+      v = ch - 'A' + 10;
+    }
+
+    if (v < 0)
+    {
+      return false;
+    }
+
+    code_unit = (code_unit << 4) | v;
+    hex_digits++;
+    if (hex_digits < 4)
+    {
+      return true;
+    }
+
+    uint32_t uni_ch = code_unit;
+    if (high_surrogate != 0)
+    {
+      // Second half of a surrogate pair
+      if ((code_unit < 0xdc00) || (0xdfff < code_unit))
+      {
+        return false;
+      }
+      uni_ch = ((((high_surrogate - 0xd800) << 10) | ((code_unit - 0xdc00) & 0x3ff)) + 0x10000);
+      high_surrogate = 0;
+    }
+    else if ((0xd800 <= code_unit) && (code_unit <= 0xdbff))
+    {
+      high_surrogate = code_unit;
+      escape_state = SurrogateBackslash;
+      return true;
+    }
+    else if ((0xdc00 <= code_unit) && (code_unit <= 0xdfff))
+    {
+      // Unpaired low surrogate
+      return false;
+    }
+
+    append_utf8(uni_ch);
+    escape_state = NoEscape;
+    return true;
+  }
+
+  void append_utf8(uint32_t uni_ch)
+  {
+    if (uni_ch < 0x80)
+    {
+      token.push_back(static_cast<char>(uni_ch));
+    }
+    else if (uni_ch < 0x800)
+    {
+      token.push_back(static_cast<char>(0xc0 | (uni_ch >> 6)));
+      token.push_back(static_cast<char>(0x80 | (uni_ch & 0x3f)));
+    }
+    else if (uni_ch < 0x10000)
+    {
+      token.push_back(static_cast<char>(0xe0 | (uni_ch >> 12)));
+      token.push_back(static_cast<char>(0x80 | ((uni_ch >> 6) & 0x3f)));
+      token.push_back(static_cast<char>(0x80 | (uni_ch & 0x3f)));
+    }
+    else {
+      token.push_back(static_cast<char>(0xf0 | (uni_ch >> 18)));
+      token.push_back(static_cast<char>(0x80 | ((uni_ch >> 12) & 0x3f)));
+      token.push_back(static_cast<char>(0x80 | ((uni_ch >> 6) & 0x3f)));
+      token.push_back(static_cast<char>(0x80 | (uni_ch & 0x3f)));
+    }
+  }
+
+  void set_error(const char* near, size_t len)
+  {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "syntax error at byte %u", (unsigned)position);
+    err = buf;
+    if ((near != nullptr) && (len > 0))
+    {
+      err += " near: ";
+      err.append(near, std::min<size_t>(len, 16));
+    }
+    state = ErrorState;
+  }
+
+  Context& ctx;
+
+  State state = ValueState;
+  std::vector<Container> containers;
+
+  // Current string or number, and the pending object key
+  std::string token;
+  std::string key;
+  bool is_key = false;
+
+  // The current string, when it is entirely within the input being fed
+  const char* string_view_data = nullptr;
+  size_t string_view_size = 0;
+
+  EscapeState escape_state = NoEscape;
+  int hex_digits = 0;
+  uint32_t code_unit = 0;
+  uint32_t high_surrogate = 0;
+
+  const char* literal = nullptr;
+  size_t literal_idx = 0;
+
+  // Skipped value state
+  bool skip_pending = false;
+  size_t skip_depth = 0;
+  bool skip_in_string = false;
+  bool skip_escape = false;
+
+  // skip_rest() of the innermost container, which is then closed as usual
+  bool skip_rest_pending = false;
+  bool skip_container = false;
+
+  bool stop_pending = false;
+
+  // Bytes consumed, for error messages and get_position()
+  size_t position = 0;
+
+  std::string err;
+};
@@ -9,14 +9,21 @@
  */
 #pragma once
 
+#include "flatbuffers_streaming_json_arena.h"
+#include "flatbuffers_streaming_json_builder.h"
+#include "flatbuffers_streaming_json_mapped_file.h"
+#include "flatbuffers_streaming_json_object_keys.h"
 #include "flatbuffers_streaming_json_parser.h"
-
-#include "picojson.h"
+#include "flatbuffers_streaming_json_path_matcher.h"
+#include "flatbuffers_streaming_json_pipeline.h"
+#include "flatbuffers_streaming_json_stats.h"
+#include "flatbuffers_streaming_json_subscription.h"
+#include "flatbuffers_streaming_json_tokenizer.h"
 
 #include "flatbuffers/idl.h"
 // read streaming JSON into dynamically built flatbuffer:
 #include "flatbuffers/reflection.h"
-// simple output to JSON string:
+// simple output to JSON string (flatbuffers_streaming_json_writer.h streams it instead):
 #include "flatbuffers/minireflect.h"
 
 #include "stx/string_view.hpp"
@@ -24,7 +31,11 @@
 #include "esp_log.h"
 
 #include <algorithm>
-#include <sstream>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <streambuf>
 #include <string>
 #include <vector>
 
@@ -40,6 +51,45 @@ is_a_subpath(
   const std::vector<std::string>& root_path
 );
 
+// Appends stream output to a string, which keeps its capacity between items
+class FlatbuffersStreamingJsonStringBuf
+: public std::streambuf
+{
+public:
+  FlatbuffersStreamingJsonStringBuf(std::string& _str)
+  : str(_str)
+  {
+  }
+
+protected:
+  int_type overflow(int_type ch) override
+  {
+    if (!traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+      str.push_back(traits_type::to_char_type(ch));
+    }
+    return traits_type::not_eof(ch);
+  }
+
+  std::streamsize xsputn(const char* s, std::streamsize n) override
+  {
+    str.append(s, n);
+    return n;
+  }
+
+private:
+  std::string& str;
+};
+
+enum class FlatbuffersStreamingJsonBuildMode
+{
+  // Re-serialize each matched item as JSON text, then use flatbuffers::Parser
+  ReserializeJson,
+
+  // Build each matched item directly from the JSON events, using reflection
+  DirectBuilder,
+};
+
 template<typename MessageT, typename ErrorT>
 class FlatbuffersStreamingJsonVisitor
 {
@@ -50,111 +100,638 @@ private:
   // do include space for null terminating byte
   const char TAG[32] = "FlatbuffersStreamingJsonVisitor";
 
-  std::vector<std::string> root_path;
-  std::function<bool(const MessageT&)> callback;
+  typedef typename MessageT::TableType MessageTableT;
+  typedef typename ErrorT::TableType ErrorTableT;
 
-  std::vector<std::string> error_path;
-  std::function<bool(const ErrorT&)> errback;
+  // Each subscription's path is compiled into path_matcher with the same id
+  std::vector<std::unique_ptr<FlatbuffersStreamingJsonSubscription>> subscriptions;
+  std::vector<const reflection::Object*> subscription_tables;
 
   FlatbuffersStreamingJsonParser& flatbuffers_parser;
+  FlatbuffersStreamingJsonBuilder flatbuffers_builder;
+
+  FlatbuffersStreamingJsonBuildMode build_mode;
 
   bool is_parse_error = false;
 
-  // Trigger errback instead of callback when error path matches
-  bool is_error_path = false;
+  // Requested by a callback, the segment begun after it is not continued
+  bool stop_requested = false;
+  bool skip_rest_requested = false;
+
+  // The subscription which claimed the item being emitted
+  size_t active_subscription = FlatbuffersStreamingJsonPathMatcher::npos;
 
   // Input parsing state
   int object_depth = 0;
   int array_depth = 0;
   int object_idx = 0;
   int array_idx = 0;
-  std::vector<std::string> current_path;
-  std::string current_key;
+  std::vector<int> array_idx_stack;
+
+  // Compiled subscription paths, tracking the current key path
+  FlatbuffersStreamingJsonPathMatcher path_matcher;
 
   // Output state
-  std::ostringstream ss;
+  std::string item_json;
+  FlatbuffersStreamingJsonStringBuf item_json_buf;
+  std::ostream ss;
   bool emit_json = false;
   bool needs_close_array = false;
   bool needs_close_object = false;
 
+  // Keys of the objects in a (flexbuffer) field's value, when re-serialized:
+  // flatbuffers::Parser asserts on a duplicate or NUL key there, rather
+  // than failing the item, so those are checked before it sees them.
+  // The depth is of the object holding the field, or -1 outside of one
+  FlatbuffersStreamingJsonObjectKeys flexbuffer_keys;
+  int flexbuffer_object_depth = -1;
+  bool flexbuffer_keys_ok = true;
+
+  // Direct builder state
+  bool build_ok = false;
+
+  // The generated decoder of the item being emitted, if its subscription has one
+  FlatbuffersStreamingJsonDecoder* active_decoder = nullptr;
+
+  // Where the active item began, to split its array value into segments
+  int item_object_depth = 0;
+  int item_array_depth = 0;
+  std::string item_key;
+
+  // The subscription whose shared batch the builder holds, if any
+  size_t shared_batch_subscription = FlatbuffersStreamingJsonPathMatcher::npos;
+
+  // Backs the direct builder's buffer, reset after each item (or batch)
+  FlatbuffersStreamingJsonArena* arena = nullptr;
+
+  // Dispatches items on another task, when set
+  FlatbuffersStreamingJsonPipeline* pipeline = nullptr;
+
   // Reflection state
-  const reflection::Object* reflection_table = nullptr;
+  const FlatbuffersStreamingJsonSchemaIndex& schema_index;
+  const FlatbuffersStreamingJsonSchemaIndex::Table* reflection_table = nullptr;
+
+  // State saved by begin_object_item, restored by end_object_item
+  struct ObjectItemState
+  {
+    const FlatbuffersStreamingJsonSchemaIndex::Table* reflection_table_prev;
+    bool keyed_vector_table_found;
+    bool needs_close_array_prev;
+    bool needs_close_object_prev;
+  };
+  std::vector<ObjectItemState> object_item_stack;
+
+  // Incremental input
+  FlatbuffersStreamingJsonTokenizer<FlatbuffersStreamingJsonVisitor> tokenizer;
+
+  // Block size for reading from a stream
+  static constexpr size_t read_buffer_size = 512;
+  std::vector<char> read_buffer;
+
+  // Only updated when compiled with FLATBUFFERS_STREAMING_JSON_STATS
+  FlatbuffersStreamingJsonStats stats;
 
 public:
   FlatbuffersStreamingJsonVisitor(
-    FlatbuffersStreamingJsonParser& _flatbuffers_parser
+    FlatbuffersStreamingJsonParser& _flatbuffers_parser,
+    FlatbuffersStreamingJsonBuildMode _build_mode=FlatbuffersStreamingJsonBuildMode::ReserializeJson,
+    FlatbuffersStreamingJsonArena* _arena=nullptr
   )
   : flatbuffers_parser(_flatbuffers_parser)
+  , flatbuffers_builder(_flatbuffers_parser, _arena)
+  , build_mode(_build_mode)
+  , item_json_buf(item_json)
+  , ss(&item_json_buf)
+  , arena(_arena)
+  , schema_index(_flatbuffers_parser.get_schema_index())
+  , tokenizer(*this)
   {
   }
 
+  // Allocate scratch state up front, for the largest expected item,
+  // so that it does not grow (and fragment the heap) during a long stream
+  void reserve(
+    size_t item_size,
+    size_t string_size,
+    size_t depth)
+  {
+    item_json.reserve(item_size);
+    object_item_stack.reserve(depth);
+    tokenizer.reserve(string_size, depth);
+    flatbuffers_builder.reserve(depth, depth * 8, item_size);
+    read_buffer.resize(read_buffer_size);
+  }
+
   void clear()
   {
+    // Items left queued by an unfinished stream are delivered first
+    if (pipeline != nullptr)
+    {
+      pipeline->flush();
+    }
+
     // Reset error state
     is_parse_error = false;
+    stop_requested = false;
+    skip_rest_requested = false;
 
-    // Trigger errback instead of callback when error path matches
-    is_error_path = false;
+    for (auto& subscription : subscriptions)
+    {
+      subscription->clear_stream();
+    }
+
+    active_subscription = FlatbuffersStreamingJsonPathMatcher::npos;
 
     // Input parsing state
     object_depth = 0;
     array_depth = 0;
     object_idx = 0;
     array_idx = 0;
-    current_path.clear();
-    current_key.clear();
+    array_idx_stack.clear();
+    path_matcher.reset();
+    object_item_stack.clear();
+    tokenizer.clear();
 
     // Output state
-    ss.str("");
+    item_json.clear();
     emit_json = false;
     needs_close_array = false;
     needs_close_object = false;
+    flexbuffer_keys.clear();
+    flexbuffer_object_depth = -1;
+    flexbuffer_keys_ok = true;
+
+    // Direct builder state
+    build_ok = false;
+    active_decoder = nullptr;
+    shared_batch_subscription = FlatbuffersStreamingJsonPathMatcher::npos;
+    flatbuffers_builder.clear();
+    if (arena != nullptr)
+    {
+      flatbuffers_builder.release();
+      arena->reset();
+    }
 
     // Reflection state
-    reflection_table = flatbuffers_parser.get_flatbuffers_root_table();;
+    reflection_table = schema_index.get_root_table();
+  }
+
+  // Accumulated across streams, until reset_stats()
+  // The parser phases are in flatbuffers_parser.get_stats()
+  const FlatbuffersStreamingJsonStats& get_stats() const
+  {
+    return stats;
+  }
+
+  void reset_stats()
+  {
+    stats.clear();
+  }
+
+  bool is_direct_build() const
+  {
+    return (build_mode == FlatbuffersStreamingJsonBuildMode::DirectBuilder);
+  }
+
+  // The current item is built from the JSON events, not re-serialized
+  bool is_event_build() const
+  {
+    return (is_direct_build() || (active_decoder != nullptr));
+  }
+
+  // Register an item path, its type, and its callback.
+  // All subscriptions are dispatched during the same pass,
+  // the first registered path which matches a key claims its whole subtree
+  template<typename ObjT>
+  size_t subscribe(
+    const std::vector<std::string>& path,
+    std::function<bool(const ObjT&)> callback)
+  {
+    return add_subscription(
+      new FlatbuffersStreamingJsonTypedSubscription<ObjT>(path, callback));
+  }
+
+  template<typename ObjT>
+  size_t subscribe(
+    const std::vector<std::string>& path,
+    std::function<bool(const typename ObjT::TableType*)> table_callback)
+  {
+    return add_subscription(
+      new FlatbuffersStreamingJsonTypedSubscription<ObjT>(path, table_callback));
+  }
+
+  // Deliver verified items together, up to max_items or max_bytes at a time.
+  // The tables point into the batch, and are only valid during the callback
+  template<typename ObjT>
+  size_t subscribe_batched(
+    const std::vector<std::string>& path,
+    size_t max_items,
+    size_t max_bytes,
+    std::function<bool(const FlatbuffersStreamingJsonBatch<typename ObjT::TableType>&)> batch_callback)
+  {
+    return add_subscription(
+      new FlatbuffersStreamingJsonBatchedSubscription<typename ObjT::TableType>(
+        path, max_items, max_bytes, batch_callback));
+  }
+
+  // Write verified items to a sink as size-prefixed flatbuffers, e.g. to a
+  // file or socket, to be read back with FlatbuffersStreamingJsonStreamReader.
+  // The buffer is only valid during the write
+  template<typename ObjT>
+  size_t subscribe_sink(
+    const std::vector<std::string>& path,
+    std::function<bool(const uint8_t*, size_t)> write)
+  {
+    return add_subscription(
+      new FlatbuffersStreamingJsonSinkSubscription<typename ObjT::TableType>(path, write));
+  }
+
+#ifndef ESP_PLATFORM
+  // Append verified items to a preallocated, mapped output file.
+  // Fails an item once the file's capacity is used up
+  template<typename ObjT>
+  size_t subscribe_sink(
+    const std::vector<std::string>& path,
+    FlatbuffersStreamingJsonMappedOutput& output)
+  {
+    return subscribe_sink<ObjT>(path, [&output](const uint8_t* buf, size_t len)
+    {
+      return output.write(buf, len);
+    });
+  }
+#endif
+
+  // Build items into one flatbuffer per batch, sharing repeated strings and
+  // identical vtables, and deliver up to max_items or max_bytes at a time.
+  // Needs the direct builder. The tables point into the batch,
+  // and are only valid during the callback
+  template<typename ObjT>
+  size_t subscribe_shared_batch(
+    const std::vector<std::string>& path,
+    size_t max_items,
+    size_t max_bytes,
+    std::function<bool(const FlatbuffersStreamingJsonSharedBatch<typename ObjT::TableType>&)> batch_callback)
+  {
+    return add_subscription(
+      new FlatbuffersStreamingJsonSharedBatchSubscription<typename ObjT::TableType>(
+        path, max_items, max_bytes, batch_callback));
+  }
+
+  // Decode items straight into ObjT, with the generated decoder for its table
+  // (see tools/flatbuffers_streaming_json_gen), in either build mode
+  template<typename ObjT>
+  size_t subscribe_decoded(
+    const std::vector<std::string>& path,
+    std::function<bool(const ObjT&)> callback)
+  {
+    return add_subscription(
+      new FlatbuffersStreamingJsonDecodedSubscription<ObjT>(path, callback));
+  }
+
+  // Capture items with no schema (e.g. dynamic JSON) into a flexbuffer,
+  // in either build mode. The buffer is only valid during the callback
+  size_t subscribe_flexbuffer(
+    const std::vector<std::string>& path,
+    std::function<bool(const uint8_t*, size_t)> callback)
+  {
+    return add_subscription(
+      new FlatbuffersStreamingJsonFlexBufferSubscription(path, callback));
+  }
+
+  // Deliver a subscription's items in segments when their value is an array,
+  // so memory is bounded by the segment instead of the whole item: each is a
+  // whole item with the next run of elements, at most max_elements of them,
+  // ending once the item has grown to max_bytes (0 for no limit).
+  // Only for subscriptions with a non-empty path
+  bool set_segment_limits(
+    size_t subscription,
+    size_t max_elements,
+    size_t max_bytes)
+  {
+    if (subscription >= subscriptions.size())
+    {
+      return false;
+    }
+
+    subscriptions[subscription]->set_segment_limits(max_elements, max_bytes);
+    return true;
+  }
+
+  // Items are then parsed or verified, and delivered, on the pipeline's task.
+  // finish() waits for them, so callbacks have all run once it returns
+  void set_pipeline(FlatbuffersStreamingJsonPipeline* _pipeline)
+  {
+    pipeline = _pipeline;
+  }
+
+  void clear_subscriptions()
+  {
+    // Queued items still refer to their subscriptions
+    if (pipeline != nullptr)
+    {
+      pipeline->flush();
+    }
+
+    subscriptions.clear();
+    subscription_tables.clear();
+    path_matcher.clear();
   }
 
+  // Parse using the registered subscriptions
+  bool parse_stream(
+    const std::istream& resp
+  )
+  {
+    begin_stream();
+    return parse_json_stream(resp);
+  }
+
+  // Replaces any registered subscriptions with root_path and error_path
   bool parse_stream(
     const std::istream& resp,
-    const std::vector<std::string>& _root_path={},
-    std::function<bool(const MessageT&)> _callback=nullptr,
+    const std::vector<std::string>& _root_path,
+    std::function<bool(const MessageT&)> _callback,
     const std::vector<std::string>& _error_path={},
     std::function<bool(const ErrorT&)> _errback=nullptr
   )
   {
-    std::string err;
+    begin_stream(_root_path, _callback, _error_path, _errback);
+    return parse_json_stream(resp);
+  }
 
+  // Zero-copy variant, callbacks receive the verified root table directly.
+  // It points into the builder, and is only valid during the callback
+  bool parse_stream(
+    const std::istream& resp,
+    const std::vector<std::string>& _root_path,
+    std::function<bool(const MessageTableT*)> _table_callback,
+    const std::vector<std::string>& _error_path={},
+    std::function<bool(const ErrorTableT*)> _table_errback=nullptr
+  )
+  {
+    begin_stream(_root_path, _table_callback, _error_path, _table_errback);
+    return parse_json_stream(resp);
+  }
+
+  // Parse a whole document in memory, e.g. a FlatbuffersStreamingJsonMappedInput,
+  // in place: it is lexed straight from the mapping, without a copy
+  bool parse_buffer(const char* data, size_t len)
+  {
+    begin_stream();
+    return parse_json_buffer(data, len);
+  }
+
+  // Replaces any registered subscriptions with root_path and error_path
+  bool parse_buffer(
+    const char* data,
+    size_t len,
+    const std::vector<std::string>& _root_path,
+    std::function<bool(const MessageT&)> _callback,
+    const std::vector<std::string>& _error_path={},
+    std::function<bool(const ErrorT&)> _errback=nullptr
+  )
+  {
+    begin_stream(_root_path, _callback, _error_path, _errback);
+    return parse_json_buffer(data, len);
+  }
+
+  // Zero-copy variant, callbacks receive the verified root table directly.
+  // It points into the builder, and is only valid during the callback
+  bool parse_buffer(
+    const char* data,
+    size_t len,
+    const std::vector<std::string>& _root_path,
+    std::function<bool(const MessageTableT*)> _table_callback,
+    const std::vector<std::string>& _error_path={},
+    std::function<bool(const ErrorTableT*)> _table_errback=nullptr
+  )
+  {
+    begin_stream(_root_path, _table_callback, _error_path, _table_errback);
+    return parse_json_buffer(data, len);
+  }
+
+  // Incremental parsing, for input arriving in chunks (e.g. from a socket):
+  // call begin_stream(), then feed() each chunk as it arrives, then finish().
+  // Each callback fires as soon as its item is complete
+  void begin_stream()
+  {
     // Reset existing state
     clear();
+  }
 
-    root_path = _root_path;
-    callback = _callback;
-    error_path = _error_path;
-    errback = _errback;
+  void begin_stream(
+    const std::vector<std::string>& _root_path,
+    std::function<bool(const MessageT&)> _callback,
+    const std::vector<std::string>& _error_path={},
+    std::function<bool(const ErrorT&)> _errback=nullptr
+  )
+  {
+    clear_subscriptions();
 
-    picojson::_parse(
-      *this,
-      std::istreambuf_iterator<char>(resp.rdbuf()),
-      std::istreambuf_iterator<char>(),
-      &err);
+    // Check for error path first
+    if (_errback)
+    {
+      subscribe<ErrorT>(_error_path, _errback);
+    }
+    subscribe<MessageT>(_root_path, _callback);
+
+    begin_stream();
+  }
+
+  void begin_stream(
+    const std::vector<std::string>& _root_path,
+    std::function<bool(const MessageTableT*)> _table_callback,
+    const std::vector<std::string>& _error_path={},
+    std::function<bool(const ErrorTableT*)> _table_errback=nullptr
+  )
+  {
+    clear_subscriptions();
+
+    // Check for error path first
+    if (_table_errback)
+    {
+      subscribe<ErrorT>(_error_path, _table_errback);
+    }
+    subscribe<MessageT>(_root_path, _table_callback);
+
+    begin_stream();
+  }
+
+  size_t add_subscription(FlatbuffersStreamingJsonSubscription* subscription)
+  {
+    subscriptions.emplace_back(subscription);
+
+    // Resolve the root table for the direct builder once, up front
+    subscription_tables.push_back(
+      flatbuffers_parser.get_flatbuffers_table(subscription->get_table_name()));
+
+    return path_matcher.add_path(subscription->get_path());
+  }
+
+  // From a callback, on the parsing task (not with a pipeline): start no
+  // more items and consume no more input, so feed() and parse_stream()
+  // return right after the callback does. finish() then succeeds without
+  // the rest of the input, still delivering any batches already built
+  void stop()
+  {
+    stop_requested = true;
+    tokenizer.stop();
+  }
+
+  // From a callback: skip the rest of the array or object enclosing the
+  // item, e.g. the remaining elements of a segmented array, or the keys
+  // after the item's own
+  void skip_rest()
+  {
+    skip_rest_requested = true;
+    tokenizer.skip_rest();
+  }
+
+  bool is_stopped() const
+  {
+    return tokenizer.is_stopped();
+  }
+
+  // Bytes of input consumed since begin_stream(). Once stopped, the input
+  // after this is left unread
+  size_t get_position() const
+  {
+    return tokenizer.get_position();
+  }
+
+  // Chunks may be split anywhere, returns false once the JSON is invalid
+  bool feed(const char* data, size_t len)
+  {
+#if FLATBUFFERS_STREAMING_JSON_STATS
+    // Lexing is whatever remains, once the nested phases are taken out
+    auto nested_cycles_prev = stats.serialize_cycles + stats.process_cycles;
+    auto start = flatbuffers_streaming_json_cycles();
+
+    bool ok = tokenizer.feed(data, len);
+
+    uint64_t elapsed = flatbuffers_streaming_json_cycles() - start;
+    auto nested_cycles = (stats.serialize_cycles + stats.process_cycles) - nested_cycles_prev;
+    stats.lex_cycles += (elapsed > nested_cycles)? (elapsed - nested_cycles) : 0;
+    stats.bytes_consumed += len;
+    return ok;
+#else
+    return tokenizer.feed(data, len);
+#endif
+  }
+
+  // The input is complete, returns false if it or any item was invalid
+  bool finish()
+  {
+    bool ok = tokenizer.finish();
+    if (!ok)
+    {
+      ESP_LOGE(TAG, "Unable to parse JSON response, err = %s", tokenizer.get_error().c_str());
+    }
 
-    if (!err.empty())
+    if (!flush_shared_batch())
     {
-      ESP_LOGE(TAG, "Unable to parse JSON response, err = %s", err.c_str());
+      is_parse_error = true;
+    }
+
+    // Wait for queued items, and whether they were delivered
+    if ((pipeline != nullptr) && !pipeline->flush())
+    {
+      is_parse_error = true;
+    }
+
+    // Deliver any partial batches, on this task
+    for (auto& subscription : subscriptions)
+    {
+      if (!subscription->finish_stream())
+      {
+        is_parse_error = true;
+      }
     }
 
     return (
-      (err.empty() == true) &&
+      (ok == true) &&
       (is_parse_error == false)
     );
   }
 
+  // Read the stream in blocks, instead of per-character via istreambuf_iterator
+  bool parse_json_stream(
+    const std::istream& resp
+  )
+  {
+    auto buf = resp.rdbuf();
+    if (buf == nullptr)
+    {
+      return false;
+    }
+
+    read_buffer.resize(read_buffer_size);
+
+    bool ok = true;
+    while (ok)
+    {
+      // Take whatever is already buffered, so items are delivered promptly.
+      // Otherwise block for 1 byte, which refills the streambuf's own buffer
+      auto avail = buf->in_avail();
+      if (avail < 0)
+      {
+        break;
+      }
+
+      auto len = buf->sgetn(
+        read_buffer.data(),
+        std::min<std::streamsize>(std::max<std::streamsize>(avail, 1), read_buffer.size()));
+      if (len <= 0)
+      {
+        break;
+      }
+
+      auto position = tokenizer.get_position();
+      ok = feed(read_buffer.data(), len);
+
+      if (tokenizer.is_stopped())
+      {
+        // Leave the rest of the stream for the caller, as far as the
+        // streambuf can put it back
+        auto unread = static_cast<size_t>(len) - (tokenizer.get_position() - position);
+        for (; unread > 0; --unread)
+        {
+          if (buf->sungetc() == std::char_traits<char>::eof())
+          {
+            break;
+          }
+        }
+        break;
+      }
+    }
+
+    return finish();
+  }
+
+  // Parse a complete JSON document from a contiguous buffer, after begin_stream()
+  bool parse_json_buffer(const char* data, size_t len)
+  {
+    feed(data, len);
+    return finish();
+  }
+
   bool
   set_null()
   {
     if (emit_json)
     {
-      ss << "null";
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      if (active_decoder != nullptr)
+      {
+        build_ok = build_ok && active_decoder->set_null();
+      }
+      else if (is_direct_build())
+      {
+        build_ok = build_ok && flatbuffers_builder.set_null();
+      }
+      else {
+        ss << "null";
+      }
     }
     return true;
   }
@@ -164,7 +741,18 @@ public:
   {
     if (emit_json)
     {
-      ss << (b? "true" : "false");
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      if (active_decoder != nullptr)
+      {
+        build_ok = build_ok && active_decoder->set_bool(b);
+      }
+      else if (is_direct_build())
+      {
+        build_ok = build_ok && flatbuffers_builder.set_bool(b);
+      }
+      else {
+        ss << (b? "true" : "false");
+      }
     }
     return true;
   }
@@ -174,7 +762,18 @@ public:
   {
     if (emit_json)
     {
-      ss << i;
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      if (active_decoder != nullptr)
+      {
+        build_ok = build_ok && active_decoder->set_int64(i);
+      }
+      else if (is_direct_build())
+      {
+        build_ok = build_ok && flatbuffers_builder.set_int64(i);
+      }
+      else {
+        ss << i;
+      }
     }
     return true;
   }
@@ -184,43 +783,173 @@ public:
   {
     if (emit_json)
     {
-      //ss << d;
-      ss << (int)(d);
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      if (active_decoder != nullptr)
+      {
+        build_ok = build_ok && active_decoder->set_number(d);
+      }
+      else if (is_direct_build())
+      {
+        build_ok = build_ok && flatbuffers_builder.set_number(d);
+      }
+      else {
+        // Enough digits to round-trip, as the field may be a double
+        char buf[32];
+        auto n = snprintf(buf, sizeof(buf), "%.17g", d);
+        ss.write(buf, n);
+      }
+    }
+    return true;
+  }
+
+  // From the tokenizer, converted once by the builder or decoder for the
+  // field's type, or re-serialized as written
+  bool
+  set_raw_number(const FlatbuffersStreamingJsonNumber& number)
+  {
+    if (emit_json)
+    {
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      if (active_decoder != nullptr)
+      {
+        build_ok = build_ok && active_decoder->set_raw_number(number);
+      }
+      else if (is_direct_build())
+      {
+        build_ok = build_ok && flatbuffers_builder.set_raw_number(number);
+      }
+      else {
+        // Whole numbers as plain integers (e.g. 1e3, 20.0 or 1.5e1), which
+        // flatbuffers::Parser only takes for an integer field when written
+        // that way, anything else is passed on as written.
+        // In a (flexbuffer) value they stay doubles, as when built directly
+        const char real_chars[] = ".eE";
+        bool rewrite = (
+          (flexbuffer_object_depth < 0) &&
+          (std::find_first_of(
+            number.text.begin(), number.text.end(),
+            real_chars, real_chars + (sizeof(real_chars) - 1)) != number.text.end())
+        );
+
+        int64_t i = 0;
+        uint64_t u = 0;
+        if (rewrite && flatbuffers_streaming_json_number_to_integer(number, i))
+        {
+          ss << i;
+        }
+        else if (rewrite && flatbuffers_streaming_json_number_to_integer(number, u))
+        {
+          ss << u;
+        }
+        else if (!number.text.empty() && (number.text[0] == '+'))
+        {
+          ss.write(number.text.data() + 1, number.text.size() - 1);
+        }
+        else {
+          ss.write(number.text.data(), number.text.size());
+        }
+      }
+    }
+    return true;
+  }
+
+  bool
+  set_string(stx::string_view s)
+  {
+    if (emit_json)
+    {
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      if (active_decoder != nullptr)
+      {
+        build_ok = build_ok && active_decoder->set_string(s);
+      }
+      else if (is_direct_build())
+      {
+        build_ok = build_ok && flatbuffers_builder.set_string(s);
+      }
+      else {
+        write_json_string(s);
+      }
     }
     return true;
   }
 
-  template <typename Iter> bool
-  parse_string(picojson::input<Iter> &in)
+  // Strings arrive unescaped, so only those which need it are escaped again
+  void
+  write_json_string(stx::string_view s)
   {
-    std::string s;
-    auto ok = _parse_string(s, in);
-    if (emit_json)
+    ss << "\"";
+
+    size_t begin = 0;
+    for (size_t i = 0; i < s.size(); ++i)
     {
-      ss << "\"" << s << "\"";
+      auto ch = s[i];
+      if ((ch != '"') && (ch != '\\') && ((ch < 0) || (ch >= 0x20)))
+      {
+        continue;
+      }
+
+      ss.write(s.data() + begin, i - begin);
+      begin = (i + 1);
+
+      if ((ch == '"') || (ch == '\\'))
+      {
+        char escaped[2] = {'\\', ch};
+        ss.write(escaped, sizeof(escaped));
+      }
+      else {
+        char escaped[8];
+        auto n = snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(ch));
+        ss.write(escaped, n);
+      }
     }
-    return ok;
+
+    ss.write(s.data() + begin, s.size() - begin);
+    ss << "\"";
   }
 
   bool
   parse_array_start()
   {
     array_depth++;
+
+    // Resume the enclosing array's count when this one is done
+    array_idx_stack.push_back(array_idx);
     array_idx = 0;
 
     if (emit_json)
     {
-      ss << "[";
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      if (active_decoder != nullptr)
+      {
+        build_ok = build_ok && active_decoder->start_array();
+      }
+      else if (is_direct_build())
+      {
+        build_ok = build_ok && flatbuffers_builder.start_array();
+      }
+      else {
+        ss << "[";
+      }
     }
     return true;
   }
 
-  template <typename Iter> bool 
-  parse_array_item(picojson::input<Iter> &in, size_t i)
+  bool
+  begin_array_item()
   {
+    if (emit_json && (array_idx > 0) && is_segment_boundary())
+    {
+      if (split_item() == false)
+      {
+        is_parse_error = true;
+      }
+    }
+
     // print leading comma (it should have followed last parsed item)
-    if (emit_json)
+    if (emit_json && !is_event_build())
     {
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
       if (array_idx > 0)
       {
         ss << ",";
@@ -228,7 +957,7 @@ public:
     }
 
     array_idx++;
-    return _parse(*this, in);
+    return true;
   }
 
   bool
@@ -236,10 +965,26 @@ public:
   {
     array_depth--;
     array_idx = -1;
+    if (!array_idx_stack.empty())
+    {
+      array_idx = array_idx_stack.back();
+      array_idx_stack.pop_back();
+    }
 
     if (emit_json)
     {
-      ss << "]";
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      if (active_decoder != nullptr)
+      {
+        build_ok = build_ok && active_decoder->end_array();
+      }
+      else if (is_direct_build())
+      {
+        build_ok = build_ok && flatbuffers_builder.end_array();
+      }
+      else {
+        ss << "]";
+      }
     }
     return true;
   }
@@ -250,38 +995,108 @@ public:
     object_depth++;
     object_idx = 0;
 
-    // We can lookahead to the fields first in parse_object_item
+    if (flexbuffer_object_depth >= 0)
+    {
+      flexbuffer_keys.start_object();
+    }
+
+    if (emit_json && is_event_build())
+    {
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      build_ok = build_ok && (
+        (active_decoder != nullptr)?
+          active_decoder->start_object() :
+          flatbuffers_builder.start_object()
+      );
+    }
+
+    // We can lookahead to the fields first in begin_object_item
     // If needed, an object '{' will be opened there
     return true;
   }
 
-  template <typename Iter> bool
-  parse_object_item(
-    picojson::input<Iter> &in,
-    const std::string &key)
+  bool
+  begin_object_item(stx::string_view key)
   {
     // Store the previous reflection table,
     // In case we recurse into a reflection sub-table
-    auto reflection_table_prev = reflection_table;
-
-    // Check whether we used a workaround to reformat the JSON
-    // To be more flatbuffers friendly
-    bool keyed_vector_table_found = check_for_keyed_vector_table(key);
+    ObjectItemState item_state;
+    item_state.reflection_table_prev = reflection_table;
+    item_state.keyed_vector_table_found = false;
 
-    // Capture and push the current object key onto the current path
-    current_key = key;
-    current_path.push_back(current_key);
+    // Push the current object key onto the current path
+    path_matcher.push_key(key);
 
-    // Check for error path first
-    is_error_path = is_a_subpath(current_path, error_path);
+    if (!emit_json && !path_matcher.is_reachable())
+    {
+      // No subscription can match under this key, so its value is only
+      // scanned for its end, without decoding it or any reflection lookups
+      tokenizer.skip_value();
+
+      item_state.needs_close_array_prev = needs_close_array;
+      item_state.needs_close_object_prev = needs_close_object;
+      object_item_stack.push_back(item_state);
+      return true;
+    }
 
     auto emit_json_prev = emit_json;
-    // Start outputting JSON if either with error or message path
-    emit_json = (is_error_path || is_a_subpath(current_path, root_path));
+    if (!emit_json)
+    {
+      // Start outputting JSON if any subscription path matches
+      active_subscription = path_matcher.get_first_matched();
+      emit_json = (active_subscription != FlatbuffersStreamingJsonPathMatcher::npos);
+
+      if (emit_json)
+      {
+        active_decoder = subscriptions[active_subscription]->start_decoding();
+
+        item_object_depth = object_depth;
+        item_array_depth = array_depth;
+        if (subscriptions[active_subscription]->is_segmented())
+        {
+          item_key.assign(key.data(), key.size());
+        }
+      }
+    }
+
+    // Check whether we used a workaround to reformat the JSON
+    // To be more flatbuffers friendly
+    // (the direct builder and decoders handle this themselves, from the field types)
+    item_state.keyed_vector_table_found = (
+      !is_event_build() &&
+      check_for_keyed_vector_table(key)
+    );
+    bool keyed_vector_table_found = item_state.keyed_vector_table_found;
+
+    if (emit_json && !is_event_build() && schema_index.has_flexbuffer_fields())
+    {
+      check_flexbuffer_key(item_state.reflection_table_prev, key);
+    }
 
     if (emit_json)
     {
-      if (keyed_vector_table_found)
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      if (active_decoder != nullptr)
+      {
+        if (!emit_json_prev)
+        {
+          // The decoder's root object was reset when the item started
+          build_ok = true;
+        }
+
+        build_ok = build_ok && active_decoder->set_key(key);
+      }
+      else if (is_direct_build())
+      {
+        if (!emit_json_prev)
+        {
+          // Start a new item, its root table is the type to be delivered
+          build_ok = start_built_root(active_subscription);
+        }
+
+        build_ok = build_ok && flatbuffers_builder.set_key(key);
+      }
+      else if (keyed_vector_table_found)
       {
         if (!emit_json_prev)
         {
@@ -296,8 +1111,15 @@ public:
           ss << ",";
         }
 
-        // Print key with array/object indirection
-        ss << "{\"id\":\"" << key << "\",\"val\":";
+        // Print key with array/object indirection, into the keyed table's fields
+        auto keyed_table = item_state.reflection_table_prev;
+        ss << "{";
+        write_json_string(keyed_table->id_field->field->name()->c_str());
+        ss << ":";
+        write_json_string(key);
+        ss << ",";
+        write_json_string(keyed_table->val_field->field->name()->c_str());
+        ss << ":";
         needs_close_object = true;
       }
       else {
@@ -311,33 +1133,56 @@ public:
         }
 
         // Print key
-        ss << "\"" << key << "\":";
+        write_json_string(key);
+        ss << ":";
       }
     }
 
-    auto needs_close_array_prev = needs_close_array;
-    auto needs_close_object_prev = needs_close_object;
+    item_state.needs_close_array_prev = needs_close_array;
+    item_state.needs_close_object_prev = needs_close_object;
     needs_close_array = false;
     needs_close_object = false;
 
-    auto ok = _parse(*this, in);
+    object_item_stack.push_back(item_state);
+    return true;
+  }
+
+  bool
+  end_object_item()
+  {
+    // The value for this key has now been parsed
+    auto item_state = object_item_stack.back();
+    object_item_stack.pop_back();
+
+    if (emit_json && !is_event_build() && item_state.keyed_vector_table_found)
+    {
+      // Close the {"id": key, "val": value} wrapper, by any field names
+      ss << "}";
+    }
+
+    needs_close_array = item_state.needs_close_array_prev;
+    needs_close_object = item_state.needs_close_object_prev;
+    reflection_table = item_state.reflection_table_prev;
 
-    needs_close_array = needs_close_array_prev;
-    needs_close_object = needs_close_object_prev;
-    reflection_table = reflection_table_prev;
+    if (flexbuffer_object_depth == object_depth)
+    {
+      // The (flexbuffer) field's value has ended
+      flexbuffer_object_depth = -1;
+    }
 
     object_idx++;
 
     // pop the key, it has now been parsed
-    current_path.pop_back();
+    path_matcher.pop_key();
 
-    if (is_a_subpath(current_path, root_path))
+    // Keep emitting until we leave the path which started this item
+    if (path_matcher.is_matched(active_subscription))
     {
     }
     else {
       if (emit_json) // check if we were emitting
       {
-        if (keyed_vector_table_found == false)
+        if (!is_event_build() && (item_state.keyed_vector_table_found == false))
         {
           // We will be missing one of these at this point in regular parsing
           ss << "}";
@@ -348,21 +1193,48 @@ public:
           is_parse_error = true;
         }
       }
+
+      // The next item starts afresh, even as a sibling of this one
+      // (or of a segmented item cut short by its callback)
+      needs_close_array = false;
+      needs_close_object = false;
       emit_json = false;
     }
 
-    return ok;
+    return true;
   }
 
   bool
   parse_object_stop()
   {
-    current_key.clear();
-
     object_depth--;
     object_idx = -1;
 
-    if (emit_json)
+    if ((flexbuffer_object_depth >= 0) && !flexbuffer_keys.end_object())
+    {
+      flexbuffer_keys_ok = false;
+    }
+
+    if (emit_json && is_event_build())
+    {
+      if (object_depth == 0)
+      {
+        // The document root object was the item
+        if (process_item() == false)
+        {
+          is_parse_error = true;
+        }
+      }
+      else {
+        FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+        build_ok = build_ok && (
+          (active_decoder != nullptr)?
+            active_decoder->end_object() :
+            flatbuffers_builder.end_object()
+        );
+      }
+    }
+    else if (emit_json)
     {
       if (needs_close_array)
       {
@@ -373,21 +1245,20 @@ public:
       {
         // We did expect at least one of these
         ss << "}";
-
-        if (!root_path.empty())
-        {
-          // We will be missing one of these at this point in regular parsing
-          ss << "}";
-        }
         needs_close_object = false;
       }
       else {
-        ss << "}";
+        // An empty object, its '{' is only opened along with a first key
+        ss << "{}";
       }
 
       if (object_depth == 0)
       {
-        process_item();
+        // The document root object was the item
+        if (process_item() == false)
+        {
+          is_parse_error = true;
+        }
       }
     }
 
@@ -397,68 +1268,211 @@ public:
   bool
   process_item()
   {
+    FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, process);
+    FLATBUFFERS_STREAMING_JSON_STATS_MAX(stats, peak_item_json_size, item_json.size());
+
     bool ok = convert_json_stream_to_flatbuffer();
+    if (ok)
+    {
+      FLATBUFFERS_STREAMING_JSON_STATS_ADD(stats, items_emitted, 1);
+    }
+    else {
+      FLATBUFFERS_STREAMING_JSON_STATS_ADD(stats, item_failures, 1);
+    }
 
     // reset the JSON output stream
-    ss.str("");
+    item_json.clear();
+    flexbuffer_keys_ok = true;
+    active_subscription = FlatbuffersStreamingJsonPathMatcher::npos;
+    active_decoder = nullptr;
+
+    if ((arena != nullptr) &&
+        (shared_batch_subscription == FlatbuffersStreamingJsonPathMatcher::npos))
+    {
+      // The item has been delivered, release all of its storage at once
+      flatbuffers_builder.release();
+      arena->reset();
+    }
 
     return ok;
   }
 
   bool
-  check_for_keyed_vector_table(const std::string& key)
+  start_built_root(size_t subscription)
   {
-    if (reflection_table != nullptr)
+    auto table = subscription_tables[subscription];
+
+    // Another subscription's item would clear the shared batch, deliver it first
+    if ((shared_batch_subscription != FlatbuffersStreamingJsonPathMatcher::npos) &&
+        (shared_batch_subscription != subscription) &&
+        !flush_shared_batch())
+    {
+      is_parse_error = true;
+    }
+
+    if (subscriptions[subscription]->is_shared_batch())
+    {
+      shared_batch_subscription = subscription;
+      return flatbuffers_builder.start_batch_root(table);
+    }
+
+    return flatbuffers_builder.start_root(table);
+  }
+
+  // Finish the shared batch being built, and deliver its items all at once
+  bool
+  flush_shared_batch()
+  {
+    if (shared_batch_subscription == FlatbuffersStreamingJsonPathMatcher::npos)
+    {
+      return true;
+    }
+
+    auto& subscription = *subscriptions[shared_batch_subscription];
+    shared_batch_subscription = FlatbuffersStreamingJsonPathMatcher::npos;
+
+    bool ok = true;
+    if (flatbuffers_builder.get_batch_size() > 0)
+    {
+      ok = flatbuffers_builder.finish_batch();
+
+      FLATBUFFERS_STREAMING_JSON_STATS_MAX(
+        stats, peak_builder_size, flatbuffers_builder.get_size());
+
+      ok = ok && dispatch_built(subscription);
+    }
+
+    // The next batch starts from an empty buffer
+    flatbuffers_builder.clear();
+    if (arena != nullptr)
+    {
+      flatbuffers_builder.release();
+      arena->reset();
+    }
+
+    return ok;
+  }
+
+  // Between elements of the array which is the active item's value,
+  // once its segment is full
+  bool
+  is_segment_boundary() const
+  {
+    const auto& subscription = *subscriptions[active_subscription];
+    if (!subscription.is_segmented() ||
+        subscription.get_path().empty() ||
+        (object_depth != item_object_depth) ||
+        (array_depth != (item_array_depth + 1)) ||
+        object_item_stack.back().keyed_vector_table_found)
     {
-      auto fields = reflection_table->fields();
-      if (fields != nullptr)
+      return false;
+    }
+
+    size_t item_size = 0;
+    if (active_decoder != nullptr)
+    {
+      // Only limited by element count
+    }
+    else if (is_direct_build())
+    {
+      item_size = flatbuffers_builder.get_built_size();
+    }
+    else {
+      item_size = item_json.size();
+    }
+
+    return subscription.is_segment_full(static_cast<size_t>(array_idx), item_size);
+  }
+
+  // Deliver the elements so far as a whole item, then continue the array
+  // as the next item, under the same key
+  bool
+  split_item()
+  {
+    auto subscription = active_subscription;
+    skip_rest_requested = false;
+
+    {
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      if (active_decoder != nullptr)
+      {
+        build_ok = build_ok && active_decoder->end_array();
+      }
+      else if (is_direct_build())
+      {
+        build_ok = build_ok && flatbuffers_builder.end_array();
+      }
+      else {
+        ss << "]}";
+      }
+    }
+
+    bool ok = process_item();
+
+    if (stop_requested || skip_rest_requested)
+    {
+      // The array's remaining elements are not delivered
+      emit_json = false;
+      return ok;
+    }
+
+    active_subscription = subscription;
+    active_decoder = subscriptions[subscription]->start_decoding();
+
+    {
+      FLATBUFFERS_STREAMING_JSON_STATS_TIMER(stats, serialize);
+      auto key = stx::string_view(item_key.data(), item_key.size());
+      if (active_decoder != nullptr)
+      {
+        build_ok = (
+          active_decoder->set_key(key) &&
+          active_decoder->start_array()
+        );
+      }
+      else if (is_direct_build())
       {
-        auto id_field = fields->LookupByKey("id");
-        auto val_field = fields->LookupByKey("val");
+        build_ok = (
+          start_built_root(subscription) &&
+          flatbuffers_builder.set_key(key) &&
+          flatbuffers_builder.start_array()
+        );
+      }
+      else {
+        ss << "{";
+        write_json_string(key);
+        ss << ":[";
+      }
+    }
+
+    array_idx = 0;
+    return ok;
+  }
 
-        if ((id_field != nullptr) &&
-            (val_field != nullptr))
+  bool
+  check_for_keyed_vector_table(stx::string_view key)
+  {
+    if (reflection_table != nullptr)
+    {
+      if ((reflection_table->id_field != nullptr) &&
+          (reflection_table->val_field != nullptr))
+      {
+        if (reflection_table->val_field->field->type()->base_type() == reflection::Obj)
         {
-          if (val_field->type()->base_type() == reflection::Obj)
+          reflection_table = reflection_table->val_field->child;
+
+          if (reflection_table != nullptr)
           {
-            reflection_table = flatbuffers_parser.get_flatbuffers_table(
-              val_field->type()->index()
-            );
-
-            if (reflection_table != nullptr)
-            {
-              // We found a reflection structure that can be re-written
-              return true;
-            }
+            // We found a reflection structure that can be re-written
+            return true;
           }
         }
-        else {
-          auto field = fields->LookupByKey(key.c_str());
-          if (field != nullptr)
-          {
-            if (field->type()->base_type() == reflection::Obj)
-            {
-              //TODO(@paulreimer): could be a union/struct? what then?
-              reflection_table = flatbuffers_parser.get_flatbuffers_table(
-                field->type()->index()
-              );
-            }
-
-            if (field->type()->base_type() == reflection::Vector)
-            {
-              if (field->type()->element() == reflection::Obj)
-              {
-                reflection_table = flatbuffers_parser.get_flatbuffers_table(
-                  field->type()->index()
-                );
-
-                if (reflection_table != nullptr)
-                {
-                  //TODO(@paulreimer): good state, but should this be logged somehow?
-                }
-              }
-            }
-          }
+      }
+      else {
+        auto field = schema_index.get_field(reflection_table, key);
+        if ((field != nullptr) && (field->child != nullptr))
+        {
+          //TODO(@paulreimer): could be a union/struct? what then?
+          reflection_table = field->child;
         }
       }
     }
@@ -466,32 +1480,142 @@ public:
     return false;
   }
 
+  // Within a (flexbuffer) field's value, remember each object's keys,
+  // or start doing so at the field itself
+  void
+  check_flexbuffer_key(
+    const FlatbuffersStreamingJsonSchemaIndex::Table* table,
+    stx::string_view key)
+  {
+    if (flexbuffer_object_depth >= 0)
+    {
+      if (!flexbuffer_keys.add_key(key))
+      {
+        flexbuffer_keys_ok = false;
+      }
+      return;
+    }
+
+    auto field = schema_index.get_field(table, key);
+    if ((field != nullptr) && field->is_flexbuffer)
+    {
+      flexbuffer_keys.clear();
+      flexbuffer_object_depth = object_depth;
+    }
+  }
+
   bool
   convert_json_stream_to_flatbuffer()
   {
-    bool ok = false;
+#if FLATBUFFERS_STREAMING_JSON_STATS
+    // The callback is whatever remains of dispatching, after the parser phases
+    const auto& parser_stats = flatbuffers_parser.get_stats();
+    auto parser_cycles_prev =
+      parser_stats.parse_cycles + parser_stats.verify_cycles + parser_stats.unpack_cycles;
+    auto start = flatbuffers_streaming_json_cycles();
+
+    bool ok = dispatch_item();
+
+    uint64_t elapsed = flatbuffers_streaming_json_cycles() - start;
+    auto parser_cycles = (
+      parser_stats.parse_cycles + parser_stats.verify_cycles + parser_stats.unpack_cycles
+    ) - parser_cycles_prev;
+    stats.callback_cycles += (elapsed > parser_cycles)? (elapsed - parser_cycles) : 0;
+    return ok;
+#else
+    return dispatch_item();
+#endif
+  }
+
+  bool
+  dispatch_item()
+  {
+    auto& subscription = *subscriptions[active_subscription];
+
+    if (active_decoder != nullptr)
+    {
+      // The item was already decoded into the subscription's object
+      bool ok = build_ok;
+      build_ok = false;
+
+      return (ok && subscription.dispatch_decoded());
+    }
 
-    if (is_error_path)
+    if (is_direct_build() && subscription.is_shared_batch())
     {
-      ErrorT error;
-      ok = flatbuffers_parser.parse<ErrorT>(ss.str(), error);
-      if (ok)
+      // The item stays in the builder, with the rest of its batch
+      bool ok = build_ok && flatbuffers_builder.end_batch_root();
+      build_ok = false;
+
+      if (subscription.is_shared_batch_full(
+            flatbuffers_builder.get_batch_size(),
+            flatbuffers_builder.get_built_size()))
       {
-        // Trigger the errback
-        ok = errback(error);
+        ok = flush_shared_batch() && ok;
       }
+
+      return ok;
     }
-    else {
-      MessageT message;
-      ok = flatbuffers_parser.parse<MessageT>(ss.str(), message);
-      if (ok)
+
+    if (is_direct_build())
+    {
+      // The item was already built, it only needs to be finished
+      bool ok = build_ok && flatbuffers_builder.finish_root(subscription.is_size_prefixed());
+      build_ok = false;
+
+      FLATBUFFERS_STREAMING_JSON_STATS_MAX(
+        stats, peak_builder_size, flatbuffers_builder.get_size());
+
+      return (ok && dispatch_built(subscription));
+    }
+
+    if (!flexbuffer_keys_ok)
+    {
+      ESP_LOGE(TAG, "Item not parsed, for a key in its (flexbuffer) value");
+      return false;
+    }
+
+    if (pipeline != nullptr)
+    {
+      if (pipeline->can_submit(item_json.size()))
       {
-        // Trigger the callback
-        ok = callback(message);
+        return pipeline->submit(
+          &subscription,
+          FlatbuffersStreamingJsonPipeline::JsonItem,
+          reinterpret_cast<const uint8_t*>(item_json.data()),
+          item_json.size());
       }
+
+      pipeline->wait_idle();
     }
 
-    return ok;
+    return subscription.dispatch_json(flatbuffers_parser, item_json);
+  }
+
+  // Deliver the builder's finished buffer
+  bool
+  dispatch_built(FlatbuffersStreamingJsonSubscription& subscription)
+  {
+    if (pipeline != nullptr)
+    {
+      if (pipeline->can_submit(flatbuffers_builder.get_size()))
+      {
+        // Verified and delivered on the pipeline's task, from its copy
+        return pipeline->submit(
+          &subscription,
+          FlatbuffersStreamingJsonPipeline::BufferItem,
+          flatbuffers_builder.get_buffer_pointer(),
+          flatbuffers_builder.get_size());
+      }
+
+      // Too large for the ring, delivered here in order instead
+      pipeline->wait_idle();
+    }
+
+    return subscription.dispatch_buffer(
+      flatbuffers_parser,
+      flatbuffers_builder.get_buffer_pointer(),
+      flatbuffers_builder.get_size());
   }
 };
 
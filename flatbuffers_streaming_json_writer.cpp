@@ -0,0 +1,531 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers_streaming_json_writer.h"
+
+#include "esp_log.h"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr char FlatbuffersStreamingJsonWriter::TAG[];
+constexpr size_t FlatbuffersStreamingJsonWriter::max_depth;
+
+static inline bool
+is_plain_char(uint8_t ch)
+{
+  return ((ch >= 0x20) && (ch != '"') && (ch != '\\'));
+}
+
+FlatbuffersStreamingJsonWriter::FlatbuffersStreamingJsonWriter(
+  const FlatbuffersStreamingJsonCompiledSchema& _compiled_schema
+)
+: compiled_schema(_compiled_schema)
+, schema_index(_compiled_schema.get_schema_index())
+{
+}
+
+bool
+FlatbuffersStreamingJsonWriter::start(
+  const uint8_t* buf,
+  const reflection::Object* object
+)
+{
+  depth = 0;
+  pending_size = 0;
+  pending_pos = 0;
+  text = nullptr;
+  started = false;
+  error = false;
+
+  if (buf == nullptr)
+  {
+    ESP_LOGE(TAG, "No flatbuffer to write as JSON");
+    return false;
+  }
+
+  if (object == nullptr)
+  {
+    object = compiled_schema.get_flatbuffers_root_table();
+  }
+
+  auto table = schema_index.get_table(object);
+  if ((table == nullptr) || table->object->is_struct())
+  {
+    ESP_LOGE(TAG, "Table to write not found in binary flatbuffer schema");
+    return false;
+  }
+
+  started = true;
+  auto root = (buf + flatbuffers::ReadScalar<flatbuffers::uoffset_t>(buf));
+  return push(TableFrame, table, root, nullptr, 0);
+}
+
+size_t
+FlatbuffersStreamingJsonWriter::write(char* out, size_t len)
+{
+  if (!started || error)
+  {
+    return 0;
+  }
+
+  size_t n = 0;
+  while (n < len)
+  {
+    if (pending_pos < pending_size)
+    {
+      auto count = std::min(len - n, pending_size - pending_pos);
+      memcpy(out + n, pending + pending_pos, count);
+      pending_pos += count;
+      n += count;
+    }
+    else if (text != nullptr)
+    {
+      n += write_text(out + n, len - n);
+    }
+    else if (depth == 0)
+    {
+      break;
+    }
+    else if (!step())
+    {
+      error = true;
+      break;
+    }
+  }
+  return n;
+}
+
+bool
+FlatbuffersStreamingJsonWriter::write(
+  char* chunk,
+  size_t chunk_size,
+  const std::function<bool(const char*, size_t)>& sink
+)
+{
+  while (!is_done())
+  {
+    auto n = write(chunk, chunk_size);
+    if (n == 0)
+    {
+      // An error, or nothing started
+      return false;
+    }
+
+    if (!sink(chunk, n))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonWriter::is_done() const
+{
+  return (
+    started &&
+    !error &&
+    (depth == 0) &&
+    (text == nullptr) &&
+    (pending_pos == pending_size)
+  );
+}
+
+bool
+FlatbuffersStreamingJsonWriter::has_error() const
+{
+  return error;
+}
+
+bool
+FlatbuffersStreamingJsonWriter::step()
+{
+  auto& frame = frames[depth - 1];
+  if (frame.type == VectorFrame)
+  {
+    return next_element(frame);
+  }
+  return next_field(frame);
+}
+
+bool
+FlatbuffersStreamingJsonWriter::next_field(Frame& frame)
+{
+  if (frame.value_field != nullptr)
+  {
+    auto field = frame.value_field;
+    frame.value_field = nullptr;
+
+    auto type = field->field->type();
+    auto p = get_field_address(frame, field->field);
+    if (type->base_type() == reflection::Union)
+    {
+      return write_value(reflection::Obj, type, get_union_table(frame, field), p);
+    }
+    return write_value(type->base_type(), type, field->child, p);
+  }
+
+  while (frame.index < frame.table->fields_count)
+  {
+    auto field = schema_index.get_field_by_id(frame.table, frame.index++);
+    if ((field == nullptr) || field->field->deprecated())
+    {
+      continue;
+    }
+
+    // Absent, or a union of a type this schema does not have
+    if ((get_field_address(frame, field->field) == nullptr) || (
+          (field->field->type()->base_type() == reflection::Union) &&
+          (get_union_table(frame, field) == nullptr)))
+    {
+      continue;
+    }
+
+    if (frame.needs_comma)
+    {
+      put(',');
+    }
+    frame.needs_comma = true;
+
+    auto name = field->field->name();
+    frame.value_field = field;
+    put_string(name->c_str(), name->size(), false, ":");
+    return true;
+  }
+
+  put('}');
+  depth--;
+  return true;
+}
+
+bool
+FlatbuffersStreamingJsonWriter::next_element(Frame& frame)
+{
+  if (frame.index >= frame.size)
+  {
+    put(']');
+    depth--;
+    return true;
+  }
+
+  auto i = frame.index++;
+  if (i > 0)
+  {
+    put(',');
+  }
+
+  auto element = frame.vector_type->element();
+  size_t element_size = flatbuffers::GetTypeSize(element);
+  if (element == reflection::Obj)
+  {
+    if (frame.table == nullptr)
+    {
+      ESP_LOGE(TAG, "Vector element type not found in binary flatbuffer schema");
+      return false;
+    }
+
+    if (frame.table->object->is_struct())
+    {
+      element_size = frame.table->object->bytesize();
+    }
+  }
+
+  return write_value(element, frame.vector_type, frame.table, frame.data + (i * element_size));
+}
+
+bool
+FlatbuffersStreamingJsonWriter::write_value(
+  reflection::BaseType base_type,
+  const reflection::Type* type,
+  const Table* child,
+  const uint8_t* p
+)
+{
+  switch (base_type)
+  {
+    case reflection::String:
+    {
+      auto s = reinterpret_cast<const flatbuffers::String*>(
+        p + flatbuffers::ReadScalar<flatbuffers::uoffset_t>(p));
+      put_string(s->c_str(), s->size(), true, nullptr);
+      return true;
+    }
+
+    case reflection::Vector:
+    {
+      auto v = reinterpret_cast<const flatbuffers::Vector<uint8_t>*>(
+        p + flatbuffers::ReadScalar<flatbuffers::uoffset_t>(p));
+      return push(VectorFrame, child, v->Data(), type, v->size());
+    }
+
+    case reflection::Obj:
+    {
+      if (child == nullptr)
+      {
+        ESP_LOGE(TAG, "Field type not found in binary flatbuffer schema");
+        return false;
+      }
+
+      // Structs are inline, tables are an offset away
+      if (child->object->is_struct())
+      {
+        return push(StructFrame, child, p, nullptr, 0);
+      }
+      return push(TableFrame, child, p + flatbuffers::ReadScalar<flatbuffers::uoffset_t>(p), nullptr, 0);
+    }
+
+    default:
+      return write_scalar(base_type, type, p);
+  }
+}
+
+bool
+FlatbuffersStreamingJsonWriter::write_scalar(
+  reflection::BaseType base_type,
+  const reflection::Type* type,
+  const uint8_t* p
+)
+{
+  int64_t value = 0;
+  switch (base_type)
+  {
+    case reflection::Bool:
+      if (flatbuffers::ReadScalar<uint8_t>(p) != 0)
+      {
+        put("true", 4);
+      }
+      else {
+        put("false", 5);
+      }
+      return true;
+
+    case reflection::Float:
+    {
+      char buf[flatbuffers_streaming_json_max_number_size];
+      auto end = flatbuffers_streaming_json_format_float(flatbuffers::ReadScalar<float>(p), buf);
+      put(buf, static_cast<size_t>(end - buf));
+      return true;
+    }
+
+    case reflection::Double:
+    {
+      char buf[flatbuffers_streaming_json_max_number_size];
+      auto end = flatbuffers_streaming_json_format_double(flatbuffers::ReadScalar<double>(p), buf);
+      put(buf, static_cast<size_t>(end - buf));
+      return true;
+    }
+
+    case reflection::ULong:
+    {
+      char buf[flatbuffers_streaming_json_max_number_size];
+      auto end = flatbuffers_streaming_json_format_uint(flatbuffers::ReadScalar<uint64_t>(p), buf);
+      put(buf, static_cast<size_t>(end - buf));
+      return true;
+    }
+
+    case reflection::UType:
+    case reflection::UByte: value = flatbuffers::ReadScalar<uint8_t>(p); break;
+    case reflection::Byte: value = flatbuffers::ReadScalar<int8_t>(p); break;
+    case reflection::Short: value = flatbuffers::ReadScalar<int16_t>(p); break;
+    case reflection::UShort: value = flatbuffers::ReadScalar<uint16_t>(p); break;
+    case reflection::Int: value = flatbuffers::ReadScalar<int32_t>(p); break;
+    case reflection::UInt: value = flatbuffers::ReadScalar<uint32_t>(p); break;
+    case reflection::Long: value = flatbuffers::ReadScalar<int64_t>(p); break;
+
+    default:
+      ESP_LOGE(TAG, "Field type cannot be written as JSON");
+      return false;
+  }
+
+  // An enum (or a union's type) by name, if it has one
+  auto enums = compiled_schema.get_flatbuffers_schema()->enums();
+  if ((type->index() >= 0) && (enums != nullptr) &&
+      (static_cast<flatbuffers::uoffset_t>(type->index()) < enums->size()))
+  {
+    auto values = enums->Get(type->index())->values();
+    auto enum_val = (values != nullptr)? values->LookupByKey(value) : nullptr;
+    if (enum_val != nullptr)
+    {
+      put_string(enum_val->name()->c_str(), enum_val->name()->size(), false, nullptr);
+      return true;
+    }
+  }
+
+  char buf[flatbuffers_streaming_json_max_number_size];
+  auto end = flatbuffers_streaming_json_format_int(value, buf);
+  put(buf, static_cast<size_t>(end - buf));
+  return true;
+}
+
+const FlatbuffersStreamingJsonWriter::Table*
+FlatbuffersStreamingJsonWriter::get_union_table(
+  const Frame& frame,
+  const Field* field
+) const
+{
+  // The type field is declared just before the value field
+  auto id = field->field->id();
+  auto type_field = (id > 0)? schema_index.get_field_by_id(frame.table, id - 1) : nullptr;
+  if ((type_field == nullptr) || (type_field->field->type()->base_type() != reflection::UType))
+  {
+    return nullptr;
+  }
+
+  auto p = get_field_address(frame, type_field->field);
+  auto enums = compiled_schema.get_flatbuffers_schema()->enums();
+  auto index = field->field->type()->index();
+  if ((p == nullptr) || (enums == nullptr) || (index < 0) ||
+      (static_cast<flatbuffers::uoffset_t>(index) >= enums->size()))
+  {
+    return nullptr;
+  }
+
+  auto values = enums->Get(index)->values();
+  auto enum_val = (values != nullptr)? values->LookupByKey(flatbuffers::ReadScalar<uint8_t>(p)) : nullptr;
+  if ((enum_val == nullptr) || (enum_val->union_type() == nullptr) || (enum_val->union_type()->index() < 0))
+  {
+    return nullptr;
+  }
+
+  return schema_index.get_table(static_cast<flatbuffers::uoffset_t>(enum_val->union_type()->index()));
+}
+
+const uint8_t*
+FlatbuffersStreamingJsonWriter::get_field_address(
+  const Frame& frame,
+  const reflection::Field* field
+) const
+{
+  if (frame.type == StructFrame)
+  {
+    return (frame.data + field->offset());
+  }
+
+  auto table = reinterpret_cast<const flatbuffers::Table*>(frame.data);
+  return table->GetAddressOf(field->offset());
+}
+
+bool
+FlatbuffersStreamingJsonWriter::push(
+  FrameType type,
+  const Table* table,
+  const uint8_t* data,
+  const reflection::Type* vector_type,
+  size_t size
+)
+{
+  if (depth == max_depth)
+  {
+    ESP_LOGE(TAG, "Flatbuffer nested too deeply to write as JSON");
+    return false;
+  }
+
+  auto& frame = frames[depth++];
+  frame.type = type;
+  frame.table = table;
+  frame.data = data;
+  frame.vector_type = vector_type;
+  frame.index = 0;
+  frame.size = size;
+  frame.value_field = nullptr;
+  frame.needs_comma = false;
+
+  put((type == VectorFrame)? '[' : '{');
+  return true;
+}
+
+void
+FlatbuffersStreamingJsonWriter::put(const char* s, size_t len)
+{
+  if (pending_pos == pending_size)
+  {
+    pending_pos = 0;
+    pending_size = 0;
+  }
+
+  memcpy(pending + pending_size, s, len);
+  pending_size += len;
+}
+
+void
+FlatbuffersStreamingJsonWriter::put(char ch)
+{
+  put(&ch, 1);
+}
+
+void
+FlatbuffersStreamingJsonWriter::put_string(
+  const char* data,
+  size_t len,
+  bool escape,
+  const char* suffix
+)
+{
+  put('"');
+  text = data;
+  text_size = len;
+  text_pos = 0;
+  text_escape = escape;
+  text_suffix = suffix;
+}
+
+size_t
+FlatbuffersStreamingJsonWriter::write_text(char* out, size_t len)
+{
+  size_t n = std::min(len, text_size - text_pos);
+  if (text_escape)
+  {
+    // Copy the run of plain characters, up to the next one to escape
+    size_t run = 0;
+    while ((run < n) && is_plain_char(static_cast<uint8_t>(text[text_pos + run])))
+    {
+      run++;
+    }
+    n = run;
+  }
+
+  memcpy(out, text + text_pos, n);
+  text_pos += n;
+
+  if (text_escape && (text_pos < text_size) && (n < len))
+  {
+    // Escapes are queued as tokens, then the text continues
+    static const char hex[] = "0123456789abcdef";
+    auto ch = static_cast<uint8_t>(text[text_pos++]);
+    put('\\');
+    switch (ch)
+    {
+      case '"': put('"'); break;
+      case '\\': put('\\'); break;
+      case '\b': put('b'); break;
+      case '\f': put('f'); break;
+      case '\n': put('n'); break;
+      case '\r': put('r'); break;
+      case '\t': put('t'); break;
+      default:
+        put("u00", 3);
+        put(hex[ch >> 4]);
+        put(hex[ch & 0xF]);
+        break;
+    }
+    return n;
+  }
+
+  if (text_pos == text_size)
+  {
+    text = nullptr;
+    put('"');
+    if (text_suffix != nullptr)
+    {
+      put(text_suffix, strlen(text_suffix));
+    }
+  }
+  return n;
+}
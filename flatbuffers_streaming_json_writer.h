@@ -0,0 +1,145 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+#include "flatbuffers_streaming_json_compiled_schema.h"
+#include "flatbuffers_streaming_json_format.h"
+#include "flatbuffers_streaming_json_schema_index.h"
+
+#include "flatbuffers/reflection.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Writes a flatbuffer as compact JSON, driven by the binary schema,
+// a piece at a time into whatever space the caller has, so a large table
+// is sent as it is written instead of being stringified first.
+// All state is held in the writer, it never allocates.
+// Fields are written in id order, absent ones are left out (as flatc does),
+// enums by name where the schema has one, and NaN or infinite reals as null
+class FlatbuffersStreamingJsonWriter
+{
+public:
+  explicit FlatbuffersStreamingJsonWriter(const FlatbuffersStreamingJsonCompiledSchema& _compiled_schema);
+
+  // do include space for null terminating byte
+  static constexpr char TAG[] = "FlatbuffersStreamingJsonWriter";
+
+  // Tables, structs and vectors nested in the root table
+  static constexpr size_t max_depth = 32;
+
+  // Begin writing a finished (and verified) buffer with a root table
+  // of the given type, the schema's root table by default.
+  // The buffer must outlive the writing
+  bool start(const uint8_t* buf, const reflection::Object* object=nullptr);
+
+  // Up to len more bytes of JSON, continuing where the last call ended.
+  // Fewer than len are written only once the JSON is done, or on an error
+  size_t write(char* out, size_t len);
+
+  // Write the rest through a sink, one chunk buffer at a time.
+  // The sink returns false to stop, e.g. once its connection has closed
+  bool write(
+    char* chunk,
+    size_t chunk_size,
+    const std::function<bool(const char*, size_t)>& sink);
+
+  bool is_done() const;
+  bool has_error() const;
+
+private:
+  FlatbuffersStreamingJsonWriter(const FlatbuffersStreamingJsonWriter&);
+  FlatbuffersStreamingJsonWriter& operator=(const FlatbuffersStreamingJsonWriter&);
+
+  typedef FlatbuffersStreamingJsonSchemaIndex::Table Table;
+  typedef FlatbuffersStreamingJsonSchemaIndex::Field Field;
+
+  enum FrameType
+  {
+    TableFrame,
+    StructFrame,
+    VectorFrame,
+  };
+
+  struct Frame
+  {
+    FrameType type;
+
+    // The table or struct, or the vector's element type
+    const Table* table;
+
+    // The table, struct bytes, or vector
+    const uint8_t* data;
+
+    // The vector's own type
+    const reflection::Type* vector_type;
+
+    // Next field id, or element
+    size_t index;
+    size_t size;
+
+    // A field's key is written, its value is next
+    const Field* value_field;
+    bool needs_comma;
+  };
+
+  // Write out the next token(s) of the innermost frame
+  bool step();
+
+  bool next_field(Frame& frame);
+  bool next_element(Frame& frame);
+
+  // A scalar, string, table, struct or vector
+  // of a table or struct field, or a vector element
+  bool write_value(
+    reflection::BaseType base_type,
+    const reflection::Type* type,
+    const Table* child,
+    const uint8_t* p);
+
+  bool write_scalar(reflection::BaseType base_type, const reflection::Type* type, const uint8_t* p);
+
+  // The table of a union value field, from its type field
+  const Table* get_union_table(const Frame& frame, const Field* field) const;
+
+  const uint8_t* get_field_address(const Frame& frame, const reflection::Field* field) const;
+
+  bool push(FrameType type, const Table* table, const uint8_t* data, const reflection::Type* vector_type, size_t size);
+
+  void put(const char* s, size_t len);
+  void put(char ch);
+
+  // Quoted, and escaped unless it is a name from the schema
+  void put_string(const char* data, size_t len, bool escape, const char* suffix);
+
+  size_t write_text(char* out, size_t len);
+
+  const FlatbuffersStreamingJsonCompiledSchema& compiled_schema;
+  const FlatbuffersStreamingJsonSchemaIndex& schema_index;
+
+  Frame frames[max_depth];
+  size_t depth = 0;
+
+  // Small tokens, before any text: punctuation, numbers
+  char pending[flatbuffers_streaming_json_max_number_size + 16];
+  size_t pending_size = 0;
+  size_t pending_pos = 0;
+
+  // A string or key from the buffer or schema, written out in place
+  const char* text = nullptr;
+  size_t text_size = 0;
+  size_t text_pos = 0;
+  bool text_escape = false;
+  const char* text_suffix = nullptr;
+
+  bool started = false;
+  bool error = false;
+};
@@ -0,0 +1,22 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+// Host stand-in for the ESP-IDF logging macros, used by the host tests.
+// Errors are expected from the tests of bad input, so are kept quiet
+// unless VERBOSE is set
+#include <cstdio>
+#include <cstdlib>
+
+#define ESP_LOGE(tag, format, ...) do { if (getenv("VERBOSE")) fprintf(stderr, "E (%s) " format "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGW(tag, format, ...) do { if (getenv("VERBOSE")) fprintf(stderr, "W (%s) " format "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGI(tag, format, ...) do {} while (0)
+#define ESP_LOGD(tag, format, ...) do {} while (0)
+#define ESP_LOGV(tag, format, ...) do {} while (0)
@@ -0,0 +1,81 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "test.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+int test_failures = 0;
+
+static std::string text_schema;
+static std::string binary_schema;
+
+static std::string
+load_schema(const char* filename)
+{
+  std::ifstream in(filename, std::ios::binary);
+  std::string contents(
+    (std::istreambuf_iterator<char>(in)),
+    std::istreambuf_iterator<char>());
+  if (!contents.empty())
+  {
+    contents.push_back('\0');
+  }
+  return contents;
+}
+
+stx::string_view
+get_test_text_schema()
+{
+  return stx::string_view(text_schema.data(), text_schema.size());
+}
+
+stx::string_view
+get_test_binary_schema()
+{
+  return stx::string_view(binary_schema.data(), binary_schema.size());
+}
+
+bool
+test_feed(TestVisitor& visitor, const std::string& json, size_t chunk_size)
+{
+  visitor.begin_stream();
+
+  bool ok = true;
+  for (size_t i = 0; ok && (i < json.size()); i += chunk_size)
+  {
+    ok = visitor.feed(json.data() + i, std::min(chunk_size, json.size() - i));
+  }
+
+  return visitor.finish() && ok;
+}
+
+// usage: test [test.fbs] [test.bfbs]
+int main(int argc, char** argv)
+{
+  text_schema = load_schema((argc > 1)? argv[1] : "test.fbs");
+  binary_schema = load_schema((argc > 2)? argv[2] : "build/test.bfbs");
+  if (text_schema.empty() || binary_schema.empty())
+  {
+    fprintf(stderr, "Could not load test schemas\n");
+    return EXIT_FAILURE;
+  }
+
+  test_reserialize();
+  test_modes();
+  test_flexbuffer();
+  test_decoder();
+  test_parser();
+
+  printf("%s, %d failed checks\n", (test_failures == 0)? "PASS" : "FAIL", test_failures);
+  return (test_failures == 0)? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "flatbuffers/idl.h"
+#include "flatbuffers/util.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// The binary schema of a text schema, as flatc -b --schema writes it,
+// using the embedded idl parser so the tests need no flatc
+// usage: schema_to_bfbs schema.fbs schema.bfbs
+int main(int argc, char** argv)
+{
+  if (argc != 3)
+  {
+    fprintf(stderr, "usage: %s schema.fbs schema.bfbs\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::string text_schema;
+  if (!flatbuffers::LoadFile(argv[1], false, &text_schema))
+  {
+    fprintf(stderr, "Could not read '%s'\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  flatbuffers::Parser parser;
+  if (!parser.Parse(text_schema.c_str()))
+  {
+    fprintf(stderr, "Invalid schema '%s': %s\n", argv[1], parser.error_.c_str());
+    return EXIT_FAILURE;
+  }
+
+  parser.Serialize();
+  if (!flatbuffers::SaveFile(argv[2],
+    reinterpret_cast<const char*>(parser.builder_.GetBufferPointer()),
+    parser.builder_.GetSize(), true))
+  {
+    fprintf(stderr, "Could not write '%s'\n", argv[2]);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+// Host tests for the streaming parser:
+//   make -C test run STX_INCLUDE=/path/to/stx/include
+#include "test_generated.h"
+
+#include "flatbuffers_streaming_json_visitor.h"
+
+// Generated by tools/flatbuffers_streaming_json_gen, see the Makefile
+#include "test_streaming_json.h"
+
+#include <cstdio>
+#include <string>
+
+// Failed checks so far, main() fails if any did
+extern int test_failures;
+
+// Report a failed condition and carry on, so one run lists every failure
+#define TEST_CHECK(condition) \
+  do \
+  { \
+    if (!(condition)) \
+    { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      test_failures++; \
+    } \
+  } while (0)
+
+typedef FlatbuffersStreamingJsonVisitor<test::MessageT, test::ErrorT> TestVisitor;
+
+// test.fbs, and the build's test.bfbs from it, both NUL terminated
+// as FlatbuffersStreamingJsonParser expects
+stx::string_view get_test_text_schema();
+stx::string_view get_test_binary_schema();
+
+// Begin a stream, then feed the JSON chunk_size bytes at a time
+bool test_feed(TestVisitor& visitor, const std::string& json, size_t chunk_size);
+
+// One group of tests each, run in turn by main()
+void test_reserialize();
+void test_modes();
+void test_flexbuffer();
+void test_decoder();
+void test_parser();
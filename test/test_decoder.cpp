@@ -0,0 +1,127 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "test.h"
+
+// Each is decoded by the generated decoder, and built by the direct builder,
+// which must both accept it (into the same object) or both reject it
+static const char* const decoder_docs[] = {
+  // Accepted by both
+  "{\"count\":\"15\"}",
+  "{\"count\":\"1.5e1\"}",
+  "{\"count\":null,\"count\":3}",
+  "{\"count\":3,\"count\":null}",
+  "{\"readings\":[{\"color\":\"Blue\"},{\"color\":0},{\"color\":\"2\"}]}",
+  "{\"readings\":[{\"temp\":\"2.5\",\"value\":\"-3\"},{\"temp\":true}]}",
+  "{\"readings\":[{\"pos\":{\"x\":\"1\",\"y\":2}}]}",
+  "{\"readings\":[{\"samples\":[1,\"2\",3.0],\"tags\":[\"a\",\"b\"]}],\"status\":\"s\"}",
+  "{\"entries\":{\"a\":{\"value\":1},\"b\":{\"value\":2}}}",
+  "{\"entries\":[{\"id\":\"a\",\"val\":{\"value\":1}}]}",
+
+  // Duplicate fields, of any kind
+  "{\"count\":1,\"count\":2}",
+  "{\"status\":\"a\",\"status\":\"b\"}",
+  "{\"readings\":[{\"samples\":[1],\"samples\":[2]}]}",
+  "{\"readings\":[{\"name\":\"a\"}],\"readings\":[{\"name\":\"b\"}]}",
+  "{\"readings\":[{\"pos\":{\"x\":1,\"y\":2},\"pos\":{\"x\":1,\"y\":2}}]}",
+
+  // Partial or malformed structs
+  "{\"readings\":[{\"pos\":{\"x\":1}}]}",
+  "{\"readings\":[{\"pos\":{}}]}",
+  "{\"readings\":[{\"pos\":{\"x\":1,\"z\":2}}]}",
+  "{\"readings\":[{\"pos\":{\"x\":1,\"y\":null}}]}",
+
+  // Values of the wrong type
+  "{\"count\":\"abc\"}",
+  "{\"count\":1.5}",
+  "{\"status\":1}",
+  "{\"readings\":[{\"color\":\"Purple\"}]}",
+  "{\"readings\":[{\"samples\":[1,null]}]}",
+  "{\"readings\":{\"name\":\"a\"}}",
+};
+
+static std::string
+describe_reading(const test::ReadingT& reading)
+{
+  char buf[128];
+  snprintf(buf, sizeof(buf), "{%s %lld %g %d ",
+    reading.name.c_str(), (long long)reading.value, reading.temp, (int)reading.color);
+  std::string s = buf;
+
+  if (reading.pos)
+  {
+    snprintf(buf, sizeof(buf), "(%g,%g) ", reading.pos->x(), reading.pos->y());
+    s += buf;
+  }
+
+  for (const auto& tag : reading.tags)
+  {
+    s += tag + ",";
+  }
+  for (auto sample : reading.samples)
+  {
+    s += std::to_string(sample) + ",";
+  }
+  return s + "}";
+}
+
+static std::string
+describe_message(const test::MessageT& message)
+{
+  std::string s = message.status + " " + std::to_string(message.count) + " [";
+  for (const auto& reading : message.readings)
+  {
+    s += describe_reading(*reading);
+  }
+  s += "] [";
+  for (const auto& entry : message.entries)
+  {
+    s += entry->id + ":" + (entry->val? describe_reading(*entry->val) : "-");
+  }
+  return s + "]";
+}
+
+void
+test_decoder()
+{
+  FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+
+  for (const std::string json : decoder_docs)
+  {
+    std::string built;
+    TestVisitor builder_visitor(parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder);
+    builder_visitor.subscribe<test::MessageT>({}, [&](const test::MessageT& message)
+    {
+      built = describe_message(message);
+      return true;
+    });
+    bool built_ok = test_feed(builder_visitor, json, json.size());
+
+    std::string decoded;
+    TestVisitor decoder_visitor(parser);
+    decoder_visitor.subscribe_decoded<test::MessageT>({}, [&](const test::MessageT& message)
+    {
+      decoded = describe_message(message);
+      return true;
+    });
+
+    for (size_t chunk_size : {json.size(), (size_t)1})
+    {
+      decoded.clear();
+      bool decoded_ok = test_feed(decoder_visitor, json, chunk_size);
+      if ((decoded_ok != built_ok) || (decoded != built))
+      {
+        fprintf(stderr, "%s: built %s '%s', decoded %s '%s'\n", json.c_str(),
+          built_ok? "ok" : "failed", built.c_str(),
+          decoded_ok? "ok" : "failed", decoded.c_str());
+        test_failures++;
+      }
+    }
+  }
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "test.h"
+
+#include "flatbuffers/flexbuffers.h"
+
+// Same keys in different maps, at any depth, are not duplicates
+static const std::string nested_keys =
+  "{\"meta\":{\"x\":{\"x\":1,\"y\":[{\"x\":2,\"y\":3}]},\"y\":{}},\"count\":1}";
+
+// Duplicate keys, at the top of the value and nested in it, and a key
+// with an embedded NUL: a flexbuffer map can hold none of them
+static const std::string bad_keys[] = {
+  "{\"meta\":{\"x\":1,\"x\":2}}",
+  "{\"meta\":{\"x\":{\"a\":1,\"b\":[{\"k\":1,\"j\":2,\"k\":3}]},\"y\":1}}",
+  "{\"meta\":{\"a\\u0000b\":1}}",
+};
+
+static void
+check_nested_keys(flexbuffers::Map meta)
+{
+  auto x = meta["x"].AsMap();
+  TEST_CHECK(x["x"].AsInt64() == 1);
+  TEST_CHECK(x["y"].AsVector()[0].AsMap()["x"].AsInt64() == 2);
+  TEST_CHECK(x["y"].AsVector()[0].AsMap()["y"].AsInt64() == 3);
+  TEST_CHECK(meta["y"].AsMap().size() == 0);
+}
+
+static void
+test_subscription_keys()
+{
+  FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+
+  for (auto mode : {FlatbuffersStreamingJsonBuildMode::ReserializeJson, FlatbuffersStreamingJsonBuildMode::DirectBuilder})
+  {
+    TestVisitor visitor(parser, mode);
+
+    size_t items = 0;
+    visitor.subscribe_flexbuffer({"meta"}, [&](const uint8_t* buf, size_t len)
+    {
+      items++;
+      check_nested_keys(flexbuffers::GetRoot(buf, len).AsMap()["meta"].AsMap());
+      return true;
+    });
+
+    for (const auto& json : bad_keys)
+    {
+      TEST_CHECK(!test_feed(visitor, json, json.size()));
+    }
+    TEST_CHECK(items == 0);
+
+    // A failed capture leaves nothing behind for the next
+    for (size_t chunk_size : {(size_t)1, nested_keys.size()})
+    {
+      TEST_CHECK(test_feed(visitor, nested_keys, chunk_size));
+    }
+    TEST_CHECK(items == 2);
+  }
+}
+
+static void
+test_field_keys()
+{
+  FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+
+  // (flexbuffer) fields, captured by the direct builder,
+  // or by flatbuffers::Parser from the re-serialized JSON
+  for (auto mode : {FlatbuffersStreamingJsonBuildMode::ReserializeJson, FlatbuffersStreamingJsonBuildMode::DirectBuilder})
+  {
+    TestVisitor visitor(parser, mode);
+
+    size_t items = 0;
+    visitor.subscribe<test::MessageT>({}, std::function<bool(const test::Message*)>(
+      [&](const test::Message* message)
+      {
+        items++;
+        TEST_CHECK(message->count() == 1);
+        check_nested_keys(message->meta_flexbuffer_root().AsMap());
+        return true;
+      }));
+
+    for (const auto& json : bad_keys)
+    {
+      TEST_CHECK(!test_feed(visitor, json, json.size()));
+    }
+    TEST_CHECK(items == 0);
+
+    TEST_CHECK(test_feed(visitor, nested_keys, nested_keys.size()));
+    TEST_CHECK(items == 1);
+  }
+}
+
+void
+test_flexbuffer()
+{
+  test_subscription_keys();
+  test_field_keys();
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#pragma once
+
+// Written by hand for test.fbs, in the shape of what
+// flatc --cpp --gen-object-api (1.7.x) emits, so the tests build from the
+// tree without flatc: the embedded flatbuffers has no C++ generator.
+// Only what the component uses is here: accessors, Verify() and UnPackTo().
+// Keep it in step with test.fbs
+#include "flatbuffers/flatbuffers.h"
+#include "flatbuffers/flexbuffers.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace test {
+
+struct Vec2;
+
+struct Reading;
+struct ReadingT;
+
+struct Entry;
+struct EntryT;
+
+struct Message;
+struct MessageT;
+
+struct Error;
+struct ErrorT;
+
+enum Color {
+  Color_Red = 0,
+  Color_Green = 1,
+  Color_Blue = 2
+};
+
+MANUALLY_ALIGNED_STRUCT(4) Vec2 FLATBUFFERS_FINAL_CLASS {
+ private:
+  float x_;
+  float y_;
+
+ public:
+  Vec2() {
+    memset(this, 0, sizeof(Vec2));
+  }
+  Vec2(float _x, float _y)
+      : x_(flatbuffers::EndianScalar(_x)),
+        y_(flatbuffers::EndianScalar(_y)) {
+  }
+  float x() const {
+    return flatbuffers::EndianScalar(x_);
+  }
+  float y() const {
+    return flatbuffers::EndianScalar(y_);
+  }
+};
+STRUCT_END(Vec2, 8);
+
+struct ReadingT : public flatbuffers::NativeTable {
+  typedef Reading TableType;
+  std::string name;
+  int64_t value;
+  double temp;
+  Color color;
+  std::unique_ptr<Vec2> pos;
+  std::vector<std::string> tags;
+  std::vector<int32_t> samples;
+  ReadingT()
+      : value(0),
+        temp(0.0),
+        color(Color_Green) {
+  }
+};
+
+struct Reading FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
+  typedef ReadingT NativeTableType;
+  static FLATBUFFERS_CONSTEXPR const char *GetFullyQualifiedName() {
+    return "test.Reading";
+  }
+  enum {
+    VT_NAME = 4,
+    VT_VALUE = 6,
+    VT_TEMP = 8,
+    VT_COLOR = 10,
+    VT_POS = 12,
+    VT_TAGS = 14,
+    VT_SAMPLES = 16
+  };
+  const flatbuffers::String *name() const {
+    return GetPointer<const flatbuffers::String *>(VT_NAME);
+  }
+  int64_t value() const {
+    return GetField<int64_t>(VT_VALUE, 0);
+  }
+  double temp() const {
+    return GetField<double>(VT_TEMP, 0.0);
+  }
+  Color color() const {
+    return static_cast<Color>(GetField<int8_t>(VT_COLOR, 1));
+  }
+  const Vec2 *pos() const {
+    return GetStruct<const Vec2 *>(VT_POS);
+  }
+  const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> *tags() const {
+    return GetPointer<const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> *>(VT_TAGS);
+  }
+  const flatbuffers::Vector<int32_t> *samples() const {
+    return GetPointer<const flatbuffers::Vector<int32_t> *>(VT_SAMPLES);
+  }
+  bool Verify(flatbuffers::Verifier &verifier) const {
+    return VerifyTableStart(verifier) &&
+           VerifyOffset(verifier, VT_NAME) &&
+           verifier.Verify(name()) &&
+           VerifyField<int64_t>(verifier, VT_VALUE) &&
+           VerifyField<double>(verifier, VT_TEMP) &&
+           VerifyField<int8_t>(verifier, VT_COLOR) &&
+           VerifyField<Vec2>(verifier, VT_POS) &&
+           VerifyOffset(verifier, VT_TAGS) &&
+           verifier.Verify(tags()) &&
+           verifier.VerifyVectorOfStrings(tags()) &&
+           VerifyOffset(verifier, VT_SAMPLES) &&
+           verifier.Verify(samples()) &&
+           verifier.EndTable();
+  }
+  ReadingT *UnPack() const {
+    auto _o = new ReadingT();
+    UnPackTo(_o);
+    return _o;
+  }
+  void UnPackTo(ReadingT *_o) const {
+    { auto _e = name(); if (_e) _o->name = _e->str(); };
+    { auto _e = value(); _o->value = _e; };
+    { auto _e = temp(); _o->temp = _e; };
+    { auto _e = color(); _o->color = _e; };
+    { auto _e = pos(); if (_e) _o->pos = std::unique_ptr<Vec2>(new Vec2(*_e)); };
+    { auto _e = tags(); if (_e) { _o->tags.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->tags[_i] = _e->Get(_i)->str(); } } };
+    { auto _e = samples(); if (_e) { _o->samples.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->samples[_i] = _e->Get(_i); } } };
+  }
+};
+
+struct EntryT : public flatbuffers::NativeTable {
+  typedef Entry TableType;
+  std::string id;
+  std::unique_ptr<ReadingT> val;
+  EntryT() {
+  }
+};
+
+struct Entry FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
+  typedef EntryT NativeTableType;
+  static FLATBUFFERS_CONSTEXPR const char *GetFullyQualifiedName() {
+    return "test.Entry";
+  }
+  enum {
+    VT_ID = 4,
+    VT_VAL = 6
+  };
+  const flatbuffers::String *id() const {
+    return GetPointer<const flatbuffers::String *>(VT_ID);
+  }
+  bool KeyCompareLessThan(const Entry *o) const {
+    return *id() < *o->id();
+  }
+  int KeyCompareWithValue(const char *val) const {
+    return strcmp(id()->c_str(), val);
+  }
+  const Reading *val() const {
+    return GetPointer<const Reading *>(VT_VAL);
+  }
+  bool Verify(flatbuffers::Verifier &verifier) const {
+    return VerifyTableStart(verifier) &&
+           VerifyOffsetRequired(verifier, VT_ID) &&
+           verifier.Verify(id()) &&
+           VerifyOffset(verifier, VT_VAL) &&
+           verifier.VerifyTable(val()) &&
+           verifier.EndTable();
+  }
+  EntryT *UnPack() const {
+    auto _o = new EntryT();
+    UnPackTo(_o);
+    return _o;
+  }
+  void UnPackTo(EntryT *_o) const {
+    { auto _e = id(); if (_e) _o->id = _e->str(); };
+    { auto _e = val(); if (_e) _o->val = std::unique_ptr<ReadingT>(_e->UnPack()); };
+  }
+};
+
+struct MessageT : public flatbuffers::NativeTable {
+  typedef Message TableType;
+  std::vector<std::unique_ptr<ReadingT>> readings;
+  std::vector<std::unique_ptr<EntryT>> entries;
+  std::string status;
+  int32_t count;
+  std::vector<uint8_t> meta;
+  MessageT()
+      : count(0) {
+  }
+};
+
+struct Message FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
+  typedef MessageT NativeTableType;
+  static FLATBUFFERS_CONSTEXPR const char *GetFullyQualifiedName() {
+    return "test.Message";
+  }
+  enum {
+    VT_READINGS = 4,
+    VT_ENTRIES = 6,
+    VT_STATUS = 8,
+    VT_COUNT = 10,
+    VT_META = 12
+  };
+  const flatbuffers::Vector<flatbuffers::Offset<Reading>> *readings() const {
+    return GetPointer<const flatbuffers::Vector<flatbuffers::Offset<Reading>> *>(VT_READINGS);
+  }
+  const flatbuffers::Vector<flatbuffers::Offset<Entry>> *entries() const {
+    return GetPointer<const flatbuffers::Vector<flatbuffers::Offset<Entry>> *>(VT_ENTRIES);
+  }
+  const flatbuffers::String *status() const {
+    return GetPointer<const flatbuffers::String *>(VT_STATUS);
+  }
+  int32_t count() const {
+    return GetField<int32_t>(VT_COUNT, 0);
+  }
+  const flatbuffers::Vector<uint8_t> *meta() const {
+    return GetPointer<const flatbuffers::Vector<uint8_t> *>(VT_META);
+  }
+  flexbuffers::Reference meta_flexbuffer_root() const {
+    auto v = meta();
+    return flexbuffers::GetRoot(v->Data(), v->size());
+  }
+  bool Verify(flatbuffers::Verifier &verifier) const {
+    return VerifyTableStart(verifier) &&
+           VerifyOffset(verifier, VT_READINGS) &&
+           verifier.Verify(readings()) &&
+           verifier.VerifyVectorOfTables(readings()) &&
+           VerifyOffset(verifier, VT_ENTRIES) &&
+           verifier.Verify(entries()) &&
+           verifier.VerifyVectorOfTables(entries()) &&
+           VerifyOffset(verifier, VT_STATUS) &&
+           verifier.Verify(status()) &&
+           VerifyField<int32_t>(verifier, VT_COUNT) &&
+           VerifyOffset(verifier, VT_META) &&
+           verifier.Verify(meta()) &&
+           verifier.EndTable();
+  }
+  MessageT *UnPack() const {
+    auto _o = new MessageT();
+    UnPackTo(_o);
+    return _o;
+  }
+  void UnPackTo(MessageT *_o) const {
+    { auto _e = readings(); if (_e) { _o->readings.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->readings[_i] = std::unique_ptr<ReadingT>(_e->Get(_i)->UnPack()); } } };
+    { auto _e = entries(); if (_e) { _o->entries.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->entries[_i] = std::unique_ptr<EntryT>(_e->Get(_i)->UnPack()); } } };
+    { auto _e = status(); if (_e) _o->status = _e->str(); };
+    { auto _e = count(); _o->count = _e; };
+    { auto _e = meta(); if (_e) { _o->meta.resize(_e->size()); for (flatbuffers::uoffset_t _i = 0; _i < _e->size(); _i++) { _o->meta[_i] = _e->Get(_i); } } };
+  }
+};
+
+struct ErrorT : public flatbuffers::NativeTable {
+  typedef Error TableType;
+  int32_t code;
+  std::string message;
+  ErrorT()
+      : code(0) {
+  }
+};
+
+struct Error FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
+  typedef ErrorT NativeTableType;
+  static FLATBUFFERS_CONSTEXPR const char *GetFullyQualifiedName() {
+    return "test.Error";
+  }
+  enum {
+    VT_CODE = 4,
+    VT_MESSAGE = 6
+  };
+  int32_t code() const {
+    return GetField<int32_t>(VT_CODE, 0);
+  }
+  const flatbuffers::String *message() const {
+    return GetPointer<const flatbuffers::String *>(VT_MESSAGE);
+  }
+  bool Verify(flatbuffers::Verifier &verifier) const {
+    return VerifyTableStart(verifier) &&
+           VerifyField<int32_t>(verifier, VT_CODE) &&
+           VerifyOffset(verifier, VT_MESSAGE) &&
+           verifier.Verify(message()) &&
+           verifier.EndTable();
+  }
+  ErrorT *UnPack() const {
+    auto _o = new ErrorT();
+    UnPackTo(_o);
+    return _o;
+  }
+  void UnPackTo(ErrorT *_o) const {
+    { auto _e = code(); _o->code = _e; };
+    { auto _e = message(); if (_e) _o->message = _e->str(); };
+  }
+};
+
+}  // namespace test
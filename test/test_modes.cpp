@@ -0,0 +1,276 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "test.h"
+
+#include "flatbuffers_streaming_json_writer.h"
+
+#include <cstring>
+#include <vector>
+
+// The shapes of the benchmark scenarios (benchmark/benchmark.cpp), for
+// test.fbs: every build mode, and every way of feeding the payload,
+// must deliver the same items
+struct TestScenario
+{
+  const char* name;
+  std::string payload;
+
+  std::vector<std::string> path;
+
+  // Empty for no error subscription
+  std::vector<std::string> error_path;
+
+  size_t expected_items;
+};
+
+static void
+append_reading(std::string& out, size_t i)
+{
+  char buf[192];
+  snprintf(buf, sizeof(buf),
+    "{\"name\":\"dev-%06u\",\"value\":%llu,\"temp\":%u.%02u,\"color\":\"%s\","
+    "\"pos\":{\"x\":%u.5,\"y\":-%u},\"tags\":[\"zone-%u\",\"rack\"],\"samples\":[%u,2,-3]}",
+    (unsigned)i,
+    1510000000000ULL + (unsigned long long)i * 1000,
+    (unsigned)(i % 100), (unsigned)((i * 7) % 100),
+    (i % 3)? "Blue" : "Red",
+    (unsigned)(i % 4), (unsigned)(i % 3),
+    (unsigned)(i % 16),
+    (unsigned)i);
+  out += buf;
+}
+
+static void
+append_readings(std::string& out, size_t count, size_t& next)
+{
+  out += "[";
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (i > 0)
+    {
+      out += ",";
+    }
+    append_reading(out, next++);
+  }
+  out += "]";
+}
+
+static std::vector<TestScenario>
+make_test_scenarios()
+{
+  std::vector<TestScenario> scenarios;
+  size_t next = 0;
+
+  // {"readings": [...]}, a single large item
+  {
+    TestScenario scenario{"large_array", "{\"readings\":", {"readings"}, {}, 1};
+    append_readings(scenario.payload, 40, next);
+    scenario.payload += "}";
+    scenarios.push_back(scenario);
+  }
+
+  // {"pages": [{"readings": [...], "cursor": ...}, ...]}, many small items
+  {
+    TestScenario scenario{"many_items", "{\"pages\":[", {"pages", "readings"}, {}, 20};
+    for (size_t p = 0; p < 20; ++p)
+    {
+      scenario.payload += (p > 0)? ",{\"readings\":" : "{\"readings\":";
+      append_readings(scenario.payload, 2, next);
+      scenario.payload += ",\"cursor\":{\"skipped\":[1,{}]}}";
+    }
+    scenario.payload += "]}";
+    scenarios.push_back(scenario);
+  }
+
+  // {"results": [{"l0": {"l1": ... {"readings": [...]}}}, ...]}
+  {
+    TestScenario scenario{"deep_nesting", "{\"results\":[", {"results"}, {}, 10};
+    std::string open;
+    std::string close;
+    for (size_t d = 0; d < 12; ++d)
+    {
+      std::string key = "l" + std::to_string(d);
+      scenario.path.push_back(key);
+      open += "{\"" + key + "\":";
+      close += "}";
+    }
+    scenario.path.push_back("readings");
+
+    for (size_t p = 0; p < 10; ++p)
+    {
+      scenario.payload += (p > 0)? "," : "";
+      scenario.payload += open + "{\"readings\":";
+      append_readings(scenario.payload, 2, next);
+      scenario.payload += "}" + close;
+    }
+    scenario.payload += "]}";
+    scenarios.push_back(scenario);
+  }
+
+  // {"pages": [{"entries": {"<id>": {...}, ...}}, ...]}, the id/val rewrite.
+  // Ids are in sorted order, which the direct builder sorts keyed vectors by
+  {
+    TestScenario scenario{"keyed_vector", "{\"pages\":[", {"pages", "entries"}, {}, 10};
+    for (size_t p = 0; p < 10; ++p)
+    {
+      scenario.payload += (p > 0)? ",{\"entries\":{" : "{\"entries\":{";
+      for (size_t e = 0; e < 4; ++e)
+      {
+        char key[24];
+        snprintf(key, sizeof(key), "%s\"key-%06u\":", (e > 0)? "," : "", (unsigned)next);
+        scenario.payload += key;
+        append_reading(scenario.payload, next++);
+      }
+      scenario.payload += "}}";
+    }
+    scenario.payload += "]}";
+    scenarios.push_back(scenario);
+  }
+
+  // {"shards": {"<shard>": {"readings": [...]}, ...}}
+  {
+    TestScenario scenario{"wildcard", "{\"shards\":{", {"shards", "*", "readings"}, {}, 10};
+    for (size_t s = 0; s < 10; ++s)
+    {
+      scenario.payload += (s > 0)? "," : "";
+      scenario.payload += "\"shard-" + std::to_string(s) + "\":{\"readings\":";
+      append_readings(scenario.payload, 3, next);
+      scenario.payload += "}";
+    }
+    scenario.payload += "}}";
+    scenarios.push_back(scenario);
+  }
+
+  // {"pages": [{"readings": [...]}, {"code": ...}, ...]}
+  {
+    TestScenario scenario{"error_path", "{\"pages\":[", {"pages", "readings"}, {"pages", "code"}, 15};
+    for (size_t p = 0; p < 20; ++p)
+    {
+      scenario.payload += (p > 0)? "," : "";
+      if ((p % 4) == 3)
+      {
+        scenario.payload += "{\"code\":" + std::to_string(400 + p) + "}";
+      }
+      else {
+        scenario.payload += "{\"readings\":";
+        append_readings(scenario.payload, 2, next);
+        scenario.payload += "}";
+      }
+    }
+    scenario.payload += "]}";
+    scenarios.push_back(scenario);
+  }
+
+  return scenarios;
+}
+
+// A size-prefixed item from a sink, written out as one line of JSON
+static bool
+append_item_json(
+  const FlatbuffersStreamingJsonParser& parser,
+  const reflection::Object* table,
+  const uint8_t* record,
+  size_t len,
+  std::string& out)
+{
+  // The record is only valid during the write, and is read in place
+  std::vector<uint64_t> aligned((len + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  memcpy(aligned.data(), record, len);
+
+  FlatbuffersStreamingJsonWriter writer(parser.get_compiled_schema());
+  auto buf = reinterpret_cast<const uint8_t*>(aligned.data()) + sizeof(flatbuffers::uoffset_t);
+  if (!writer.start(buf, table))
+  {
+    return false;
+  }
+
+  char chunk[64];
+  bool ok = writer.write(chunk, sizeof(chunk), [&out](const char* data, size_t size)
+  {
+    out.append(data, size);
+    return true;
+  });
+
+  out += "\n";
+  return ok;
+}
+
+// Every item and error of one parse of the scenario, as JSON
+static bool
+capture_output(
+  FlatbuffersStreamingJsonParser& parser,
+  FlatbuffersStreamingJsonBuildMode mode,
+  const TestScenario& scenario,
+  size_t chunk_size,
+  std::string& out,
+  size_t& items)
+{
+  auto message_table = parser.get_flatbuffers_table(test::Message::GetFullyQualifiedName());
+  auto error_table = parser.get_flatbuffers_table(test::Error::GetFullyQualifiedName());
+  bool written = true;
+
+  TestVisitor visitor(parser, mode);
+  if (!scenario.error_path.empty())
+  {
+    visitor.subscribe_sink<test::ErrorT>(
+      scenario.error_path,
+      [&](const uint8_t* record, size_t len)
+      {
+        out += "error ";
+        written = append_item_json(parser, error_table, record, len, out) && written;
+        return true;
+      });
+  }
+  visitor.subscribe_sink<test::MessageT>(
+    scenario.path,
+    [&](const uint8_t* record, size_t len)
+    {
+      items++;
+      out += "item ";
+      written = append_item_json(parser, message_table, record, len, out) && written;
+      return true;
+    });
+
+  return test_feed(visitor, scenario.payload, chunk_size) && written;
+}
+
+void
+test_modes()
+{
+  FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+
+  for (const auto& scenario : make_test_scenarios())
+  {
+    // Parsed whole, by the text mode, is what every other way must match
+    std::string expected;
+    size_t items = 0;
+    TEST_CHECK(capture_output(
+      parser, FlatbuffersStreamingJsonBuildMode::ReserializeJson,
+      scenario, scenario.payload.size(), expected, items));
+    TEST_CHECK(items == scenario.expected_items);
+
+    for (auto mode : {FlatbuffersStreamingJsonBuildMode::ReserializeJson, FlatbuffersStreamingJsonBuildMode::DirectBuilder})
+    {
+      for (size_t chunk_size : {scenario.payload.size(), (size_t)1, (size_t)7})
+      {
+        std::string output;
+        size_t mode_items = 0;
+        bool ok = capture_output(parser, mode, scenario, chunk_size, output, mode_items);
+        TEST_CHECK(ok);
+        if (output != expected)
+        {
+          fprintf(stderr, "%s: mode %d chunk %u output differs\n",
+            scenario.name, (int)mode, (unsigned)chunk_size);
+          test_failures++;
+        }
+      }
+    }
+  }
+}
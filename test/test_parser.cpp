@@ -0,0 +1,61 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "test.h"
+
+static const std::string parser_doc = "{\"count\":1}";
+
+// The text schema's parser exists exactly once it has been parsed
+void
+test_parser()
+{
+  // Parsed by the constructor
+  {
+    FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+    TEST_CHECK(parser.is_ready() && parser.has_text_schema());
+
+    auto flatbuffers_parser = parser.find_flatbuffers_parser();
+    TEST_CHECK(flatbuffers_parser != nullptr);
+    TEST_CHECK(parser.load_text_schema());
+    TEST_CHECK(parser.find_flatbuffers_parser() == flatbuffers_parser);
+  }
+
+  // Never, without a text schema
+  {
+    FlatbuffersStreamingJsonParser parser(get_test_binary_schema());
+    TEST_CHECK(parser.is_ready() && !parser.has_text_schema());
+    TEST_CHECK(parser.find_flatbuffers_parser() == nullptr);
+    TEST_CHECK(!parser.load_text_schema());
+    TEST_CHECK(parser.find_flatbuffers_parser() == nullptr);
+
+    // Only re-serialized items need it
+    TestVisitor visitor(parser, FlatbuffersStreamingJsonBuildMode::DirectBuilder);
+    visitor.subscribe<test::MessageT>({}, [](const test::MessageT&) { return true; });
+    TEST_CHECK(test_feed(visitor, parser_doc, parser_doc.size()));
+    TEST_CHECK(parser.find_flatbuffers_parser() == nullptr);
+  }
+
+  // From a shared schema, when first needed, or when asked to
+  {
+    FlatbuffersStreamingJsonCompiledSchema compiled_schema(get_test_text_schema(), get_test_binary_schema());
+
+    FlatbuffersStreamingJsonParser parser(compiled_schema);
+    TEST_CHECK(parser.find_flatbuffers_parser() == nullptr);
+
+    TestVisitor visitor(parser);
+    visitor.subscribe<test::MessageT>({}, [](const test::MessageT&) { return true; });
+    TEST_CHECK(test_feed(visitor, parser_doc, parser_doc.size()));
+    TEST_CHECK(parser.find_flatbuffers_parser() != nullptr);
+
+    FlatbuffersStreamingJsonParser loaded_parser(compiled_schema);
+    TEST_CHECK(loaded_parser.load_text_schema());
+    TEST_CHECK(loaded_parser.find_flatbuffers_parser() != nullptr);
+    TEST_CHECK(loaded_parser.find_flatbuffers_parser() != parser.find_flatbuffers_parser());
+  }
+}
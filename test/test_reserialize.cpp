@@ -0,0 +1,210 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+#include "test.h"
+
+// The text build mode re-serializes each item's JSON for flatbuffers::Parser,
+// which rejects any unbalanced or malformed text, so a whole item parsing
+// is the check that its JSON was re-written correctly
+static void
+test_nested_objects()
+{
+  FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+  TestVisitor visitor(parser);
+
+  // Objects nested in the item, and in a field the schema doesn't have,
+  // are closed once each
+  const std::string json =
+    "{\"readings\":[{\"name\":\"a\",\"pos\":{\"x\":1,\"y\":2},"
+    "\"extra\":{\"q\":{\"r\":[{\"s\":1}]}}},{\"name\":\"b\",\"value\":2}],"
+    "\"status\":\"done\"}";
+
+  for (size_t chunk_size : {(size_t)1, (size_t)7, json.size()})
+  {
+    size_t items = 0;
+    visitor.clear_subscriptions();
+    visitor.subscribe<test::MessageT>({"readings"}, [&](const test::MessageT& message)
+    {
+      items++;
+      TEST_CHECK(message.readings.size() == 2);
+      if (message.readings.size() == 2)
+      {
+        TEST_CHECK(message.readings[0]->pos && (message.readings[0]->pos->y() == 2.0f));
+        TEST_CHECK(message.readings[1]->name == "b");
+        TEST_CHECK(message.readings[1]->value == 2);
+      }
+      return true;
+    });
+
+    TEST_CHECK(test_feed(visitor, json, chunk_size));
+    TEST_CHECK(items == 1);
+  }
+
+  // The whole document as the item
+  size_t items = 0;
+  visitor.clear_subscriptions();
+  visitor.subscribe<test::MessageT>({}, [&](const test::MessageT& message)
+  {
+    items++;
+    TEST_CHECK(message.readings.size() == 2);
+    TEST_CHECK(message.status == "done");
+    return true;
+  });
+
+  TEST_CHECK(test_feed(visitor, json, json.size()));
+  TEST_CHECK(items == 1);
+}
+
+static void
+test_nested_arrays()
+{
+  FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+  TestVisitor visitor(parser);
+
+  // Elements after a nested array are still separated by commas
+  const std::string json =
+    "{\"readings\":[{\"tags\":[\"x\",\"y\"],\"samples\":[1,2],\"extra\":[[1,[2]],[3]]},"
+    "{\"name\":\"b\",\"samples\":[3]},{\"name\":\"c\"}]}";
+
+  size_t items = 0;
+  visitor.subscribe<test::MessageT>({"readings"}, [&](const test::MessageT& message)
+  {
+    items++;
+    TEST_CHECK(message.readings.size() == 3);
+    if (message.readings.size() == 3)
+    {
+      TEST_CHECK(message.readings[0]->tags.size() == 2);
+      TEST_CHECK(message.readings[0]->samples.size() == 2);
+      TEST_CHECK(message.readings[1]->samples.size() == 1);
+      TEST_CHECK(message.readings[2]->name == "c");
+    }
+    return true;
+  });
+
+  TEST_CHECK(test_feed(visitor, json, json.size()));
+  TEST_CHECK(items == 1);
+}
+
+static void
+test_empty_objects()
+{
+  FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+  TestVisitor visitor(parser);
+
+  const std::string json = "{\"readings\":[{},{\"name\":\"b\",\"extra\":{}},{}]}";
+
+  size_t items = 0;
+  visitor.subscribe<test::MessageT>({"readings"}, [&](const test::MessageT& message)
+  {
+    items++;
+    TEST_CHECK(message.readings.size() == 3);
+    if (message.readings.size() == 3)
+    {
+      TEST_CHECK(message.readings[0]->name.empty());
+      TEST_CHECK(message.readings[1]->name == "b");
+    }
+    return true;
+  });
+
+  TEST_CHECK(test_feed(visitor, json, json.size()));
+  TEST_CHECK(items == 1);
+}
+
+static void
+test_keyed_vector()
+{
+  FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+  TestVisitor visitor(parser);
+
+  // Each {"<id>": {...}} is written as {"id": "<id>", "val": {...}},
+  // the wrapper closed after its value, nested objects and all
+  const std::string json =
+    "{\"entries\":{\"k1\":{\"value\":1,\"pos\":{\"x\":1,\"y\":1}},"
+    "\"k2\":{\"value\":2,\"tags\":[\"t\"]},\"k3\":{}}}";
+
+  size_t items = 0;
+  visitor.subscribe<test::MessageT>({"entries"}, [&](const test::MessageT& message)
+  {
+    items++;
+    TEST_CHECK(message.entries.size() == 3);
+    if (message.entries.size() == 3)
+    {
+      TEST_CHECK(message.entries[0]->id == "k1");
+      TEST_CHECK(message.entries[0]->val && (message.entries[0]->val->value == 1));
+      TEST_CHECK(message.entries[1]->id == "k2");
+      TEST_CHECK(message.entries[1]->val && (message.entries[1]->val->tags.size() == 1));
+      TEST_CHECK(message.entries[2]->id == "k3");
+    }
+    return true;
+  });
+
+  TEST_CHECK(test_feed(visitor, json, json.size()));
+  TEST_CHECK(items == 1);
+}
+
+static void
+test_whole_numbers()
+{
+  FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+
+  // An integer field takes a whole number in any form, as the direct
+  // builder does, while a (flexbuffer) value keeps it as a double
+  for (auto mode : {FlatbuffersStreamingJsonBuildMode::ReserializeJson, FlatbuffersStreamingJsonBuildMode::DirectBuilder})
+  {
+    TestVisitor visitor(parser, mode);
+
+    for (const std::string& count : {"15", "1.5e1", "1.5E+1", "15.0", "150e-1", "2e0"})
+    {
+      const std::string json = "{\"count\":" + count + ",\"meta\":{\"d\":" + count + "}}";
+      auto expected = (count == "2e0")? 2 : 15;
+
+      size_t items = 0;
+      visitor.clear_subscriptions();
+      visitor.subscribe<test::MessageT>({}, std::function<bool(const test::Message*)>(
+        [&](const test::Message* message)
+        {
+          items++;
+          TEST_CHECK(message->count() == expected);
+
+          auto d = message->meta_flexbuffer_root().AsMap()["d"];
+          TEST_CHECK((count == "15")? d.IsInt() : d.IsFloat());
+          TEST_CHECK(d.AsInt64() == expected);
+          return true;
+        }));
+
+      TEST_CHECK(test_feed(visitor, json, json.size()));
+      TEST_CHECK(items == 1);
+    }
+
+    // Not whole, so not an integer
+    TEST_CHECK(!test_feed(visitor, "{\"count\":1.5}", 13));
+  }
+}
+
+static void
+test_root_item_failure()
+{
+  FlatbuffersStreamingJsonParser parser(get_test_text_schema(), get_test_binary_schema());
+  TestVisitor visitor(parser);
+
+  // A failing callback for the document root item fails the parse
+  visitor.subscribe<test::MessageT>({}, [](const test::MessageT&) { return false; });
+  TEST_CHECK(!test_feed(visitor, "{\"count\":1}", 11));
+}
+
+void
+test_reserialize()
+{
+  test_nested_objects();
+  test_nested_arrays();
+  test_empty_objects();
+  test_keyed_vector();
+  test_whole_numbers();
+  test_root_item_failure();
+}
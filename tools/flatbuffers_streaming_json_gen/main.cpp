@@ -0,0 +1,624 @@
+/*
+ * Copyright Paul Reimer, 2017
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+// Emits FlatbuffersStreamingJsonDecoder descriptors for each table and struct
+// of a binary schema (flatc -b --schema), which decode streamed JSON straight
+// into the gen-object-api native objects of flatc --cpp --gen-object-api.
+//
+// usage: flatbuffers_streaming_json_gen schema.bfbs schema_generated.h [ns.Table:key:val ...] > schema_streaming_json.h
+//
+// Each ns.Table:key:val names the key and value fields of a keyed table,
+// as FlatbuffersStreamingJsonKeyedTable does (otherwise "id" and "val")
+
+#include "flatbuffers/reflection.h"
+#include "flatbuffers/util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const reflection::Schema* schema = nullptr;
+
+struct KeyedTable
+{
+  std::string table;
+  std::string key_field;
+  std::string val_field;
+};
+static std::vector<KeyedTable> keyed_tables;
+
+// "ns.Name" to "ns::Name"
+static std::string
+cpp_name(const flatbuffers::String* name)
+{
+  std::string s;
+  for (auto ch : name->str())
+  {
+    if (ch == '.')
+    {
+      s += "::";
+    }
+    else {
+      s.push_back(ch);
+    }
+  }
+  return s;
+}
+
+// "ns.Name" to "ns_Name"
+static std::string
+ident(const flatbuffers::String* name)
+{
+  std::string s = name->str();
+  for (auto& ch : s)
+  {
+    if (ch == '.')
+    {
+      ch = '_';
+    }
+  }
+  return s;
+}
+
+static std::string
+quoted(const std::string& s)
+{
+  return "\"" + s + "\"";
+}
+
+static bool
+has_attribute(const reflection::Field* field, const char* key)
+{
+  return (
+    (field->attributes() != nullptr) &&
+    (field->attributes()->LookupByKey(key) != nullptr)
+  );
+}
+
+static const char*
+scalar_type(reflection::BaseType base_type)
+{
+  switch (base_type)
+  {
+    case reflection::Bool:   return "bool";
+    case reflection::Byte:   return "int8_t";
+    case reflection::UByte:  return "uint8_t";
+    case reflection::Short:  return "int16_t";
+    case reflection::UShort: return "uint16_t";
+    case reflection::Int:    return "int32_t";
+    case reflection::UInt:   return "uint32_t";
+    case reflection::Long:   return "int64_t";
+    case reflection::ULong:  return "uint64_t";
+    case reflection::Float:  return "float";
+    case reflection::Double: return "double";
+    default:                 return nullptr;
+  }
+}
+
+static bool
+is_real(reflection::BaseType base_type)
+{
+  return ((base_type == reflection::Float) || (base_type == reflection::Double));
+}
+
+static const reflection::Object*
+get_object(int32_t index)
+{
+  return schema->objects()->Get(index);
+}
+
+// The key and value field names of a table
+static void
+get_keyed_fields(
+  const reflection::Object* object,
+  std::string& key_field,
+  std::string& val_field)
+{
+  key_field = "id";
+  val_field = "val";
+  for (const auto& keyed_table : keyed_tables)
+  {
+    if (object->name()->str() == keyed_table.table)
+    {
+      key_field = keyed_table.key_field;
+      val_field = keyed_table.val_field;
+    }
+  }
+}
+
+// A table of {key, val}, where val is a table or struct
+static bool
+is_keyed_table(const reflection::Object* object)
+{
+  if (object->is_struct())
+  {
+    return false;
+  }
+
+  std::string key_name;
+  std::string val_name;
+  get_keyed_fields(object, key_name, val_name);
+
+  auto id_field = object->fields()->LookupByKey(key_name.c_str());
+  auto val_field = object->fields()->LookupByKey(val_name.c_str());
+  return (
+    (id_field != nullptr) &&
+    (val_field != nullptr) &&
+    (id_field != val_field) &&
+    (val_field->type()->base_type() == reflection::Obj)
+  );
+}
+
+static std::string
+native_type(const reflection::Object* object)
+{
+  return cpp_name(object->name()) + (object->is_struct()? "" : "T");
+}
+
+static std::string
+decoder_table(const reflection::Object* object)
+{
+  return ident(object->name()) + "_decoder_table()";
+}
+
+static std::string
+enum_find_value(int32_t index)
+{
+  return "&" + ident(schema->enums()->Get(index)->name()) + "_find_value";
+}
+
+// Emits a switch on length, then on bytes, of each name
+static void
+print_name_switch(
+  const std::vector<std::pair<std::string, std::string>>& cases,
+  const char* param)
+{
+  size_t max_size = 0;
+  for (const auto& c : cases)
+  {
+    max_size = std::max(max_size, c.first.size());
+  }
+
+  printf("  switch (%s.size())\n  {\n", param);
+  for (size_t size = 0; size <= max_size; ++size)
+  {
+    bool any = false;
+    for (const auto& c : cases)
+    {
+      if (c.first.size() != size)
+      {
+        continue;
+      }
+
+      if (!any)
+      {
+        printf("    case %u:\n", (unsigned)size);
+        any = true;
+      }
+      printf("      if (memcmp(%s.data(), %s, %u) == 0) { %s }\n",
+        param, quoted(c.first).c_str(), (unsigned)size, c.second.c_str());
+    }
+
+    if (any)
+    {
+      printf("      break;\n");
+    }
+  }
+  printf("    default:\n      break;\n  }\n");
+}
+
+static void
+print_enum(const reflection::Enum* e)
+{
+  std::vector<std::pair<std::string, std::string>> cases;
+  for (auto val : *e->values())
+  {
+    cases.push_back(std::make_pair(
+      val->name()->str(),
+      "i = " + flatbuffers::NumToString(val->value()) + "; return true;"));
+  }
+
+  printf("inline bool\n%s_find_value(stx::string_view name, int64_t& i)\n{\n", ident(e->name()).c_str());
+  print_name_switch(cases, "name");
+  printf("  return false;\n}\n\n");
+}
+
+static const char*
+field_kind(const reflection::Field* field)
+{
+  auto type = field->type();
+  switch (type->base_type())
+  {
+    case reflection::String:
+      return "DecoderScalarField";
+
+    case reflection::Obj:
+      return "DecoderObjectField";
+
+    case reflection::Vector:
+      if (type->element() == reflection::Obj)
+      {
+        return is_keyed_table(get_object(type->index()))?
+          "DecoderKeyedVectorField" : "DecoderObjectVectorField";
+      }
+      if ((type->element() == reflection::String) ||
+          (scalar_type(type->element()) != nullptr))
+      {
+        return "DecoderScalarVectorField";
+      }
+      return "DecoderUnsupportedField";
+
+    default:
+      return (scalar_type(type->base_type()) != nullptr)?
+        "DecoderScalarField" : "DecoderUnsupportedField";
+  }
+}
+
+// Decode a scalar value of base_type (and enum index) into lvalue
+static std::string
+decode_scalar(reflection::BaseType base_type, int32_t index, const std::string& lvalue)
+{
+  if (index >= 0)
+  {
+    return "flatbuffers_streaming_json_decode_enum(value, " + enum_find_value(index) + ", " + lvalue + ")";
+  }
+  if (base_type == reflection::Bool)
+  {
+    return "flatbuffers_streaming_json_decode_bool(value, " + lvalue + ")";
+  }
+  if (is_real(base_type))
+  {
+    return "flatbuffers_streaming_json_decode_real(value, " + lvalue + ")";
+  }
+  return "flatbuffers_streaming_json_decode_integer(value, " + lvalue + ")";
+}
+
+static std::string
+enum_cpp_type(int32_t index)
+{
+  return cpp_name(schema->enums()->Get(index)->name());
+}
+
+static void
+print_table_set_value(const reflection::Field* field)
+{
+  auto type = field->type();
+  auto name = field->name()->str();
+  auto base_type = type->base_type();
+
+  if (base_type == reflection::String)
+  {
+    printf("      return flatbuffers_streaming_json_decode_string(value, obj->%s);\n", name.c_str());
+  }
+  else if (base_type == reflection::Vector)
+  {
+    auto element = type->element();
+    if (element == reflection::String)
+    {
+      printf("      obj->%s.emplace_back();\n", name.c_str());
+      printf("      if (flatbuffers_streaming_json_decode_string(value, obj->%s.back())) { return true; }\n", name.c_str());
+      printf("      obj->%s.pop_back();\n", name.c_str());
+      printf("      return false;\n");
+    }
+    else {
+      printf("      %s v;\n", scalar_type(element));
+      printf("      if (!%s) { return false; }\n", decode_scalar(element, type->index(), "v").c_str());
+      if (type->index() >= 0)
+      {
+        printf("      obj->%s.push_back(static_cast<%s>(v));\n", name.c_str(), enum_cpp_type(type->index()).c_str());
+      }
+      else {
+        printf("      obj->%s.push_back(v);\n", name.c_str());
+      }
+      printf("      return true;\n");
+    }
+  }
+  else if (type->index() >= 0)
+  {
+    printf("      %s v;\n", scalar_type(base_type));
+    printf("      if (!%s) { return false; }\n", decode_scalar(base_type, type->index(), "v").c_str());
+    printf("      obj->%s = static_cast<%s>(v);\n", name.c_str(), enum_cpp_type(type->index()).c_str());
+    printf("      return true;\n");
+  }
+  else {
+    printf("      return %s;\n", decode_scalar(base_type, -1, "obj->" + name).c_str());
+  }
+}
+
+static void
+print_struct_set_value(const reflection::Field* field)
+{
+  auto type = field->type();
+  auto base_type = type->base_type();
+  auto storage_type = (base_type == reflection::Bool)? "uint8_t" : scalar_type(base_type);
+
+  if (type->index() >= 0)
+  {
+    printf("      return flatbuffers_streaming_json_decode_struct_enum<%s>(value, %s, obj, %u);\n",
+      storage_type, enum_find_value(type->index()).c_str(), (unsigned)field->offset());
+  }
+  else if (base_type == reflection::Bool)
+  {
+    printf("      return flatbuffers_streaming_json_decode_struct_bool(value, obj, %u);\n",
+      (unsigned)field->offset());
+  }
+  else if (is_real(base_type))
+  {
+    printf("      return flatbuffers_streaming_json_decode_struct_real<%s>(value, obj, %u);\n",
+      storage_type, (unsigned)field->offset());
+  }
+  else {
+    printf("      return flatbuffers_streaming_json_decode_struct_integer<%s>(value, obj, %u);\n",
+      storage_type, (unsigned)field->offset());
+  }
+}
+
+static void
+print_start_object(const reflection::Object* object, const reflection::Field* field)
+{
+  auto type = field->type();
+  auto name = field->name()->str();
+  auto child = get_object(type->index());
+  bool inline_child = (child->is_struct() && (type->base_type() == reflection::Vector)) ||
+    has_attribute(field, "native_inline");
+
+  printf("      *table = %s;\n", decoder_table(child).c_str());
+  if (object->is_struct())
+  {
+    // Nested structs are stored in place
+    printf("      return (static_cast<uint8_t*>(_obj) + %u);\n", (unsigned)field->offset());
+  }
+  else if (type->base_type() == reflection::Vector)
+  {
+    if (inline_child)
+    {
+      printf("      obj->%s.emplace_back();\n", name.c_str());
+      printf("      return &obj->%s.back();\n", name.c_str());
+    }
+    else {
+      printf("      obj->%s.emplace_back(new %s());\n", name.c_str(), native_type(child).c_str());
+      printf("      return obj->%s.back().get();\n", name.c_str());
+    }
+  }
+  else if (inline_child)
+  {
+    printf("      obj->%s = %s();\n", name.c_str(), native_type(child).c_str());
+    printf("      return &obj->%s;\n", name.c_str());
+  }
+  else {
+    printf("      obj->%s.reset(new %s());\n", name.c_str(), native_type(child).c_str());
+    printf("      return obj->%s.get();\n", name.c_str());
+  }
+}
+
+static void
+print_object(const reflection::Object* object)
+{
+  auto id = ident(object->name());
+  auto native = native_type(object);
+  auto fields = object->fields();
+
+  // find_field
+  std::vector<std::pair<std::string, std::string>> cases;
+  for (flatbuffers::uoffset_t f = 0; f < fields->size(); ++f)
+  {
+    auto field = fields->Get(f);
+    if (!field->deprecated())
+    {
+      cases.push_back(std::make_pair(
+        field->name()->str(),
+        "return " + flatbuffers::NumToString(f) + ";"));
+    }
+  }
+
+  printf("inline int\n%s_find_field(stx::string_view key)\n{\n", id.c_str());
+  print_name_switch(cases, "key");
+  printf("  return -1;\n}\n\n");
+
+  // get_field_kind
+  printf("inline FlatbuffersStreamingJsonDecoderFieldKind\n%s_get_field_kind(int field)\n{\n", id.c_str());
+  printf("  switch (field)\n  {\n");
+  for (flatbuffers::uoffset_t f = 0; f < fields->size(); ++f)
+  {
+    printf("    case %u: return %s;\n", (unsigned)f, field_kind(fields->Get(f)));
+  }
+  printf("    default: return DecoderUnsupportedField;\n  }\n}\n\n");
+
+  // set_value
+  printf("inline bool\n%s_set_value(void* _obj, int field, const FlatbuffersStreamingJsonDecoderValue& value)\n{\n", id.c_str());
+  if (!object->is_struct())
+  {
+    printf("  auto obj = static_cast<%s*>(_obj);\n", native.c_str());
+  }
+  else {
+    printf("  auto obj = _obj;\n");
+  }
+  printf("  (void)obj;\n  (void)value;\n");
+  printf("  switch (field)\n  {\n");
+  for (flatbuffers::uoffset_t f = 0; f < fields->size(); ++f)
+  {
+    auto field = fields->Get(f);
+    if (strcmp(field_kind(field), "DecoderScalarField") &&
+        strcmp(field_kind(field), "DecoderScalarVectorField"))
+    {
+      continue;
+    }
+
+    printf("    case %u:\n    {\n", (unsigned)f);
+    if (object->is_struct())
+    {
+      print_struct_set_value(field);
+    }
+    else {
+      print_table_set_value(field);
+    }
+    printf("    }\n");
+  }
+  printf("    default:\n      return false;\n  }\n}\n\n");
+
+  // start_object
+  printf("inline void*\n%s_start_object(void* _obj, int field, const FlatbuffersStreamingJsonDecoderTable** table)\n{\n", id.c_str());
+  if (!object->is_struct())
+  {
+    printf("  auto obj = static_cast<%s*>(_obj);\n  (void)obj;\n", native.c_str());
+  }
+  printf("  (void)_obj;\n  (void)table;\n");
+  printf("  switch (field)\n  {\n");
+  for (flatbuffers::uoffset_t f = 0; f < fields->size(); ++f)
+  {
+    auto field = fields->Get(f);
+    if (strcmp(field_kind(field), "DecoderObjectField") &&
+        strcmp(field_kind(field), "DecoderObjectVectorField") &&
+        strcmp(field_kind(field), "DecoderKeyedVectorField"))
+    {
+      continue;
+    }
+
+    printf("    case %u:\n    {\n", (unsigned)f);
+    print_start_object(object, field);
+    printf("    }\n");
+  }
+  printf("    default:\n      return nullptr;\n  }\n}\n\n");
+
+  // Descriptor
+  int id_field = -1;
+  int val_field = -1;
+  if (is_keyed_table(object))
+  {
+    std::string key_name;
+    std::string val_name;
+    get_keyed_fields(object, key_name, val_name);
+
+    for (flatbuffers::uoffset_t f = 0; f < fields->size(); ++f)
+    {
+      auto name = fields->Get(f)->name()->str();
+      if (name == key_name)
+      {
+        id_field = f;
+      }
+      else if (name == val_name)
+      {
+        val_field = f;
+      }
+    }
+  }
+
+  printf("inline const FlatbuffersStreamingJsonDecoderTable*\n%s\n{\n", decoder_table(object).c_str());
+  printf("  static const FlatbuffersStreamingJsonDecoderTable table = {\n");
+  printf("    %s,\n", quoted(object->name()->str()).c_str());
+  printf("    &%s_find_field,\n", id.c_str());
+  printf("    &%s_get_field_kind,\n", id.c_str());
+  printf("    &%s_set_value,\n", id.c_str());
+  printf("    &%s_start_object,\n", id.c_str());
+  printf("    %d,\n    %d,\n", id_field, val_field);
+  printf("    %u,\n", object->is_struct()? (unsigned)fields->size() : 0u);
+  printf("  };\n  return &table;\n}\n\n");
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "usage: %s schema.bfbs schema_generated.h [ns.Table:key:val ...] > schema_streaming_json.h\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 3; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    auto key_sep = arg.find(':');
+    auto val_sep = (key_sep != std::string::npos)? arg.find(':', key_sep + 1) : std::string::npos;
+    if (val_sep == std::string::npos)
+    {
+      fprintf(stderr, "Keyed table '%s' is not of the form ns.Table:key:val\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+
+    keyed_tables.push_back({
+      arg.substr(0, key_sep),
+      arg.substr(key_sep + 1, val_sep - key_sep - 1),
+      arg.substr(val_sep + 1),
+    });
+  }
+
+  std::string bfbs;
+  if (!flatbuffers::LoadFile(argv[1], true, &bfbs))
+  {
+    fprintf(stderr, "Could not read '%s'\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  flatbuffers::Verifier verifier(
+    reinterpret_cast<const uint8_t*>(bfbs.data()), bfbs.size());
+  if (!reflection::VerifySchemaBuffer(verifier))
+  {
+    fprintf(stderr, "Invalid binary schema '%s'\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  schema = reflection::GetSchema(bfbs.data());
+  auto objects = schema->objects();
+
+  for (const auto& keyed_table : keyed_tables)
+  {
+    auto object = objects->LookupByKey(keyed_table.table.c_str());
+    if ((object == nullptr) || !is_keyed_table(object))
+    {
+      fprintf(stderr, "Keyed table '%s' or its fields not found\n", keyed_table.table.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("// Generated by flatbuffers_streaming_json_gen from %s, do not modify\n", argv[1]);
+  printf("#pragma once\n\n");
+  printf("#include \"%s\"\n\n", argv[2]);
+  printf("#include \"flatbuffers_streaming_json_decoder.h\"\n\n");
+  printf("#include <cstring>\n\n");
+  printf("namespace flatbuffers_streaming_json_decoders {\n\n");
+
+  for (flatbuffers::uoffset_t i = 0; i < objects->size(); ++i)
+  {
+    printf("inline const FlatbuffersStreamingJsonDecoderTable* %s;\n", decoder_table(objects->Get(i)).c_str());
+  }
+  printf("\n");
+
+  for (auto e : *schema->enums())
+  {
+    if (!e->is_union())
+    {
+      print_enum(e);
+    }
+  }
+
+  for (flatbuffers::uoffset_t i = 0; i < objects->size(); ++i)
+  {
+    print_object(objects->Get(i));
+  }
+
+  printf("} // namespace flatbuffers_streaming_json_decoders\n\n");
+
+  for (flatbuffers::uoffset_t i = 0; i < objects->size(); ++i)
+  {
+    auto object = objects->Get(i);
+    if (object->is_struct())
+    {
+      continue;
+    }
+
+    printf("template<>\nstruct FlatbuffersStreamingJsonDecoderTraits<%s>\n{\n", native_type(object).c_str());
+    printf("  static const FlatbuffersStreamingJsonDecoderTable* get_table()\n  {\n");
+    printf("    return flatbuffers_streaming_json_decoders::%s;\n  }\n};\n\n", decoder_table(object).c_str());
+  }
+
+  return EXIT_SUCCESS;
+}